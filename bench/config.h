@@ -0,0 +1,29 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// the benchmarks build the log with the serial sink, utx_write is a stub
+// that counts the bytes so the time is spent in log_vprintf. the archive
+// benchmark adds __MEMORY_DEBUG__ on the command line
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#define __SERIAL_DEBUG__
+
+#endif //__CONFIG_H__
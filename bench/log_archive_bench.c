@@ -0,0 +1,206 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// measures the archive of the memory log on the host. every case logs
+// BENCH_RECORDS records worth of lines into the ring of cpu 0, running
+// the archive blocks after every line as dfr_drain would, and then reads
+// the ring back through LOG_FUNCTION_RING_READ. the ratio of the bytes
+// archived to the bytes they take in the archive, the time spent
+// compressing a byte and the records that are still found are printed
+// next to what the ring alone and the 256 record ring it replaced keep
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// as in inc/log.h and inc/cpu.h
+#define BENCH_RING_RECORDS     64
+#define BENCH_OLD_RING_RECORDS 256
+#define BENCH_RECORD_DATA_SIZE 40
+#define BENCH_CPUS             4
+
+#define BENCH_RECORDS 2000
+#define BENCH_READ    64
+
+typedef struct bench_record bench_record_t;
+typedef struct bench_registers bench_registers_t;
+typedef struct bench_case bench_case_t;
+
+// log_record_t
+struct bench_record {
+	unsigned int sequence;
+	unsigned int type;
+	unsigned int size;
+	unsigned int cpu;
+	unsigned int timestamp_low;
+	unsigned int timestamp_high;
+	unsigned char data[BENCH_RECORD_DATA_SIZE];
+};
+
+// the handlers use r0 to r5, the rest stands in for the other registers
+struct bench_registers {
+	unsigned int r[32];
+};
+
+struct bench_case {
+	const char *name;
+	unsigned int (* function)(unsigned int i);
+};
+
+extern unsigned int log_init(void);
+extern unsigned int log_fini(void);
+extern unsigned int log_ring_init(void);
+extern unsigned int log_printf(const char *fmt, ...);
+extern void log_binary_printf(const char *fmt, unsigned int count, ...);
+extern unsigned int log_call_ring_read_handler(void *handler, void *data, bench_registers_t *registers);
+extern unsigned int log_call_archive_handler(void *handler, void *data, bench_registers_t *registers);
+
+extern unsigned long long log_stub_bytes;
+extern void *log_stub_data;
+extern void log_stub_drain(void);
+
+// static so the addresses fit into the 32 bit registers
+static bench_record_t bench_records[BENCH_READ];
+static unsigned int bench_sequences[BENCH_CPUS];
+
+static unsigned int bench_handlers[] = { 0xC0012340, 0xC0012A88, 0xC0013F00, 0xC0014B2C };
+
+// a text line takes a record for every BENCH_RECORD_DATA_SIZE bytes
+static unsigned int bench_text_records(void) {
+	return (unsigned int)((log_stub_bytes + (BENCH_RECORD_DATA_SIZE - 1)) / BENCH_RECORD_DATA_SIZE);
+}
+
+// the lines vec_dispatch_handler writes at DBG_LEVEL_3
+static unsigned int bench_text(unsigned int i) {
+
+	log_stub_bytes = 0;
+
+	log_printf("vec: vector %u handler %08x cycles %u\n", (i & 7), bench_handlers[i & 3], 180 + ((i * 37) & 63));
+
+	return bench_text_records();
+}
+
+static unsigned int bench_binary(unsigned int i) {
+
+	log_binary_printf("vec: vector %u handler %08x cycles %u\n", 3, (i & 7), bench_handlers[i & 3], 180 + ((i * 37) & 63));
+
+	return 1;
+}
+
+// dispatches with the odd abort and module load in between
+static unsigned int bench_mixed(unsigned int i) {
+
+	log_stub_bytes = 0;
+
+	if((i % 13) == 0) {
+		log_printf("abt: dfsr %08x dfar %08x pc %08x\n", 0x817, 0xBEEF0000 + (i << 4), bench_handlers[i & 3] + 0x1C);
+	}
+	else if((i % 29) == 0) {
+		log_printf("[+] adding module %u at %08x size %u\n", (i / 29), 0xC0100000 + (i << 12), 0x3000 + (i & 0xFF0));
+	}
+	else {
+		log_printf("vec: vector %u handler %08x cycles %u\n", (i & 7), bench_handlers[i & 3], 180 + ((i * 37) & 63));
+	}
+
+	return bench_text_records();
+}
+
+static bench_case_t bench_cases[] = {
+	{ "text", bench_text },
+	{ "binary", bench_binary },
+	{ "mixed", bench_mixed }
+};
+
+// the records of the ring of cpu 0 that are still found, the first one
+// logged has sequence 0
+static unsigned int bench_retained(void) {
+
+	bench_registers_t registers;
+	unsigned int retained;
+	unsigned int i;
+
+	memset(bench_sequences, 0, sizeof(bench_sequences));
+
+	retained = 0;
+
+	do {
+		memset(&registers, 0, sizeof(bench_registers_t));
+
+		registers.r[3] = (unsigned int)(unsigned long)bench_records;
+		registers.r[4] = (unsigned int)(unsigned long)bench_sequences;
+		registers.r[5] = BENCH_READ;
+
+		log_call_ring_read_handler(NULL, log_stub_data, &registers);
+
+		for(i = 0; i < registers.r[1]; i++) {
+			if(bench_records[i].cpu == 0) {
+				retained++;
+			}
+		}
+	} while((registers.r[0] == 0) && (registers.r[1] != 0));
+
+	return retained;
+}
+
+int main(int argc, char *argv[]) {
+
+	bench_registers_t registers;
+	unsigned int records;
+	unsigned int retained;
+	unsigned int total;
+	unsigned int i, j;
+
+	total = BENCH_RECORDS;
+
+	if(argc > 1) {
+		total = strtoul(argv[1], NULL, 0);
+	}
+
+	printf("%-8s %8s %8s %8s %10s %8s %8s\n", "case", "records", "ratio", "ns/byte", "retained", "ring", "old");
+
+	for(i = 0; i < (sizeof(bench_cases) / sizeof(bench_case_t)); i++) {
+
+		// a new state for the caches and empty rings and archives
+		if((log_init() != 0) || (log_ring_init() != 0)) {
+			printf("unable to initialize the log\n");
+			return 1;
+		}
+
+		for(records = 0, j = 0; records < total; j++) {
+			records += bench_cases[i].function(j);
+			log_stub_drain();
+		}
+
+		retained = bench_retained();
+
+		memset(&registers, 0, sizeof(bench_registers_t));
+
+		log_call_archive_handler(NULL, log_stub_data, &registers);
+
+		printf("%-8s %8u %8.2f %8.2f %10u %8u %8u\n", bench_cases[i].name, records,
+			(registers.r[2] == 0) ? 0.0 : ((double)registers.r[1] / registers.r[2]),
+			(registers.r[1] == 0) ? 0.0 : ((double)registers.r[3] / registers.r[1]),
+			retained, ((records < BENCH_RING_RECORDS) ? records : BENCH_RING_RECORDS),
+			((records < BENCH_OLD_RING_RECORDS) ? records : BENCH_OLD_RING_RECORDS));
+
+		log_fini();
+	}
+
+	return 0;
+}
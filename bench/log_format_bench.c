@@ -0,0 +1,129 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// measures log_vprintf on the host. every case is formatted repeatedly
+// and the time per call and the formatted bytes per second are printed.
+// the only sink is a utx_write that counts the bytes, see config.h, so
+// the parsing of the format, the argument collection and the formatting
+// are measured
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 1000000
+
+extern unsigned int log_printf(const char *fmt, ...);
+
+extern unsigned long long log_stub_bytes;
+
+typedef struct bench_case bench_case_t;
+
+struct bench_case {
+	const char *name;
+	void (* function)(void);
+};
+
+static void bench_literal(void) {
+	log_printf("vec_dispatch_handler: the handler was demoted to the deferred queue\n");
+}
+
+static void bench_hex(void) {
+	log_printf("%x %x %x %x\n", 0xDEADBEEF, 0x1F, 0x80000000, 0x0);
+}
+
+static void bench_padded(void) {
+	log_printf("%08x: %08x %08x %08x %08x\n", 0xC0008000, 0xE59F0000, 0xE1A00000, 0xEAFFFFFE, 0x0);
+}
+
+static void bench_decimal(void) {
+	log_printf("cpu %u depth %d handled %u cycles %10u\n", 3, -1, 1, 123456);
+}
+
+static void bench_wide(void) {
+	log_printf("timestamp %llu offset %016llX\n", 0x0123456789ABCDEFULL, 0xFEDCBA9876543210ULL);
+}
+
+static void bench_string(void) {
+	log_printf("[+] %s %-12s|%.4s\n", "adding module", "trc", "vertigo");
+}
+
+static void bench_mixed(void) {
+	log_printf("abt: dfsr %08x dfar %08x pc %08x mode %s count %u\n", 0x817, 0xBEEF0000, 0xC0012345, "svc", 42);
+}
+
+static bench_case_t bench_cases[] = {
+	{ "literal", bench_literal },
+	{ "hex", bench_hex },
+	{ "padded", bench_padded },
+	{ "decimal", bench_decimal },
+	{ "wide", bench_wide },
+	{ "string", bench_string },
+	{ "mixed", bench_mixed }
+};
+
+static double bench_now(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + (now.tv_nsec / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+
+	unsigned int iterations;
+	unsigned int i, j;
+	double start, elapsed;
+	double bytes;
+
+	iterations = BENCH_ITERATIONS;
+
+	if(argc > 1) {
+		iterations = strtoul(argv[1], NULL, 0);
+	}
+
+	printf("%-8s %12s %10s %10s\n", "case", "calls", "ns/call", "MB/s");
+
+	for(i = 0; i < (sizeof(bench_cases) / sizeof(bench_case_t)); i++) {
+
+		// warm the caches and the branch predictors
+		for(j = 0; j < (iterations / 100); j++) {
+			bench_cases[i].function();
+		}
+
+		log_stub_bytes = 0;
+
+		start = bench_now();
+
+		for(j = 0; j < iterations; j++) {
+			bench_cases[i].function();
+		}
+
+		elapsed = bench_now() - start;
+
+		bytes = (double)log_stub_bytes;
+
+		printf("%-8s %12u %10.1f %10.1f\n", bench_cases[i].name, iterations, (elapsed * 1e9) / iterations, (bytes / elapsed) / 1e6);
+	}
+
+	return 0;
+}
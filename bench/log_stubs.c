@@ -0,0 +1,222 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// host stand-ins for the microvisor functions that src/log.c calls. the
+// benchmarks run on one thread so the atomics and barriers are plain
+// operations. the prototypes come from the kernel headers so a change to
+// one of them breaks the build here as well
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <fxplib/gen.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
+#include <kernel/mas.h>
+#include <kernel/utx.h>
+#include <kernel/vec.h>
+
+// the stubs allocate from the host heap, not through mas
+#undef malloc
+#undef memalign
+#undef free
+
+// the bytes passed to utx_write
+unsigned long long log_stub_bytes = 0;
+
+void *gen_add_base(const void *address) {
+	return (void *)address;
+}
+
+void *gen_subtract_base(const void *address) {
+	return (void *)address;
+}
+
+void *mas_alloc(size_t alignment, size_t size) {
+
+	void *pointer;
+
+	if(posix_memalign(&pointer, alignment, size) != 0) {
+		return NULL;
+	}
+
+	return pointer;
+}
+
+void mas_free(void *ptr) {
+	free(ptr);
+}
+
+size_t cpu_get_id(void) {
+	return 0;
+}
+
+void cpu_data_memory_barrier(void) {
+	__sync_synchronize();
+}
+
+size_t cpu_atomic_add(size_t *address, size_t value) {
+
+	size_t old;
+
+	old = *address;
+	*address += value;
+
+	return old;
+}
+
+size_t cpu_atomic_compare_and_swap(size_t *address, size_t expected, size_t value) {
+
+	size_t old;
+
+	old = *address;
+
+	if(old == expected) {
+		*address = value;
+	}
+
+	return old;
+}
+
+size_t cpu_get_cycle_count(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (size_t)((now.tv_sec * 1000000000ULL) + now.tv_nsec);
+}
+
+// nanoseconds stand in for the count of the generic timer
+size_t cpu_get_timestamp(size_t *high) {
+
+	struct timespec now;
+	unsigned long long value;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	value = (now.tv_sec * 1000000000ULL) + now.tv_nsec;
+
+	*high = (size_t)(value >> 32);
+
+	return (size_t)value;
+}
+
+result_t utx_write(u8_t *buffer, size_t size) {
+
+	(void)buffer;
+
+	log_stub_bytes += size;
+
+	return SUCCESS;
+}
+
+// there is only one thread, nothing can still be using the memory
+result_t vec_retire(void *pointer) {
+
+	free(pointer);
+
+	return SUCCESS;
+}
+
+#define LOG_STUB_ITEMS 64
+
+dfr_item_t log_stub_items[LOG_STUB_ITEMS];
+size_t log_stub_queued = 0;
+
+// the data log_init registered with its handler table
+void *log_stub_data = NULL;
+
+result_t dfr_enqueue(dfr_function_t function, void *data, size_t argument, gen_general_purpose_registers_t *registers) {
+
+	(void)registers;
+
+	// nothing drains the queue until log_stub_drain, the caller sees a
+	// full queue as the kernel one
+	if(log_stub_queued == LOG_STUB_ITEMS) {
+		return FAILURE;
+	}
+
+	memset(&(log_stub_items[log_stub_queued]), 0, sizeof(dfr_item_t));
+
+	log_stub_items[log_stub_queued].function = function;
+	log_stub_items[log_stub_queued].data = data;
+	log_stub_items[log_stub_queued].argument = argument;
+
+	log_stub_queued++;
+
+	return SUCCESS;
+}
+
+// runs the queued items the way dfr_drain does once the exception that
+// queued them has returned
+void log_stub_drain(void) {
+
+	size_t i;
+
+	for(i = 0; i < log_stub_queued; i++) {
+		log_stub_items[i].function(&(log_stub_items[i]));
+	}
+
+	log_stub_queued = 0;
+}
+
+result_t call_register_handler_table(size_t identifier, call_function_t *functions, size_t size, void *data) {
+
+	(void)identifier;
+	(void)functions;
+	(void)size;
+
+	log_stub_data = data;
+
+	return SUCCESS;
+}
+
+result_t call_unregister_handler_table(size_t identifier, call_function_t *functions) {
+
+	(void)identifier;
+	(void)functions;
+
+	return SUCCESS;
+}
+
+result_t call_register_leaf(size_t identifier, vec_leaf_function_t function) {
+
+	(void)identifier;
+	(void)function;
+
+	return SUCCESS;
+}
+
+result_t call_unregister_leaf(size_t identifier, vec_leaf_function_t function) {
+
+	(void)identifier;
+	(void)function;
+
+	return SUCCESS;
+}
@@ -0,0 +1,79 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_ABT_H__
+#define __KERNEL_ABT_H__
+
+// ABT - Abort dispatch filtered by the fault address
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/vec.h>
+
+#define ABT_DATA_ABORT     0 // keyed on the dfar
+#define ABT_PREFETCH_ABORT 1 // keyed on the ifar
+#define ABT_NUMBER_OF_TYPES 2
+
+#ifdef __C__
+
+typedef struct abt_handler abt_handler_t;
+typedef struct abt_entry abt_entry_t;
+typedef struct abt_index abt_index_t;
+
+typedef result_t (* abt_function_t)(abt_handler_t *handler, size_t address, bool_t *handled, gen_general_purpose_registers_t *registers);
+
+struct abt_handler {
+	size_t type;             ///< ABT_DATA_ABORT or ABT_PREFETCH_ABORT.
+	size_t start;            ///< First fault address covered by the handler.
+	size_t end;              ///< Last fault address covered by the handler (inclusive).
+	abt_function_t function; ///< Function called for faults inside the range.
+	void *data;              ///< Data passed by the caller of abt_register_handler.
+};
+
+struct abt_entry {
+	size_t start;            ///< Copy of handler->start so the search stays in the index.
+	size_t end;              ///< Copy of handler->end.
+	size_t maximum;          ///< Largest end of this and every entry before it.
+	abt_handler_t *handler;
+};
+
+// the entries are sorted by start. maximum lets a lookup stop walking
+// back as soon as no earlier range can reach the fault address, so a
+// fault nobody registered for costs a binary search and one compare.
+struct abt_index {
+	size_t size;
+	abt_entry_t entries[];
+};
+
+extern result_t abt_init(void);
+extern result_t abt_fini(void);
+extern result_t abt_register_handler(size_t type, size_t start, size_t size, abt_function_t function, void *data);
+extern result_t abt_unregister_handler(size_t type, size_t start, abt_function_t function);
+extern result_t abt_rebuild_index(size_t type, abt_handler_t *handler, bool_t remove);
+extern result_t abt_dispatch(size_t type, size_t address, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t abt_vec_data_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t abt_vec_prefetch_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t abt_get_debug_level(size_t *level);
+extern result_t abt_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_ABT_H__
@@ -0,0 +1,110 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_ASY_H__
+#define __KERNEL_ASY_H__
+
+// ASY - Asynchronous hypercalls
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+#include <kernel/dfr.h>
+
+#define ASY_CALL_IDENTIFIER 0x99999999
+
+#define ASY_FUNCTION_SUBMIT     0 ///< Queue a hypercall on the current cpu. Input: r3 holds the identifier, r4 holds the sub-function, r5 - r10 hold the arguments. Output: r0 holds the result, r1 holds the ticket.
+#define ASY_FUNCTION_POLL       1 ///< Poll a ticket, a completed ticket is released. Input: r3 holds the ticket. Output: r0 holds the result, r1 holds the state, r2 - r6 hold r0 - r4 of the hypercall once the state is ASY_STATE_DONE.
+#define ASY_NUMBER_OF_FUNCTIONS 2
+
+#define ASY_STATE_FREE    0
+#define ASY_STATE_PENDING 1
+#define ASY_STATE_DONE    2
+
+// the state word of an entry holds the state in the low bits and the
+// generation above them, see ASY_TICKET_GENERATION_SHIFT
+#define ASY_STATE_MASK 0xFFFF
+
+#define ASY_TICKETS_SIZE 16 // tickets per cpu
+
+// a ticket is the index of the entry, the cpu it was submitted on and
+// the generation of the entry so a stale ticket is not mistaken for a
+// newer one
+#define ASY_TICKET_INDEX_MASK       0xFF
+#define ASY_TICKET_CPU_SHIFT        8
+#define ASY_TICKET_CPU_MASK         0xFF
+#define ASY_TICKET_GENERATION_SHIFT 16
+#define ASY_TICKET_GENERATION_MASK  0xFFFF
+
+#define ASY_SLICES_SIZE  4          // hypercalls that can run as a series of slices
+#define ASY_SLICE_CANCEL 0xFFFFFFFF // the slice a sliced hypercall gets when it has to give up
+
+#ifdef __C__
+
+typedef struct asy_ticket asy_ticket_t;
+typedef struct asy_cpu asy_cpu_t;
+typedef struct asy_slices asy_slices_t;
+
+// runs one slice of a hypercall, slices start at 0. it sets *done once
+// the hypercall is finished with its results in descriptor. context is
+// kept for it between the slices, ASY_SLICE_CANCEL asks it to release
+// whatever it holds
+typedef result_t (* asy_slice_function_t)(call_descriptor_t *descriptor, size_t slice, void **context, gen_general_purpose_registers_t *registers, bool_t *done);
+
+struct asy_ticket {
+	call_descriptor_t descriptor; ///< The hypercall, results are valid once state is ASY_STATE_DONE.
+	volatile size_t state;        ///< One of ASY_STATE_* and the generation, incremented every time the entry is handed out.
+	void *context;                ///< Kept between the slices of a sliced hypercall.
+};
+
+// entries are only handed out by their own cpu and only completed by its
+// deferred queue. a poll from any cpu releases an entry that is done with
+// a compare and swap of the whole state word, so only one poll gets the
+// results and a stale poll can not release a newer generation
+struct asy_cpu {
+	asy_ticket_t tickets[ASY_TICKETS_SIZE]; ///< The entries of the cpu.
+	size_t next;                            ///< Where the search for a free entry starts.
+	size_t submitted;                       ///< Number of hypercalls submitted.
+	size_t completed;                       ///< Number of hypercalls completed.
+};
+
+struct asy_slices {
+	size_t identifier;          ///< The identifier of the hypercall.
+	size_t function;            ///< The sub-function of the hypercall.
+	asy_slice_function_t slice; ///< Runs the slices, NULL for a free entry.
+};
+
+extern result_t asy_init(void);
+extern result_t asy_fini(void);
+extern result_t asy_submit(call_descriptor_t *descriptor, gen_general_purpose_registers_t *registers, size_t *ticket);
+extern result_t asy_poll(size_t ticket, size_t *state, call_descriptor_t *descriptor);
+extern result_t asy_register_slices(size_t identifier, size_t function, asy_slice_function_t slice);
+extern result_t asy_unregister_slices(size_t identifier, size_t function);
+extern asy_slice_function_t asy_lookup_slices(size_t identifier, size_t function);
+extern result_t asy_deferred_handler(dfr_item_t *item);
+extern result_t asy_call_submit_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t asy_call_poll_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t asy_get_debug_level(size_t *level);
+extern result_t asy_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_ASY_H__
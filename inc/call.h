@@ -5,29 +5,132 @@
 
 #include <armv7lib/gen.h>
 
+#include <kernel/cpu.h>
 #include <kernel/lst.h>
 #include <kernel/vec.h>
 
 #define CALL_DEFAULT_HANDLER 0xFFFF
 
+#define CALL_HANDLER_FLAG_NONE        0
+#define CALL_HANDLER_FLAG_OVER_BUDGET (1 << 0) // set by call_dispatch, cleared by call_set_handler_budget
+
+// the identifiers are hashed into an open addressed table that is
+// rebuilt from call_list whenever a handler is added or removed. it is
+// kept at most half full so a lookup only probes a few entries
+#define CALL_TABLE_SHIFT 6
+#define CALL_TABLE_SIZE  (1 << CALL_TABLE_SHIFT)
+#define CALL_TABLE_HASH  0x9E3779B1
+
+#define CALL_BATCH_IDENTIFIER 0x77777777
+
+#define CALL_BATCH_FUNCTION_EXECUTE    0 ///< Execute up to CALL_BATCH_LIMIT of an array of call_descriptor_t in order, the caller repeats it for the rest while r2 is not 0. Input: r3 holds a pointer to the array, r4 holds the number of descriptors, r5 holds the CALL_BATCH_FLAG_* flags. Output: r0 holds the result, r1 holds the number of descriptors executed, r2 holds the number of descriptors left.
+#define CALL_BATCH_NUMBER_OF_FUNCTIONS 1
+
+#define CALL_BATCH_FLAG_NONE          0
+#define CALL_BATCH_FLAG_STOP_ON_ERROR (1 << 0) // stop at the first descriptor that does not return SUCCESS in r0
+
+#define CALL_BATCH_LIMIT 16 // descriptors executed per trap so the time spent in one trap stays bounded
+
+#define CALL_METRICS_IDENTIFIER 0xAAAAAAAA
+
+#define CALL_METRICS_FUNCTION_READ     0 ///< Copy the metrics summed over the cpus. Input: r3 holds a pointer to an array of call_metrics_record_t, r4 holds the number of records it can hold. Output: r0 holds the result, r1 holds the number of records copied, r2 holds the number of records available.
+#define CALL_METRICS_FUNCTION_RESET    1 ///< Clear the metrics of every cpu. Output: r0 holds the result.
+#define CALL_METRICS_NUMBER_OF_FUNCTIONS 2
+
+// every handler gets a row of CALL_METRICS_FUNCTIONS entries per cpu,
+// sub-functions past the end of the row share the last entry
+#define CALL_METRICS_HANDLERS  ((CALL_TABLE_SIZE / 2) + 1) // every identifier the table holds and the default handler
+#define CALL_METRICS_FUNCTIONS 16
+#define CALL_METRICS_NO_INDEX  CALL_METRICS_HANDLERS
+
+// leaf hypercalls are handled in the und stub, see VEC_ASM_UND_HANDLER.
+// they only return r0 and r1, are not measured and do not show up in
+// the metrics. each module defines its own identifiers in the range,
+// 0 is CALL_LEAF_CYCLE_COUNT, 1 is LOG_LEAF_BUFFER_SIZE and 2 is
+// UTX_LEAF_DROPPED
+#define CALL_LEAF_IDENTIFIER_BASE VEC_LEAF_IDENTIFIER_BASE
+#define CALL_LEAF_IDENTIFIER_END  (VEC_LEAF_IDENTIFIER_BASE + VEC_LEAF_TABLE_SIZE)
+
+#define CALL_LEAF_CYCLE_COUNT (CALL_LEAF_IDENTIFIER_BASE + 0) ///< Output: r0 holds the result, r1 holds the cycle counter of the cpu.
+
+#define CALL_DESCRIPTOR_NUMBER_OF_ARGUMENTS 6 // r3 - r8
+#define CALL_DESCRIPTOR_NUMBER_OF_RESULTS   5 // r0 - r4
+
+#define CALL_TABLE_INDEX(identifier) (((identifier) * CALL_TABLE_HASH) >> (32 - CALL_TABLE_SHIFT))
+
 #ifdef __C__
 
 typedef struct call_handler call_handler_t;
 
+typedef struct call_descriptor call_descriptor_t;
+typedef struct call_metrics call_metrics_t;
+typedef struct call_metrics_record call_metrics_record_t;
+
 typedef result_t (*call_function_t)(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
 
 struct call_handler {
 	size_t identifier;
 	call_function_t function;
 	void *data;
+	size_t flags;
+	cpu_statistics_t statistics;
+	call_function_t *functions; ///< Sub-function table indexed by r2, see call_register_handler_table.
+	size_t size;                ///< Number of entries in functions.
+	size_t index;               ///< Row of the handler in the metrics, CALL_METRICS_NO_INDEX if it has none.
+};
+
+// the cycles are summed in two words as a 32 bit total wraps in seconds
+struct call_metrics {
+	size_t calls;      ///< Number of calls.
+	size_t failures;   ///< Number of calls that did not return SUCCESS in r0.
+	size_t total_low;  ///< Low word of the cycles spent in all of the calls.
+	size_t total_high; ///< High word of the cycles spent in all of the calls.
+	size_t minimum;    ///< Fewest cycles spent in a call.
+	size_t maximum;    ///< Most cycles spent in a call.
+};
+
+struct call_metrics_record {
+	size_t identifier;      ///< Identifier of the handler.
+	size_t function;        ///< Sub-function, CALL_METRICS_FUNCTIONS - 1 includes the ones past it.
+	call_metrics_t metrics; ///< The metrics summed over the cpus.
+};
+
+// one hypercall of a batch, the handler sees the same registers it would
+// for a single hypercall with the results copied back once it returns
+struct call_descriptor {
+	size_t identifier;                                     ///< r1, the identifier of the handler.
+	size_t function;                                       ///< r2, the sub-function of the handler.
+	size_t arguments[CALL_DESCRIPTOR_NUMBER_OF_ARGUMENTS]; ///< r3 - r8 passed to the handler.
+	size_t results[CALL_DESCRIPTOR_NUMBER_OF_RESULTS];     ///< r0 - r4 set by the handler.
 };
 
 extern result_t call_init(void);
 extern result_t call_fini(void);
 extern result_t call_register_handler(size_t identifier, call_function_t function, void *data);
 extern result_t call_unregister_handler(size_t identifier, call_function_t function);
+extern result_t call_add_handler(size_t identifier, call_function_t function, call_function_t *functions, size_t size, void *data);
+extern result_t call_remove_handler(size_t identifier, call_function_t function, call_function_t *functions);
+extern result_t call_register_handler_table(size_t identifier, call_function_t *functions, size_t size, void *data);
+extern result_t call_unregister_handler_table(size_t identifier, call_function_t *functions);
+extern result_t call_table_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t call_rebuild_table(void);
+extern result_t call_lookup_handler(size_t identifier, call_handler_t **handler);
 extern result_t call_dispatch(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t call_invoke(size_t identifier, gen_general_purpose_registers_t *registers);
+extern result_t call_get_metrics_index(size_t *index);
+extern void call_update_metrics(call_handler_t *handler, size_t function, size_t cycles, bool_t failed);
+extern result_t call_get_metrics(size_t identifier, size_t function, call_metrics_t *metrics);
+extern result_t call_metrics_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t call_metrics_reset_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t call_register_leaf(size_t identifier, vec_leaf_function_t function);
+extern result_t call_unregister_leaf(size_t identifier, vec_leaf_function_t function);
+extern size_t call_leaf_cycle_count(size_t function, size_t argument);
+extern result_t call_execute_descriptor(call_descriptor_t *descriptor, gen_general_purpose_registers_t *registers);
+extern result_t call_batch_execute_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
 extern result_t call_find_handler(lst_item_t **item, size_t identifier);
+extern result_t call_get_handler(size_t identifier, call_function_t function, call_handler_t **handler);
+extern result_t call_set_handler_budget(size_t identifier, call_function_t function, size_t budget);
+extern result_t call_get_handler_statistics(size_t identifier, call_function_t function, cpu_statistics_t *statistics);
 extern result_t call_default_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
 extern result_t call_get_debug_level(size_t *level);
 extern result_t call_set_debug_level(size_t level);
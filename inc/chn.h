@@ -0,0 +1,109 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_CHN_H__
+#define __KERNEL_CHN_H__
+
+// CHN - Shared memory request channels
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+#include <armv7lib/vmsa/tt.h>
+
+#include <kernel/call.h>
+#include <kernel/vec.h>
+
+#define CHN_CALL_IDENTIFIER 0x88888888
+
+#define CHN_FUNCTION_CREATE     0 ///< Create a channel bound to the current cpu. Output: r0 holds the result, r1 holds the channel, r2 holds the operating system address of the chn_shared_t page.
+#define CHN_FUNCTION_DESTROY    1 ///< Destroy a channel. Input: r3 holds the channel. Output: r0 holds the result.
+#define CHN_FUNCTION_KICK       2 ///< Execute the pending requests of a channel, made on the cpu of the channel. Input: r3 holds the channel. Output: r0 holds the result, r1 holds the number of requests executed.
+#define CHN_NUMBER_OF_FUNCTIONS 3
+
+#define CHN_CHANNELS_SIZE 16
+#define CHN_RING_SIZE     64 // entries per ring, a power of two
+#define CHN_DRAIN_LIMIT   4  // requests executed per exception entry so the latency stays bounded
+
+#define CHN_CACHE_LINE_WORDS 16 // the indexes written by each side are kept on separate cache lines
+
+#ifdef __C__
+
+typedef struct chn_request chn_request_t;
+typedef struct chn_completion chn_completion_t;
+typedef struct chn_shared chn_shared_t;
+typedef struct chn_channel chn_channel_t;
+
+// a hypercall posted by the operating system, see call_descriptor_t
+struct chn_request {
+	size_t tag;                                            ///< Copied into the completion.
+	size_t identifier;                                     ///< r1, the identifier of the handler.
+	size_t function;                                       ///< r2, the sub-function of the handler.
+	size_t arguments[CALL_DESCRIPTOR_NUMBER_OF_ARGUMENTS]; ///< r3 - r8 passed to the handler.
+};
+
+struct chn_completion {
+	size_t tag;                                        ///< Tag of the request.
+	size_t results[CALL_DESCRIPTOR_NUMBER_OF_RESULTS]; ///< r0 - r4 set by the handler.
+};
+
+// the page shared with the operating system. the operating system
+// produces requests and consumes completions, the microvisor consumes
+// requests and produces completions so each index has a single writer.
+// the indexes count entries ever written and wrap naturally. a request
+// is published by writing it and then sq_head after a barrier, the
+// operating system only needs to make a CHN_FUNCTION_KICK hypercall
+// when the ring was empty. requests may be executed from any exception
+// entry on the cpu of the channel, so any pointers in them must stay
+// valid whatever process is running
+struct chn_shared {
+	volatile size_t sq_head;                         ///< Written by the operating system.
+	size_t reserved_0[CHN_CACHE_LINE_WORDS - 1];
+	volatile size_t sq_tail;                         ///< Written by the microvisor.
+	volatile size_t cq_head;                         ///< Written by the microvisor.
+	size_t reserved_1[CHN_CACHE_LINE_WORDS - 2];
+	volatile size_t cq_tail;                         ///< Written by the operating system.
+	size_t reserved_2[CHN_CACHE_LINE_WORDS - 1];
+	chn_request_t requests[CHN_RING_SIZE];           ///< Submission ring.
+	chn_completion_t completions[CHN_RING_SIZE];     ///< Completion ring.
+};
+
+struct chn_channel {
+	chn_shared_t *shared;    ///< Microvisor address of the shared page.
+	tt_virtual_address_t va; ///< Operating system address of the shared page.
+	size_t cpu;              ///< The cpu that executes the requests.
+	size_t executed;         ///< Number of requests executed.
+	bool_t used;             ///< The channel is in use.
+};
+
+extern result_t chn_init(void);
+extern result_t chn_fini(void);
+extern result_t chn_create(size_t *channel, tt_virtual_address_t *va);
+extern result_t chn_destroy(size_t channel);
+extern size_t chn_drain(chn_channel_t *channel, size_t limit, gen_general_purpose_registers_t *registers);
+extern result_t chn_call_create_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t chn_call_destroy_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t chn_call_kick_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t chn_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t chn_get_debug_level(size_t *level);
+extern result_t chn_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_CHN_H__
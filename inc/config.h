@@ -25,4 +25,8 @@
 #define __MEMORY_DEBUG__
 #define __SERIAL_DEBUG__
 
+// the operating system does not use the uart the log is written to, utx
+// may mask and clear its transmit interrupt
+//#define __UTX_OWNS_UART__
+
 #endif //__CONFIG_H__
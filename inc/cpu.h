@@ -0,0 +1,139 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_CPU_H__
+#define __KERNEL_CPU_H__
+
+#include <types.h>
+
+#define CPU_NUMBER_OF_CPUS 4 // must be a power of two
+
+#define CPU_PMCR_ENABLE            (1 << 0)  // PMCR.E enables all of the counters
+#define CPU_PMCNTENSET_CYCLE_COUNT (1 << 31) // PMCNTENSET.C enables the cycle counter
+#define CPU_PMOVSR_CYCLE_COUNT     (1 << 31) // PMOVSR.C is set when the cycle counter wraps
+
+#define CPU_PAR_FAULT        (1 << 0)   // the translation in the PAR failed
+#define CPU_PAR_ADDRESS_MASK 0xFFFFF000 // physical address bits of a successful translation
+
+#define CPU_MODE_MASK 0x1F // mode bits of the cpsr and spsr
+#define CPU_MODE_USER 0x10
+#define CPU_PSR_THUMB (1 << 5) // thumb state bit of the cpsr and spsr
+
+// ID_PFR1.GenTimer is not 0 when the core implements the generic timer,
+// the cortex-a8 and cortex-a9 do not
+#define CPU_ID_PFR1_GENERIC_TIMER_SHIFT 16
+#define CPU_ID_PFR1_GENERIC_TIMER_MASK  0xF
+
+// what cpu_get_timestamp reads, chosen once from ID_PFR1
+#define CPU_TIMESTAMP_SOURCE_UNKNOWN       0
+#define CPU_TIMESTAMP_SOURCE_GENERIC_TIMER 1
+#define CPU_TIMESTAMP_SOURCE_CYCLE_COUNT   2
+
+#define CPU_CACHE_LINE_WORDS 16 // the clocks of two cpus never share a cache line
+
+// generic timer control register (CNTP_CTL, CNTV_CTL) bits
+#define CPU_TIMER_CONTROL_ENABLE  (1 << 0)
+#define CPU_TIMER_CONTROL_IMASK   (1 << 1)
+#define CPU_TIMER_CONTROL_ISTATUS (1 << 2)
+
+// the rolling average moves 1/8th of the way toward each new sample
+#define CPU_STATISTICS_AVERAGE_SHIFT 3
+
+// number of back to back invocations over budget before a handler is flagged
+#define CPU_STATISTICS_OVERRUN_LIMIT 8
+
+#define CPU_STATISTICS_NO_BUDGET 0
+
+#ifdef __C__
+
+typedef struct cpu_statistics cpu_statistics_t;
+
+typedef struct cpu_clock cpu_clock_t;
+
+// cycle statistics for a handler, the cycle counts wrap so only
+// differences between two reads of the counter are meaningful
+struct cpu_statistics {
+	size_t count;       // number of measured invocations
+	size_t last;        // cycles taken by the last invocation
+	size_t minimum;
+	size_t maximum;
+	size_t average;     // rolling average
+	size_t budget;      // CPU_STATISTICS_NO_BUDGET or the cycles allowed per invocation
+	size_t exceeded;    // number of invocations over budget
+	size_t consecutive; // number of back to back invocations over budget
+};
+
+// the timestamp of a cpu without the generic timer, its cycle count
+// extended to 64 bits and moved by the offset it was calibrated with
+struct cpu_clock {
+	bool_t calibrated;
+	size_t last;        // cycle count of the previous timestamp, a smaller count means it wrapped or was written
+	size_t wraps;       // high word of the extended cycle count
+	size_t offset_low;
+	size_t offset_high;
+	size_t latest_low;  // the previous timestamp, read by the cpus that calibrate
+	size_t latest_high;
+	size_t reserved[CPU_CACHE_LINE_WORDS - 7];
+};
+
+extern result_t cpu_init(void);
+extern size_t cpu_get_id(void);
+extern void cpu_data_memory_barrier(void);
+extern size_t cpu_atomic_add(size_t *address, size_t value);
+extern size_t cpu_atomic_or(size_t *address, size_t value);
+extern size_t cpu_atomic_clear(size_t *address, size_t value);
+extern size_t cpu_atomic_compare_and_swap(size_t *address, size_t expected, size_t value);
+extern void cpu_enable_cycle_counter(void);
+extern void cpu_prepare_cycle_counter(void);
+extern size_t cpu_get_cycle_count(void);
+extern bool_t cpu_clear_cycle_count_overflow(void);
+extern size_t cpu_get_physical_timer_control(void);
+extern size_t cpu_get_virtual_timer_control(void);
+extern size_t cpu_get_physical_count(size_t *high);
+extern size_t cpu_get_processor_feature_1(void);
+extern size_t cpu_get_timestamp_source(void);
+extern bool_t cpu_has_generic_timer(void);
+extern size_t cpu_get_timestamp(size_t *high);
+extern void cpu_calibrate_clock(cpu_clock_t *clock);
+extern size_t cpu_get_privileged_thread_id(void);
+extern size_t cpu_get_instruction_fault_status(void);
+extern size_t cpu_translate_address(size_t va);
+extern size_t cpu_translate_user_address(size_t va);
+extern bool_t cpu_update_statistics(cpu_statistics_t *statistics, size_t cycles);
+
+#endif //__C__
+
+#ifdef __ASSEMBLY__
+
+.extern cpu_data_memory_barrier
+.extern cpu_enable_cycle_counter
+.extern cpu_get_cycle_count
+.extern cpu_clear_cycle_count_overflow
+.extern cpu_get_physical_timer_control
+.extern cpu_get_virtual_timer_control
+.extern cpu_get_physical_count
+.extern cpu_get_processor_feature_1
+.extern cpu_get_privileged_thread_id
+.extern cpu_get_instruction_fault_status
+.extern cpu_translate_address
+.extern cpu_translate_user_address
+
+#endif //__ASSEMBLY__
+
+#endif //__KERNEL_CPU_H__
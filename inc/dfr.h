@@ -0,0 +1,80 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_DFR_H__
+#define __KERNEL_DFR_H__
+
+// DFR - Deferred work
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+#define DFR_CALL_IDENTIFIER 0x22222222
+
+#define DFR_FUNCTION_DRAIN      0 ///< Execute up to DFR_DRAIN_LIMIT items of the deferred work queued on the current cpu, the caller repeats it while r2 is not 0. Output: r0 holds the result, r1 holds the number of items executed, r2 holds the number of items still queued.
+#define DFR_FUNCTION_STATISTICS 1 ///< Read the statistics of a cpu queue. Input: r3 holds the cpu. Output: r0 holds the result, r1 holds the depth, r2 holds the number of dropped items, r3 holds the number of executed items, r4 holds the number of failed items.
+#define DFR_NUMBER_OF_FUNCTIONS 2
+
+#define DFR_QUEUE_SIZE 64 // items per cpu, must be a power of two
+
+#define DFR_DRAIN_ALL       0 // no limit on the number of items executed by dfr_drain
+#define DFR_INTERRUPT_LIMIT 4 // items executed per interrupt so the interrupt latency stays bounded
+#define DFR_CALL_LIMIT      1 // items executed ahead of a hypercall, the hypercall itself still has to run
+#define DFR_DRAIN_LIMIT     16 // items executed by a DFR_FUNCTION_DRAIN hypercall
+
+#ifdef __C__
+
+typedef struct dfr_item dfr_item_t;
+typedef struct dfr_queue dfr_queue_t;
+
+typedef result_t (* dfr_function_t)(dfr_item_t *item);
+
+struct dfr_item {
+	dfr_function_t function;                   ///< Function to execute.
+	void *data;                                ///< Data passed by the caller of dfr_enqueue.
+	size_t argument;                           ///< Argument passed by the caller of dfr_enqueue.
+	gen_general_purpose_registers_t registers; ///< Copy of the registers at the time the item was queued, zero if none were given.
+};
+
+struct dfr_queue {
+	rng_t ring;      ///< Ring of dfr_item_t.
+	size_t executed; ///< Number of items executed.
+	size_t failed;   ///< Number of items that returned failure.
+};
+
+extern result_t dfr_init(void);
+extern result_t dfr_fini(void);
+extern result_t dfr_enqueue(dfr_function_t function, void *data, size_t argument, gen_general_purpose_registers_t *registers);
+extern result_t dfr_drain(size_t limit, size_t *count);
+extern result_t dfr_get_statistics(size_t cpu, size_t *depth, size_t *dropped, size_t *executed, size_t *failed);
+extern result_t dfr_call_drain_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t dfr_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t dfr_vec_call_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t dfr_vec_interrupt_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t dfr_get_debug_level(size_t *level);
+extern result_t dfr_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_DFR_H__
@@ -0,0 +1,93 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_HOK_H__
+#define __KERNEL_HOK_H__
+
+// HOK - Inline function hooks
+
+#include <types.h>
+
+#include <kernel/cpu.h>
+
+#define HOK_HOOKS_SIZE 64
+
+// trampoline layout, hok_trampoline in hok.S must match
+#define HOK_TRAMPOLINE_PROLOGUE_INDEX 6  // the displaced instruction
+#define HOK_TRAMPOLINE_HOOK_INDEX     8  // literal, the hok_hook_t
+#define HOK_TRAMPOLINE_DISPATCH_INDEX 9  // literal, hok_dispatch
+#define HOK_TRAMPOLINE_RETURN_INDEX   10 // literal, the instruction after the displaced one
+#define HOK_TRAMPOLINE_SIZE           11
+
+// the trampolines share a page that is mapped into the operating system
+#define HOK_TRAMPOLINES_SIZE (HOK_HOOKS_SIZE * HOK_TRAMPOLINE_SIZE * sizeof(u32_t))
+
+#define HOK_BRANCH_INSTRUCTION 0xEA000000 // b with a zero offset
+#define HOK_BRANCH_RANGE       0x02000000 // +/- 32 MB
+
+#ifdef __C__
+
+typedef struct hok_hook hok_hook_t;
+typedef struct hok_registers hok_registers_t;
+
+// the registers the trampoline saves on the operating system stack, the
+// function arguments are in r0 - r3 and changes are seen by the function
+struct hok_registers {
+	size_t r0;
+	size_t r1;
+	size_t r2;
+	size_t r3;
+	size_t r12;
+	size_t lr;
+};
+
+typedef void (* hok_function_t)(hok_hook_t *hook, hok_registers_t *registers);
+
+struct hok_hook {
+	u32_t *trampoline;                               ///< Copy of hok_trampoline filled in for this hook.
+	size_t trampoline_address;                       ///< Address of the trampoline in the operating system paging system.
+	size_t address;                                  ///< Address of the hooked function.
+	size_t prologue;                                 ///< The original instruction at address.
+	hok_function_t function;                         ///< Function called on every call of the hooked function.
+	void *data;                                      ///< Data passed by the caller of hok_add.
+	cpu_statistics_t statistics[CPU_NUMBER_OF_CPUS]; ///< Cycles spent in function per call on each cpu.
+	bool_t used;                                     ///< The hook is in use.
+};
+
+extern u32_t hok_trampoline[HOK_TRAMPOLINE_SIZE];
+
+extern result_t hok_init(void);
+extern result_t hok_fini(void);
+extern result_t hok_add(size_t address, hok_function_t function, void *data);
+extern result_t hok_remove(size_t address);
+extern result_t hok_find(size_t address, hok_hook_t **hook);
+extern result_t hok_get_statistics(size_t address, size_t cpu, cpu_statistics_t *statistics);
+extern void hok_dispatch(hok_hook_t *hook, hok_registers_t *registers);
+extern result_t hok_get_debug_level(size_t *level);
+extern result_t hok_set_debug_level(size_t level);
+
+#endif //__C__
+
+#ifdef __ASSEMBLY__
+
+.extern hok_trampoline
+
+#endif //__ASSEMBLY__
+
+#endif //__KERNEL_HOK_H__
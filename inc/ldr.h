@@ -36,11 +36,21 @@
 #define LDR_ADD_MODULE           0 ///< Add a module to the system. Input: r2 holds a pointer the buffer, r3 is the size, r4 holds argc, r5 holds argv. Output: r0 holds the result.
 #define LDR_REMOVE_MODULE        1 ///< Remove a module from the system, Input: r2 holds a pointer to the string, r3 holds argc, r4 holds argv. Output: r0 holds the result.
 #define LDR_COPY_MODULE_HEADER   2 ///< Copy a module header of the system, Input: r2 holds an index into the module list, r3 holds a pointer to an allocated memory, r4 holds the size of allocated memory. Output: r0 holds the result.
+#define LDR_NUMBER_OF_FUNCTIONS  3
+
+// the slices of an asynchronous LDR_ADD_MODULE, see asy_register_slices.
+// the first one copies the arguments, the module follows at most
+// LDR_SLICE_COPY_SIZE bytes per slice. the slice after the copy adds the
+// exports and resolves the imports and the last one calls the init
+// function of the module
+#define LDR_SLICE_COPY      0
+#define LDR_SLICE_COPY_SIZE (FOUR_KILOBYTES * 4)
 
 #ifdef __C__
 
 typedef struct ldr_module ldr_module_t;
 typedef struct ldr_function ldr_function_t;
+typedef struct ldr_add_context ldr_add_context_t;
 
 struct ldr_module {
 	ldr_module_t *prev;
@@ -48,6 +58,16 @@ struct ldr_module {
 	ldr_module_t *next;
 };
 
+// kept between the slices of an asynchronous LDR_ADD_MODULE
+struct ldr_add_context {
+	void *buffer;  ///< The copy of the module.
+	size_t size;   ///< The size of the module.
+	size_t argc;   ///< The number of arguments.
+	u8_t **argv;   ///< The copies of the arguments.
+	size_t copied; ///< The number of bytes of the module copied so far.
+	bool_t added;  ///< TRUE once the module is in the module list.
+};
+
 struct ldr_function {
 	ldr_function_t *prev;           ///< Pointer to the previous function in the linked list.
 	gen_export_function_t *pointer; ///< Pointer to the buffer that holds the module.
@@ -62,7 +82,15 @@ extern result_t ldr_call_remove_module(u8_t *string);
 
 extern result_t ldr_init(void);
 
-extern result_t ldr_call_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t ldr_call_add_module_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+
+extern result_t ldr_call_remove_module_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+
+extern result_t ldr_call_copy_module_header_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+
+extern result_t ldr_slice_add_module(call_descriptor_t *descriptor, size_t slice, void **context, gen_general_purpose_registers_t *registers, bool_t *done);
+
+extern void ldr_free_add_context(ldr_add_context_t *context);
 
 extern result_t ldr_add_function(ldr_module_t *module, gen_export_function_t *export);
 
@@ -6,6 +6,8 @@
 #include <armv7lib/gen.h>
 
 #include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
 
 #include <stdlib/stdarg.h>
 
@@ -15,30 +17,222 @@
 #define LOG_FUNCTION_BUFFER_SIZE  1
 #define LOG_FUNCTION_BUFFER_VALUE 2
 #define LOG_FUNCTION_FINI         3
+#define LOG_FUNCTION_BUFFER_COPY  4 // r3 = destination, r4 = offset, r5 = size, returns the bytes copied in r1
+#define LOG_FUNCTION_RING_READ    5 // r3 = log_record_t array, r4 = array of CPU_NUMBER_OF_CPUS sequences, r5 = records, returns the records copied in r1 and moves the sequences past them
+#define LOG_FUNCTION_ARCHIVE      6 // r3 = cpu, returns the bytes of records archived in r1, the bytes they take in the archive in r2 and the cycles spent compressing them in r3
+#define LOG_NUMBER_OF_FUNCTIONS   7
+
+#define LOG_LEAF_BUFFER_SIZE (CALL_LEAF_IDENTIFIER_BASE + 1) ///< Output: r0 holds the result, r1 holds the size of the log buffer.
+
+// the memory log is a ring of fixed size records per cpu that overwrites
+// the oldest record, LOG_RING_RECORDS must be a power of two. the ring
+// only has to hold the blocks that wait for the deferred work, the older
+// records are in the archive
+#define LOG_RING_RECORDS   64
+#define LOG_RING_DATA_SIZE 40 // keeps a record at 64 bytes
+
+// every LOG_ARCHIVE_BLOCK_RECORDS records of a ring are compressed into
+// the archive of the cpu once they are complete, the oldest blocks are
+// dropped to make room. both must be powers of two. the ring, the
+// archive and the cache of a cpu take about the 16 KB the ring alone
+// took when it was 256 records, see bench/log_archive_bench.c
+#define LOG_ARCHIVE_BLOCK_RECORDS 16
+#define LOG_ARCHIVE_SIZE          8192
+#define LOG_ARCHIVE_BLOCK_SIZE    (LOG_ARCHIVE_BLOCK_RECORDS * sizeof(log_record_t))
+#define LOG_ARCHIVE_FLAG_RAW      (1 << 0) // the block did not compress and is stored as it is
+
+// lz77 with the lz4 sequence layout, a token holds the literal length in
+// the top four bits and the match length - LOG_COMPRESS_MATCH_MINIMUM in
+// the bottom four, a field of 15 goes on in the following bytes. the
+// literals and a two byte offset follow, the last sequence has no match
+#define LOG_COMPRESS_MATCH_MINIMUM 4
+#define LOG_COMPRESS_FIELD_LIMIT   15
+#define LOG_COMPRESS_HASH_BITS     8
+#define LOG_COMPRESS_HASH_SIZE     (1 << LOG_COMPRESS_HASH_BITS)
+#define LOG_COMPRESS_HASH_MULTIPLE 0x9E3779B1
+#define LOG_COMPRESS_TAIL_SIZE     5 // the last bytes are always literals
+
+#define LOG_CACHE_LINE_WORDS 16 // the rings of two cpus never share a cache line
+
+#define LOG_RECORD_TYPE_TEXT   0 // data holds formatted text
+#define LOG_RECORD_TYPE_BINARY 1 // data holds a log_binary_t, formatted when it is read out
+
+#define LOG_FORMAT_ARGUMENTS 16 // argument words log_vprintf takes per call
+
+// %[flags][width][.precision][ll]conversion with the flags 0 and -, the
+// conversions are s c d u o x X p and %
+#define LOG_FORMAT_FLAG_ZERO (1 << 0)
+#define LOG_FORMAT_FLAG_LEFT (1 << 1)
+
+#define LOG_FORMAT_NO_PRECISION    0xFFFFFFFF
+#define LOG_FORMAT_WIDTH_LIMIT     64
+#define LOG_FORMAT_PRECISION_LIMIT 32
+#define LOG_FORMAT_FIELD_SIZE      LOG_FORMAT_WIDTH_LIMIT
+#define LOG_FORMAT_DIGITS_SIZE     24 // a 64 bit value in octal
+#define LOG_BINARY_ARGUMENTS ((LOG_RING_DATA_SIZE / sizeof(size_t)) - 1)
+
+// LOG_FUNCTION_INIT formats the binary records so the buffer it takes
+// is larger than the ring data. it stops taking records once less than
+// LOG_SNAPSHOT_RECORD_SIZE is left, the rest wait for the next one
+#define LOG_SNAPSHOT_RECORD_SIZE 128
+#define LOG_SNAPSHOT_SIZE        (256 * LOG_SNAPSHOT_RECORD_SIZE)
+
+// counts the arguments of bprintf at compile time, up to LOG_BINARY_ARGUMENTS
+#define LOG_COUNT_ARGUMENTS(...) LOG_COUNT_ARGUMENTS_(0, ##__VA_ARGS__, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_COUNT_ARGUMENTS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, n, ...) n
 
 #ifdef __C__
 
 #define printf(a, ...) log_printf(gen_add_base(a), ##__VA_ARGS__)
 
+// like printf but only the format and the argument words
+// are stored, %s arguments must point at strings that are not freed
+#define bprintf(a, ...) log_binary_printf(gen_add_base(a), LOG_COUNT_ARGUMENTS(__VA_ARGS__), ##__VA_ARGS__)
+
 typedef struct log_state log_state_t;
+typedef struct log_record log_record_t;
+typedef struct log_ring log_ring_t;
+typedef struct log_line log_line_t;
+typedef struct log_binary log_binary_t;
+typedef struct log_directive log_directive_t;
+typedef struct log_archive log_archive_t;
+typedef struct log_archive_header log_archive_header_t;
+typedef struct log_archive_cache log_archive_cache_t;
+
+struct log_record {
+	size_t sequence;       // sequence of the record + 1 once it is complete, 0 while it is written
+	size_t type;           // LOG_RECORD_TYPE_*
+	size_t size;
+	size_t cpu;            // the ring the record was read from, set on readout
+	size_t timestamp_low;  // cpu_get_timestamp when the record was claimed, it
+	size_t timestamp_high; // orders the records of the rings
+	u8_t data[LOG_RING_DATA_SIZE];
+};
+
+struct log_directive {
+	size_t flags;     // LOG_FORMAT_FLAG_*
+	size_t width;     // minimum size of the field
+	size_t precision; // minimum digits or maximum characters, LOG_FORMAT_NO_PRECISION if there is none
+	size_t length;    // number of l, two or more takes a 64 bit argument
+	u8_t conversion;
+};
+
+struct log_binary {
+	size_t format; // offset of the format from the base of the microvisor
+	size_t arguments[LOG_BINARY_ARGUMENTS];
+};
+
+// only the cpu of the ring writes it, the reader may be on any cpu. the
+// padding keeps each ring off the cache lines of its neighbours
+struct log_ring {
+	size_t head; // sequence of the next record, claimed with cpu_atomic_add
+	size_t reserved_0[LOG_CACHE_LINE_WORDS - 1];
+	log_record_t records[LOG_RING_RECORDS];
+	size_t reserved_1[LOG_CACHE_LINE_WORDS];
+};
+
+// written only by the cpu of the archive from deferred work, the reader
+// may be on any cpu. head and tail count bytes ever written and wrap
+// naturally. tail is moved before the bytes of a dropped block are
+// reused so a reader that still finds its block after tail after the
+// copy knows the copy is whole
+struct log_archive {
+	size_t head;   // position of the next block, moved once the block is written
+	size_t tail;   // position of the oldest block
+	size_t raw;    // bytes of records archived
+	size_t packed; // bytes the archived records take in the archive, headers included
+	size_t cycles; // cycles spent compressing
+	size_t reserved_0[LOG_CACHE_LINE_WORDS - 5];
+	log_record_t records[LOG_ARCHIVE_BLOCK_RECORDS]; // the block being compressed
+	u8_t scratch[LOG_ARCHIVE_BLOCK_SIZE];             // the compressed block
+	u8_t data[LOG_ARCHIVE_SIZE];
+	size_t reserved_1[LOG_CACHE_LINE_WORDS];
+};
+
+// stored in the archive in front of every block
+struct log_archive_header {
+	size_t first; // sequence of the first record in the block
+	size_t end;   // sequence of the last record in the block + 1
+	size_t count; // records in the block, a record that was overwritten before it was archived leaves a gap
+	size_t size;  // bytes of the block that follow the header
+	size_t flags; // LOG_ARCHIVE_FLAG_*
+};
+
+// the last block a readout took out of an archive
+struct log_archive_cache {
+	bool_t valid;
+	log_archive_header_t header;
+	log_record_t records[LOG_ARCHIVE_BLOCK_RECORDS];
+	u8_t *scratch; // the block as it is in the archive, log_state_t scratch
+};
 
 struct log_state {
 	u8_t *buffer;
 	u32_t size;
 	size_t index;
+	size_t sequences[CPU_NUMBER_OF_CPUS]; // first record of each ring that LOG_FUNCTION_FINI has not consumed
+	size_t next[CPU_NUMBER_OF_CPUS];      // first record of each ring after the buffer taken by LOG_FUNCTION_INIT
+	size_t reading;                       // TRUE while a readout uses the caches
+	log_archive_cache_t caches[CPU_NUMBER_OF_CPUS];
+	u8_t scratch[LOG_ARCHIVE_BLOCK_SIZE]; // shared by the caches, a single readout uses them at a time
 };
 
+// the output of one log_vprintf, one ring record worth at a time. it
+// goes to log_write unless destination is set
+struct log_line {
+	u8_t data[LOG_RING_DATA_SIZE];
+	size_t size;
+	u8_t *destination;
+	size_t available; // bytes left at destination, the rest is dropped
+};
+
+extern log_ring_t log_rings[CPU_NUMBER_OF_CPUS];
+extern log_archive_t log_archives[CPU_NUMBER_OF_CPUS];
+
 extern result_t log_init(void);
 extern result_t log_fini(void);
+extern result_t log_call_init_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t log_call_buffer_size_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern size_t log_leaf_buffer_size(size_t function, size_t argument);
+extern result_t log_call_buffer_value_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t log_call_buffer_copy_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t log_call_ring_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t log_call_archive_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t log_call_fini_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
 extern result_t log_call_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
 extern result_t log_call_init_handler(log_state_t *state);
 extern result_t log_call_buffer_size_handler(log_state_t *state, gen_general_purpose_registers_t *registers);
 extern result_t log_call_buffer_value_handler(log_state_t *state, gen_general_purpose_registers_t *registers);
 extern result_t log_call_fini_handler(log_state_t *state);
+extern result_t log_ring_init(void);
+extern log_record_t *log_ring_claim(size_t *sequence);
+extern void log_ring_commit(log_record_t *record, size_t sequence);
+extern void log_ring_write(u8_t *buffer, size_t size);
+extern size_t log_ring_read(size_t cpu, log_record_t *records, size_t count, size_t *sequence);
+extern size_t log_ring_merge(log_record_t *records, size_t count, size_t *sequences, log_archive_cache_t *caches);
+extern size_t log_read_next(size_t cpu, log_record_t *record, size_t *sequence, log_archive_cache_t *cache);
+extern result_t log_archive_block(dfr_item_t *item);
+extern void log_archive_write(log_archive_t *archive, size_t position, void *buffer, size_t size);
+extern void log_archive_copy(log_archive_t *archive, size_t position, void *buffer, size_t size);
+extern result_t log_archive_read(size_t cpu, size_t sequence, log_record_t *record, log_archive_cache_t *cache);
+extern size_t log_compress(u8_t *source, size_t size, u8_t *destination, size_t capacity);
+extern bool_t log_compress_sequence(u8_t *destination, size_t *out, size_t capacity, u8_t *literals, size_t count, size_t match, size_t offset);
+extern size_t log_decompress(u8_t *source, size_t size, u8_t *destination, size_t capacity);
+extern bool_t log_record_is_earlier(log_record_t *a, log_record_t *b);
 extern result_t log_putc(u8_t c);
 extern result_t log_write(u8_t *buffer, size_t size);
 extern result_t log_printf(const char *fmt, ...);
 extern result_t log_vprintf(const char *fmt, va_list args);
+extern size_t log_get_arguments(const char *fmt, va_list args, size_t *arguments);
+extern size_t log_parse_directive(const char *fmt, log_directive_t *directive);
+extern size_t log_get_directive_words(log_directive_t *directive);
+extern size_t log_format_number(u8_t *digits, size_t low, size_t high, size_t base, bool_t upper);
+extern size_t log_format_field(u8_t *field, log_directive_t *directive, size_t *arguments);
+extern result_t log_format(log_line_t *line, const char *fmt, size_t *arguments, size_t count);
+extern void log_binary_printf(const char *fmt, size_t count, ...);
+extern result_t log_format_record(log_line_t *line, log_record_t *record);
+extern result_t log_line_append(log_line_t *line, u8_t *buffer, size_t size);
+extern result_t log_line_flush(log_line_t *line);
 extern result_t log_get_debug_level(size_t *level);
 extern result_t log_set_debug_level(size_t level);
 
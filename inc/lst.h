@@ -23,7 +23,9 @@ extern result_t lst_init(lst_item_t **item);
 extern result_t lst_fini(lst_item_t *item);
 extern result_t lst_add_before_item(lst_item_t **item);
 extern result_t lst_add_after_item(lst_item_t **item);
+extern result_t lst_publish_after_item(lst_item_t **item, void *data);
 extern result_t lst_remove_item(lst_item_t *item);
+extern result_t lst_unlink_item(lst_item_t *item);
 extern result_t lst_get_data(lst_item_t *item, void **data);
 extern result_t lst_set_data(lst_item_t *item, void *data);
 extern result_t lst_get_next_item(lst_item_t *current, lst_item_t **next);
@@ -32,6 +32,7 @@
 #define MMU_MAP_EXECUTE_NEVER           (1 << 3)
 #define MMU_MAP_INTERNAL                (1 << 4)
 #define MMU_MAP_EXTERNAL                (1 << 5)
+#define MMU_MAP_PRIVILEGED              (1 << 6)
 
 #define MMU_SWITCH_EXTERNAL 0
 #define MMU_SWITCH_INTERNAL 1
@@ -81,6 +82,7 @@ extern result_t mmu_unmap_internal_section(tt_virtual_address_t va);
 extern result_t mmu_unmap_external(tt_virtual_address_t va, size_t size);
 extern result_t mmu_unmap_external_small_page(tt_virtual_address_t va);
 extern result_t mmu_unmap_external_section(tt_virtual_address_t va);
+extern result_t mmu_write_external(tt_virtual_address_t va, void *data, size_t size);
 extern result_t mmu_get_debug_level(size_t *level);
 extern result_t mmu_set_debug_level(size_t level);
 
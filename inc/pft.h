@@ -0,0 +1,110 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_PFT_H__
+#define __KERNEL_PFT_H__
+
+// PFT - Page fault tracer
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/abt.h>
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+#define PFT_CALL_IDENTIFIER 0x55555555
+
+#define PFT_FUNCTION_START      0 ///< Start tracing. Output: r0 holds the result.
+#define PFT_FUNCTION_STOP       1 ///< Stop tracing. Output: r0 holds the result.
+#define PFT_FUNCTION_READ       2 ///< Read the oldest fault record of a cpu. Input: r3 holds the cpu. Output: r0 holds the result (FAILURE when empty), r1 - r8 hold the pft_record_t.
+#define PFT_FUNCTION_STATISTICS 3 ///< Read the counters of a cpu. Input: r3 holds the cpu. Output: r0 holds the result, r1 holds the data aborts, r2 holds the prefetch aborts, r3 holds the depth, r4 holds the dropped records, r5 holds the number of timed faults, r6 holds the average, r7 the minimum and r8 the maximum latency in cycles.
+#define PFT_FUNCTION_PROCESS    4 ///< Read a process entry of a cpu. Input: r3 holds the cpu, r4 holds the entry index. Output: r0 holds the result, r1 holds the ttbr0, r2 holds the number of faults.
+#define PFT_NUMBER_OF_FUNCTIONS 5
+
+#define PFT_RING_SIZE        256 // records per cpu, must be a power of two
+#define PFT_PROCESSES_BITS   6
+#define PFT_PROCESSES_SIZE   (1 << PFT_PROCESSES_BITS) // process entries per cpu
+#define PFT_PROCESSES_PROBES 8 // entries looked at before a fault is left out of the process table
+#define PFT_PROCESSES_SHIFT  7 // the low bits of a ttbr hold attributes, not the table address
+#define PFT_PROCESSES_HASH   0x9E3779B1
+
+#define PFT_DATA_ABORT_RETURN_ADJUSTMENT     8 // lr_abt is the faulting instruction + 8
+#define PFT_PREFETCH_ABORT_RETURN_ADJUSTMENT 4 // lr_abt is the faulting instruction + 4
+
+#ifdef __C__
+
+typedef struct pft_record pft_record_t;
+typedef struct pft_process pft_process_t;
+typedef struct pft_cpu pft_cpu_t;
+
+// the layout is returned as is in r1 - r8 by PFT_FUNCTION_READ
+struct pft_record {
+	size_t type;    ///< ABT_DATA_ABORT or ABT_PREFETCH_ABORT.
+	size_t status;  ///< DFSR or IFSR.
+	size_t address; ///< DFAR or IFAR.
+	size_t pc;      ///< Faulting instruction.
+	size_t ttbr0;   ///< Operating system ttbr0, identifies the process.
+	size_t spsr;    ///< Mode the fault was taken from.
+	size_t cycles;  ///< Cycle counter of the cpu on entry.
+	size_t cpu;     ///< Cpu that faulted.
+};
+
+struct pft_process {
+	size_t ttbr0;  ///< Process identity.
+	size_t faults; ///< Number of faults, zero if the entry is unused.
+};
+
+struct pft_cpu {
+	rng_t ring;                                   ///< Ring of pft_record_t.
+	size_t faults[ABT_NUMBER_OF_TYPES];           ///< Number of faults per abort type.
+	size_t missed;                                ///< Number of faults left out of the process table.
+	pft_process_t processes[PFT_PROCESSES_SIZE];  ///< Open addressed fault counts per process.
+	bool_t open;                                  ///< A user mode fault is waiting for its process to run again.
+	size_t open_ttbr0;                            ///< Process of the open fault.
+	size_t open_cycles;                           ///< Cycle counter when the open fault was taken.
+	cpu_statistics_t latency;                     ///< Cycles from a user mode fault to the next exception taken from the same process in user mode.
+};
+
+extern result_t pft_init(void);
+extern result_t pft_fini(void);
+extern result_t pft_start(void);
+extern result_t pft_stop(void);
+extern result_t pft_read(size_t cpu, pft_record_t *record);
+extern result_t pft_get_process(size_t cpu, size_t index, pft_process_t *process);
+extern result_t pft_get_statistics(size_t cpu, size_t *faults, size_t *depth, size_t *dropped, cpu_statistics_t *latency);
+extern void pft_close(pft_cpu_t *state, size_t spsr, size_t ttbr0, size_t cycles);
+extern result_t pft_trace(size_t type, size_t status, size_t address, gen_general_purpose_registers_t *registers);
+extern result_t pft_call_start_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t pft_call_stop_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t pft_call_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t pft_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t pft_call_process_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t pft_vec_data_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t pft_vec_prefetch_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t pft_vec_interrupt_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t pft_get_debug_level(size_t *level);
+extern result_t pft_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_PFT_H__
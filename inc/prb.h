@@ -0,0 +1,88 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_PRB_H__
+#define __KERNEL_PRB_H__
+
+// PRB - Dynamic probes
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+#include <kernel/vec.h>
+
+#define PRB_CALL_IDENTIFIER 0x66666666
+
+#define PRB_FUNCTION_ADD    0 ///< Add a probe. Input: r3 holds the address of the instruction, r4 holds a pointer to the name of the exported function called on a hit, r5 holds the data passed to it. Output: r0 holds the result.
+#define PRB_FUNCTION_REMOVE 1 ///< Remove a probe. Input: r3 holds the address of the instruction. Output: r0 holds the result.
+#define PRB_FUNCTION_HITS   2 ///< Read the number of hits of a probe. Input: r3 holds the address of the instruction. Output: r0 holds the result, r1 holds the number of hits.
+#define PRB_NUMBER_OF_FUNCTIONS 3
+
+#define PRB_INSTRUCTION        0xE7F565F0 // udf #0x5650, permanently undefined in the arm instruction set
+#define PRB_LDR_PC_INSTRUCTION 0xE51FF004 // ldr pc, [pc, #-4]
+
+#define PRB_UNDEFINED_INSTRUCTION_RETURN_ADJUSTMENT 4 // lr_und is the undefined instruction + 4
+
+#define PRB_PROBES_SIZE 256
+#define PRB_TABLE_BITS  9
+#define PRB_TABLE_SIZE  (1 << PRB_TABLE_BITS) // twice the number of probes so the probe sequences stay short
+#define PRB_TABLE_HASH  0x9E3779B1
+
+#define PRB_SLOT_SIZE  3
+#define PRB_SLOTS_SIZE (PRB_PROBES_SIZE * PRB_SLOT_SIZE * sizeof(u32_t)) // the out of line copies of all of the probes, they share a page
+
+#ifdef __C__
+
+typedef struct prb_probe prb_probe_t;
+
+typedef result_t (* prb_function_t)(prb_probe_t *probe, gen_general_purpose_registers_t *registers);
+
+struct prb_probe {
+	u32_t *slot;               ///< The displaced instruction followed by ldr pc, [pc, #-4] and address + 4, PRB_SLOT_SIZE words in the slot page.
+	size_t slot_address;       ///< Operating system address of slot.
+	size_t address;            ///< Address of the probed instruction.
+	size_t instruction;        ///< The displaced instruction.
+	prb_function_t function;   ///< Function called on a hit, may be null.
+	void *data;                ///< Data passed by the caller of prb_add.
+	size_t hits;               ///< Number of hits.
+	bool_t used;               ///< The probe is in use.
+};
+
+// removed probes leave a marker behind so the probe sequences of the
+// other entries are not cut short
+#define PRB_TABLE_DELETED ((prb_probe_t *)1)
+
+extern result_t prb_init(void);
+extern result_t prb_fini(void);
+extern result_t prb_add(size_t address, prb_function_t function, void *data);
+extern result_t prb_remove(size_t address);
+extern result_t prb_find(size_t address, size_t *index);
+extern result_t prb_get_hits(size_t address, size_t *hits);
+extern result_t prb_call_add_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prb_call_remove_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prb_call_hits_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prb_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t prb_get_debug_level(size_t *level);
+extern result_t prb_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_PRB_H__
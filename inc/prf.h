@@ -0,0 +1,103 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_PRF_H__
+#define __KERNEL_PRF_H__
+
+// PRF - Program counter sampling profiler
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+#define PRF_CALL_IDENTIFIER 0x44444444
+
+#define PRF_FUNCTION_START      0 ///< Start sampling. Input: r3 holds the period (sample every Nth interrupt), r4 holds the filter. Output: r0 holds the result.
+#define PRF_FUNCTION_STOP       1 ///< Stop sampling. Output: r0 holds the result.
+#define PRF_FUNCTION_READ       2 ///< Read the oldest sample of a cpu. Input: r3 holds the cpu. Output: r0 holds the result (FAILURE when empty), r1 - r4 hold the prf_sample_t.
+#define PRF_FUNCTION_HISTOGRAM  3 ///< Read a histogram bucket of a cpu. Input: r3 holds the cpu, r4 holds the bucket index. Output: r0 holds the result, r1 holds the bucket address, r2 holds the count.
+#define PRF_FUNCTION_STATISTICS 4 ///< Read the statistics of a cpu. Input: r3 holds the cpu. Output: r0 holds the result, r1 holds the number of samples, r2 holds the depth, r3 holds the number of dropped samples, r4 holds the number of samples missing from the histogram.
+#define PRF_FUNCTION_RESET      5 ///< Clear the samples and histograms of every cpu. Output: r0 holds the result.
+#define PRF_NUMBER_OF_FUNCTIONS 6
+
+#define PRF_FILTER_NONE  0 // sample any interrupt
+#define PRF_FILTER_TIMER 1 // only sample while a generic timer is asserting its interrupt
+
+#define PRF_RING_SIZE        256 // samples per cpu, must be a power of two
+#define PRF_HISTOGRAM_BITS   10
+#define PRF_HISTOGRAM_SIZE   (1 << PRF_HISTOGRAM_BITS) // buckets per cpu
+#define PRF_HISTOGRAM_SHIFT  4 // a bucket covers 16 bytes of code
+#define PRF_HISTOGRAM_PROBES 8 // buckets looked at before a sample is left out of the histogram
+#define PRF_HISTOGRAM_HASH   0x9E3779B1
+
+#define PRF_IRQ_RETURN_ADJUSTMENT 4 // lr_irq is the interrupted pc + 4
+
+#ifdef __C__
+
+typedef struct prf_sample prf_sample_t;
+typedef struct prf_bucket prf_bucket_t;
+typedef struct prf_cpu prf_cpu_t;
+
+// the layout is returned as is in r1 - r4 by PRF_FUNCTION_READ
+struct prf_sample {
+	size_t pc;     ///< Interrupted program counter.
+	size_t spsr;   ///< Interrupted cpsr, holds the mode and the thumb bit.
+	size_t cycles; ///< Cycle counter of the cpu when the sample was taken.
+	size_t cpu;    ///< Cpu that was interrupted.
+};
+
+struct prf_bucket {
+	size_t address; ///< First address covered by the bucket.
+	size_t count;   ///< Number of samples in the bucket, zero if the bucket is unused.
+};
+
+struct prf_cpu {
+	rng_t ring;                                   ///< Ring of prf_sample_t.
+	size_t interrupts;                            ///< Interrupts seen since the last sample.
+	size_t samples;                               ///< Number of samples taken.
+	size_t missed;                                ///< Number of samples left out of the histogram.
+	prf_bucket_t histogram[PRF_HISTOGRAM_SIZE];   ///< Open addressed histogram of the sampled pcs.
+};
+
+extern result_t prf_init(void);
+extern result_t prf_fini(void);
+extern result_t prf_start(size_t period, size_t filter);
+extern result_t prf_stop(void);
+extern result_t prf_reset(void);
+extern result_t prf_read(size_t cpu, prf_sample_t *sample);
+extern result_t prf_get_bucket(size_t cpu, size_t index, prf_bucket_t *bucket);
+extern result_t prf_get_statistics(size_t cpu, size_t *samples, size_t *depth, size_t *dropped, size_t *missed);
+extern result_t prf_call_start_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prf_call_stop_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prf_call_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prf_call_histogram_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prf_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prf_call_reset_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t prf_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t prf_get_debug_level(size_t *level);
+extern result_t prf_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_PRF_H__
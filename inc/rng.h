@@ -0,0 +1,57 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_RNG_H__
+#define __KERNEL_RNG_H__
+
+// RNG - Ring buffer of fixed size records
+
+#include <types.h>
+
+#ifdef __C__
+
+typedef struct rng rng_t;
+
+// the consumers, which may run on any cpu, only move tail with a compare
+// and swap. the producers, including ones that interrupt each other on the
+// same cpu, claim their slots in reserved and the last one to finish moves
+// head.
+struct rng {
+	u8_t *buffer;              ///< Storage for count records.
+	size_t size;               ///< Size of a record in bytes.
+	size_t count;              ///< Number of records, a power of two.
+	volatile size_t head;      ///< Number of records ever published.
+	volatile size_t tail;      ///< Number of records ever read.
+	size_t dropped;            ///< Number of records dropped because the ring was full.
+	volatile size_t reserved;  ///< Number of slots ever claimed by a producer.
+	volatile size_t written;   ///< Number of claimed slots that have been written.
+};
+
+extern result_t rng_init(rng_t *ring, size_t size, size_t count);
+extern result_t rng_fini(rng_t *ring);
+extern result_t rng_put(rng_t *ring, void *record);
+extern result_t rng_get(rng_t *ring, void *record);
+extern result_t rng_reset(rng_t *ring);
+extern size_t rng_get_depth(rng_t *ring);
+extern result_t rng_get_debug_level(size_t *level);
+extern result_t rng_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_RNG_H__
@@ -0,0 +1,84 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_SCT_H__
+#define __KERNEL_SCT_H__
+
+// SCT - System call tracer
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+#define SCT_CALL_IDENTIFIER 0x33333333
+
+#define SCT_FUNCTION_TRACE      0 ///< Trace a system call. Input: r3 holds the system call number, r4 is TRUE to also write trace records. Output: r0 holds the result.
+#define SCT_FUNCTION_UNTRACE    1 ///< Stop tracing a system call. Input: r3 holds the system call number. Output: r0 holds the result.
+#define SCT_FUNCTION_COUNT      2 ///< Read the number of traced calls summed over the cpus. Input: r3 holds the system call number. Output: r0 holds the result, r1 holds the count.
+#define SCT_FUNCTION_READ       3 ///< Read the oldest trace record of a cpu. Input: r3 holds the cpu. Output: r0 holds the result (FAILURE when empty), r1 - r7 hold the sct_record_t.
+#define SCT_FUNCTION_STATISTICS 4 ///< Read the statistics of a cpu. Input: r3 holds the cpu. Output: r0 holds the result, r1 holds the depth, r2 holds the number of dropped records, r3 holds the number of calls past SCT_NUMBER_OF_SYSTEM_CALLS.
+#define SCT_NUMBER_OF_FUNCTIONS 5
+
+#define SCT_NUMBER_OF_SYSTEM_CALLS VEC_SVC_BITMAP_SIZE
+#define SCT_NUMBER_OF_ARGUMENTS    4   // r0 - r3
+#define SCT_RING_SIZE              256 // records per cpu, must be a power of two
+
+#ifdef __C__
+
+typedef struct sct_record sct_record_t;
+typedef struct sct_cpu sct_cpu_t;
+
+// the layout is returned as is in r1 - r7 by SCT_FUNCTION_READ
+struct sct_record {
+	size_t number;                             ///< System call number.
+	size_t arguments[SCT_NUMBER_OF_ARGUMENTS]; ///< r0 - r3 at the time of the call.
+	size_t cycles;                             ///< Cycle counter of the cpu that made the call.
+	size_t cpu;                                ///< Cpu that made the call.
+};
+
+struct sct_cpu {
+	rng_t ring;                                ///< Ring of sct_record_t, written by the cpu and drained by the operating system.
+	size_t counts[SCT_NUMBER_OF_SYSTEM_CALLS]; ///< Number of traced calls per system call number.
+	size_t other;                              ///< Number of calls past SCT_NUMBER_OF_SYSTEM_CALLS.
+};
+
+extern result_t sct_init(void);
+extern result_t sct_fini(void);
+extern result_t sct_trace(size_t number, bool_t record);
+extern result_t sct_untrace(size_t number);
+extern result_t sct_get_count(size_t number, size_t *count);
+extern result_t sct_read(size_t cpu, sct_record_t *record);
+extern result_t sct_get_statistics(size_t cpu, size_t *depth, size_t *dropped, size_t *other);
+extern result_t sct_call_trace_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t sct_call_untrace_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t sct_call_count_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t sct_call_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t sct_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t sct_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t sct_get_debug_level(size_t *level);
+extern result_t sct_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_SCT_H__
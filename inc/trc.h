@@ -0,0 +1,117 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_TRC_H__
+#define __KERNEL_TRC_H__
+
+// TRC - Static tracepoints
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+
+#define TRC_CALL_IDENTIFIER 0xBBBBBBBB
+
+#define TRC_FUNCTION_LIST    0 ///< List the tracepoints. Input: r3 holds a pointer to an array of trc_record_t, r4 holds the number of records in it, r5 holds the index of the first tracepoint to list. Output: r0 holds the result, r1 holds the number of records written, r2 holds the number of tracepoints.
+#define TRC_FUNCTION_ENABLE  1 ///< Enable a tracepoint. Input: r3 holds the index of the tracepoint. Output: r0 holds the result.
+#define TRC_FUNCTION_DISABLE 2 ///< Disable a tracepoint. Input: r3 holds the index of the tracepoint. Output: r0 holds the result.
+#define TRC_NUMBER_OF_FUNCTIONS 3
+
+#define TRC_NOP_INSTRUCTION 0xE320F000 // nop
+#define TRC_BL_INSTRUCTION  0xEB000000 // bl with a zero offset
+
+#define TRC_BL_OFFSET_MASK 0x00FFFFFF
+#define TRC_BL_PC_OFFSET   8 // pc reads as the instruction + 8
+
+#define TRC_NAME_SIZE 32
+
+#ifdef __C__
+
+// a disabled tracepoint is a nop in the function, trc_enable rewrites it
+// as a bl to the stub of the site. the stub loads the runtime address of
+// the record pc relative and goes on to trc_trampoline, so a hit never
+// searches for its record. the registers the call clobbers are listed
+// so the compiler keeps nothing live in them across the site. the record
+// goes into the trc_points section, linker.ld keeps it inside the image
+// ahead of the heap between __start_trc_points and __stop_trc_points
+#define TRC_POINT(name) \
+	__asm__ __volatile__( \
+		"1: nop\n" \
+		".pushsection trc_points, \"aw\"\n" \
+		".align 2\n" \
+		"2: .word 1b\n" \
+		".word 3f\n" \
+		".word 4f\n" \
+		".word 0\n" \
+		".word 0\n" \
+		".popsection\n" \
+		".pushsection .rodata\n" \
+		"3: .asciz \"" #name "\"\n" \
+		".popsection\n" \
+		".pushsection .text.trc_stubs, \"ax\"\n" \
+		".align 2\n" \
+		"4: ldr r0, 6f\n" \
+		"5: add r0, pc, r0\n" \
+		"b trc_trampoline\n" \
+		"6: .word 2b - (5b + 8)\n" \
+		".popsection\n" \
+		: : : "r0", "r1", "r2", "r3", "r12", "lr", "cc")
+
+typedef struct trc_point trc_point_t;
+typedef struct trc_record trc_record_t;
+
+// laid out by TRC_POINT, the addresses are link time addresses
+struct trc_point {
+	size_t site;    ///< Address of the nop.
+	size_t name;    ///< Address of the name.
+	size_t stub;    ///< Address of the stub the bl goes to.
+	size_t enabled; ///< TRUE while the site is a bl.
+	size_t hits;    ///< Number of hits while enabled.
+};
+
+struct trc_record {
+	size_t index;              ///< Index of the tracepoint.
+	size_t enabled;            ///< TRUE while the tracepoint is enabled.
+	size_t hits;               ///< Number of hits while enabled.
+	u8_t name[TRC_NAME_SIZE];  ///< Name of the tracepoint, truncated and null terminated.
+};
+
+extern trc_point_t __start_trc_points[];
+extern trc_point_t __stop_trc_points[];
+
+extern result_t trc_init(void);
+extern result_t trc_fini(void);
+extern size_t trc_get_count(void);
+extern result_t trc_get_point(size_t index, trc_point_t **point);
+extern result_t trc_enable(size_t index);
+extern result_t trc_disable(size_t index);
+extern result_t trc_set_site(trc_point_t *point, u32_t instruction);
+extern void trc_dispatch(trc_point_t *point);
+extern void trc_trampoline(void);
+extern result_t trc_call_list_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t trc_call_enable_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t trc_call_disable_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers);
+extern result_t trc_get_debug_level(size_t *level);
+extern result_t trc_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_TRC_H__
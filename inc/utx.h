@@ -0,0 +1,79 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KERNEL_UTX_H__
+#define __KERNEL_UTX_H__
+
+// UTX - Queued serial transmit for a PL011 uart
+
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <kernel/call.h>
+#include <kernel/vec.h>
+
+#define UTX_QUEUE_SIZE  4096 // bytes, a power of two
+#define UTX_DRAIN_LIMIT 32   // bytes moved per drain, the deepest PL011 fifo
+
+#define UTX_LEAF_DROPPED (CALL_LEAF_IDENTIFIER_BASE + 2) ///< Output: r0 holds the result, r1 holds the number of serial bytes dropped.
+
+#define UTX_ENTRY_VALID 0x100 // set in an entry once its byte is written
+
+// PL011 registers, offsets from the base of the uart
+#define UTX_PL011_DR   0x000 // data
+#define UTX_PL011_FR   0x018 // flags
+#define UTX_PL011_IMSC 0x038 // interrupt mask set/clear
+#define UTX_PL011_ICR  0x044 // interrupt clear
+
+#define UTX_PL011_FR_TXFF    (1 << 5) // transmit fifo full
+#define UTX_PL011_INT_TX     (1 << 5) // transmit interrupt in IMSC and ICR
+
+#ifdef __C__
+
+typedef struct utx_queue utx_queue_t;
+
+// producers claim a range of entries by moving head with a compare and
+// swap, write the bytes with UTX_ENTRY_VALID set and never wait on the
+// uart. the one drain that holds draining moves the valid entries into
+// the fifo, clears them and then moves tail
+struct utx_queue {
+	size_t head;                   ///< Next entry to claim.
+	size_t tail;                   ///< Next entry to send.
+	size_t draining;               ///< TRUE while a drain is running.
+	size_t dropped;                ///< Bytes dropped because the queue was full.
+	u16_t entries[UTX_QUEUE_SIZE]; ///< One byte and UTX_ENTRY_VALID per entry.
+};
+
+extern utx_queue_t utx_queue;
+extern bool_t utx_started;
+
+extern result_t utx_init(void);
+extern result_t utx_fini(void);
+extern result_t utx_write(u8_t *buffer, size_t size);
+extern size_t utx_drain(size_t limit);
+extern size_t utx_get_dropped(void);
+extern size_t utx_leaf_dropped(size_t function, size_t argument);
+extern result_t utx_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t utx_get_debug_level(size_t *level);
+extern result_t utx_set_debug_level(size_t level);
+
+#endif //__C__
+
+#endif //__KERNEL_UTX_H__
@@ -27,6 +27,7 @@
 #include <armv7lib/gen.h>
 #include <armv7lib/exc.h>
 
+#include <kernel/cpu.h>
 #include <kernel/mmu.h>
 #include <kernel/lst.h>
 
@@ -41,23 +42,125 @@
 
 #define VEC_DEFAULT_VECTOR 0xFFFF
 
+// handlers with a higher priority are dispatched first, handlers with
+// the same priority are dispatched in registration order
+#define VEC_HANDLER_PRIORITY_LOWEST  0x00
+#define VEC_HANDLER_PRIORITY_DEFAULT 0x80
+#define VEC_HANDLER_PRIORITY_HIGHEST 0xFF
+
+#define VEC_HANDLER_FLAG_NONE     0
+#define VEC_HANDLER_FLAG_TERMINAL (1 << 0) // stop dispatching once this handler sets *handled
+#define VEC_HANDLER_FLAG_DEMOTE   (1 << 1) // move the handler to the deferred queue once it keeps going over budget
+#define VEC_HANDLER_FLAG_SELECTED (1 << 4) // an svc handler that only needs the system calls selected with vec_set_svc_dispatch
+
+// set by vec_dispatch_handler, cleared by vec_set_handler_budget
+#define VEC_HANDLER_FLAG_OVER_BUDGET (1 << 2) // the handler kept going over budget
+#define VEC_HANDLER_FLAG_DEMOTED     (1 << 3) // the handler runs from the deferred queue
+
 #define VEC_ARM_SINGLE_DATA_TRANSFER_OPCODE      0x04000000
 #define VEC_ARM_SINGLE_DATA_TRANSFER_OPCODE_MASK 0x0C000000
 
 #define VEC_ARM_BRANCH_OPCODE      0x0A000000
 #define VEC_ARM_BRANCH_OPCODE_MASK 0x0E000000
+#define VEC_ARM_BRANCH_OFFSET_MASK 0x00FFFFFF
+
+#define VEC_ARM_MOVE_PC_REGISTER_OPCODE      0x01A0F000
+#define VEC_ARM_MOVE_PC_REGISTER_OPCODE_MASK 0x0FEFFFF0
+#define VEC_ARM_MOVE_PC_REGISTER_RM_MASK     0x0000000F
+
+#define VEC_ARM_BLOCK_DATA_TRANSFER_OPCODE      0x08000000
+#define VEC_ARM_BLOCK_DATA_TRANSFER_OPCODE_MASK 0x0E000000
+#define VEC_ARM_REGISTER_LIST_PC                (1 << 15)
+
+#define VEC_ARM_BRANCH_LINK_EXCHANGE_REGISTER_OPCODE      0x012FFF30
+#define VEC_ARM_BRANCH_LINK_EXCHANGE_REGISTER_OPCODE_MASK 0x0FFFFFF0
+
+#define VEC_ARM_CONDITION_MASK          0xF0000000
+#define VEC_ARM_CONDITION_UNCONDITIONAL 0xF0000000
+
+#define VEC_ARM_RN_SHIFT      16
+#define VEC_ARM_RD_SHIFT      12
+#define VEC_ARM_RM_SHIFT      0
+#define VEC_ARM_REGISTER_MASK 0xF
+#define VEC_ARM_PC_REGISTER   15
 
 #define VEC_LDR_18_INSTRUCTION 0xE59FF018
 
+// fiq mode with both irq and fiq masked
+#define VEC_FIQ_MODE_MASKED 0xD1
+
+#define VEC_FIQ_FIRST_BANKED_REGISTER 8
+#define VEC_FIQ_NUMBER_OF_REGISTERS   7
+
+#define VEC_FIQ_HANDLERS_SIZE 8
+
 #define VEC_PREFETCH_OPERATION_ADJUSTMENT 0x8
 
+// the register the operating system passes the system call number in,
+// r7 for the linux eabi. it is used by name from both c and assembly
+// (registers->VEC_SVC_NUMBER_REGISTER) and must not be r0 or r1
+#ifndef VEC_SVC_NUMBER_REGISTER
+#define VEC_SVC_NUMBER_REGISTER r7
+#endif //VEC_SVC_NUMBER_REGISTER
+
+// an exception taken in the mode of an exception that is being
+// dispatched nests below the interrupted frame on the same microvisor
+// stack. the nesting depth counts the exceptions being dispatched on the
+// cpu on every vector, so a data abort taken by an irq handler is nested
+// too. past the limit, or when nothing handles a nested exception,
+// vec_nested_fault fails the handler that took it instead of chaining to
+// the operating system with the microvisor state
+#define VEC_NESTING_LIMIT 4
+
+// every vector has a vec_stack_t per cpu, the stubs index them with the
+// cpu number from the MPIDR. the fields are used from assembly
+#define VEC_STACK_OLD_OFFSET   0
+#define VEC_STACK_NEW_OFFSET   4
+#define VEC_STACK_DEPTH_OFFSET 8
+#define VEC_STACK_SHIFT        4 // sizeof(vec_stack_t) is 1 << VEC_STACK_SHIFT
+
+#define VEC_STACK_SIZE (FOUR_KILOBYTES * 2)
+
+#define VEC_PSR_FIQ_DISABLE 0x40 // the f bit of a program status register
+
+#define VEC_HANDLER_FUNCTION_OFFSET 4 // function in vec_handler_t
+
+// vec_recovery_t holds r4 - r11 followed by sp and the resume address
+#define VEC_RECOVERY_SP_OFFSET 32
+#define VEC_RECOVERY_PC_OFFSET 36
+
+// words the stubs keep above the gen_general_purpose_registers_t frame,
+// the offsets are from the start of the frame
+#define VEC_FRAME_EXTRA_SIZE     12
+#define VEC_FRAME_HANDLED_OFFSET 60 // bool_t handled, passed to vec_dispatch_handler
+#define VEC_FRAME_SPSR_OFFSET    64 // spsr of the exception
+#define VEC_FRAME_STACK_OFFSET   68 // sp of the interrupted code
+
+#define VEC_DATA_ABORT_RETURN_ADJUSTMENT 8 // lr_abt is the faulting instruction + 8
+
+#define VEC_SVC_BITMAP_SIZE  512 // system call numbers covered by vec_svc_bitmap
+#define VEC_SVC_BITMAP_WORDS (VEC_SVC_BITMAP_SIZE / 32)
+
+// hypercall identifiers VEC_LEAF_IDENTIFIER_BASE to VEC_LEAF_IDENTIFIER_BASE
+// + VEC_LEAF_TABLE_SIZE - 1 are looked up in vec_leaf_table by the und stub
+// before it switches stacks. the base must be an arm immediate
+#define VEC_LEAF_IDENTIFIER_BASE 0xEE000000
+#define VEC_LEAF_TABLE_SIZE      16
+
 #ifdef __C__
 
-#define VEC_C_HANDLER(name)	                           \
-	extern size_t *vec_handler_ ## name;               \
-	extern bool_t vec_handled_ ## name;                \
-	extern size_t *vec_old_stack_ ## name;             \
-	extern size_t *vec_new_stack_ ## name;             \
+typedef struct vec_stack vec_stack_t;
+
+struct vec_stack {
+	size_t old_stack; // sp of the interrupted code until VEC_ASM_DISPATCH moves it into the frame
+	size_t new_stack; // top of the microvisor stack
+	size_t depth;     // exceptions of the vector being dispatched on the cpu, selects the stack
+	size_t reserved;
+};
+
+#define VEC_C_HANDLER(name)	                                       \
+	extern size_t *vec_handler_ ## name;                           \
+	extern vec_stack_t vec_stacks_ ## name[CPU_NUMBER_OF_CPUS];    \
 	extern void vec_asm_handler_ ## name(void);
 
 VEC_C_HANDLER(rst);
@@ -69,18 +172,48 @@ VEC_C_HANDLER(ntsd);
 VEC_C_HANDLER(irq);
 VEC_C_HANDLER(fiq);
 
+// exceptions being dispatched on each cpu on every vector
+extern size_t vec_depth[CPU_NUMBER_OF_CPUS];
+
+// the probe accesses, a data abort on either resumes at vec_probe_fixup
+extern void vec_probe_read_access(void);
+extern void vec_probe_write_access(void);
+extern void vec_probe_fixup(void);
+
 typedef struct vec_handler vec_handler_t;
 
 typedef union vec_arm_single_data_transfer_instruction vec_arm_single_data_transfer_instruction_t;
 
 typedef union vec_arm_branch_instruction vec_arm_branch_instruction_t;
 
+typedef union vec_fiq_registers vec_fiq_registers_t;
+
+typedef struct vec_fiq_handler vec_fiq_handler_t;
+
+typedef struct vec_recovery vec_recovery_t;
+
+typedef struct vec_retired vec_retired_t;
+
 typedef result_t (* vec_function_t)(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
 
+// leaf functions are called from the und stub on the und stack of the
+// microvisor with the paging system of the operating system. they receive r2 and r3
+// of the hypercall and return the value placed in r1
+typedef size_t (* vec_leaf_function_t)(size_t function, size_t argument);
+
+// fiq handlers do not receive a register frame, the fiq stub only preserves
+// the registers the aapcs allows a c function to corrupt
+typedef result_t (* vec_fiq_function_t)(vec_fiq_handler_t *handler, bool_t *handled);
+
 struct vec_handler {
 	size_t vector;
 	vec_function_t function;
 	void *data;
+	size_t priority;
+	size_t flags;
+	cpu_statistics_t statistics;
+	size_t deferred; // items queued for the handler that vec_deferred_handler has not run
+	bool_t removed;  // unregistered, the queued items are dropped
 };
 
 union vec_arm_single_data_transfer_instruction {
@@ -110,15 +243,89 @@ union vec_arm_branch_instruction {
 	u32_t all;
 };
 
+// the banked fiq registers r8_fiq - r14_fiq
+union vec_fiq_registers {
+	struct {
+		size_t r8;
+		size_t r9;
+		size_t r10;
+		size_t r11;
+		size_t r12;
+		size_t sp;
+		size_t lr;
+	} fields;
+	size_t all[VEC_FIQ_NUMBER_OF_REGISTERS];
+};
+
+struct vec_fiq_handler {
+	vec_fiq_function_t function;
+	void *data;
+};
+
+// vec_call_handler keeps one on the stack of every handler it runs, the
+// ones of a cpu are linked from vec_recoveries
+struct vec_recovery {
+	size_t registers[10];     // r4 - r11, sp and the resume address
+	size_t depth;             // vec_depth of the cpu while the handler runs
+	vec_recovery_t *previous; // the handler that was interrupted by this dispatch
+};
+
+// memory handed to vec_retire and the state of the cpus when it was
+struct vec_retired {
+	void *pointer;
+	size_t *pending;                       // count that has to drop to zero as well, NULL if none
+	size_t quiescent;                      // bit per cpu that was not dispatching
+	size_t dispatches[CPU_NUMBER_OF_CPUS]; // vec_dispatches of the cpus
+	vec_retired_t *next;
+};
+
+extern size_t vec_chain_fiq;
+extern bool_t vec_patched_fiq;
+extern size_t vec_fiq_entries[CPU_NUMBER_OF_CPUS];
+extern size_t vec_fiq_exits[CPU_NUMBER_OF_CPUS];
+
+extern u32_t vec_svc_bitmap[VEC_SVC_BITMAP_WORDS];
+extern u32_t vec_svc_selected[VEC_SVC_BITMAP_WORDS];
+extern size_t vec_svc_unselected;
+
+extern vec_leaf_function_t vec_leaf_table[VEC_LEAF_TABLE_SIZE];
+
+extern void vec_get_fiq_registers(vec_fiq_registers_t *registers);
+extern result_t vec_call_recoverable(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers, vec_recovery_t *recovery);
+extern void vec_resume(vec_recovery_t *recovery);
+extern void vec_halt(void);
+
 extern result_t vec_init(void);
+extern result_t vec_init_stacks(vec_stack_t *stacks);
 extern result_t vec_fini(void);
 extern result_t vec_patch(mmu_paging_system_t *ps);
 extern size_t vec_instruction_to_address(size_t instruction, size_t instruction_address, size_t *absolute_address);
+extern bool_t vec_instruction_is_relocatable(size_t instruction);
+extern result_t vec_fiq_instruction_to_address(size_t instruction, size_t instruction_address, vec_fiq_registers_t *registers, size_t *absolute_address);
 extern result_t vec_default_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
 extern result_t vec_register_handler(size_t vector, vec_function_t function, void *data);
+extern result_t vec_register_priority_handler(size_t vector, vec_function_t function, void *data, size_t priority, size_t flags);
 extern result_t vec_find_handler(lst_item_t **item, size_t vector);
 extern result_t vec_unregister_handler(size_t vector, vec_function_t function);
-extern result_t vec_dispatch_handler(size_t vector, gen_general_purpose_registers_t *registers);
+extern result_t vec_dispatch_handler(size_t vector, gen_general_purpose_registers_t *registers, bool_t *handled, size_t depth);
+extern result_t vec_dispatch_chain(size_t vector, gen_general_purpose_registers_t *registers, bool_t *handled);
+extern result_t vec_call_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers);
+extern result_t vec_nested_fault(size_t vector, gen_general_purpose_registers_t *registers, bool_t *handled, size_t depth);
+extern result_t vec_retire(void *pointer);
+extern result_t vec_retire_pending(void *pointer, size_t *pending);
+extern void vec_reclaim(void);
+extern result_t vec_probe_read(size_t address, size_t *value);
+extern result_t vec_probe_write(size_t address, size_t value);
+extern result_t vec_get_handler(size_t vector, vec_function_t function, vec_handler_t **handler);
+extern result_t vec_set_handler_budget(size_t vector, vec_function_t function, size_t budget);
+extern result_t vec_get_handler_statistics(size_t vector, vec_function_t function, cpu_statistics_t *statistics);
+extern result_t vec_set_svc_dispatch(size_t number, bool_t dispatch);
+extern result_t vec_set_svc_dispatch_all(bool_t dispatch);
+extern void vec_update_svc_bitmap(void);
+extern result_t vec_set_leaf_function(size_t index, vec_leaf_function_t function);
+extern result_t vec_register_fiq_handler(vec_fiq_function_t function, void *data);
+extern result_t vec_unregister_fiq_handler(vec_fiq_function_t function);
+extern result_t vec_dispatch_fiq_handler(bool_t *handled);
 extern result_t vec_get_debug_level(size_t *level);
 extern result_t vec_set_debug_level(size_t level);
 
@@ -132,20 +339,59 @@ extern result_t vec_set_debug_level(size_t level);
 #define VEC_C_HANDLER(name)				\
 	.extern vec_asm_handler_ ## name
 
-.macro VEC_ASM_HANDLER name, vector
-
-// the address of the original handler
-VARIABLE(vec_handler_\name) .word 0x0
+// \reg is set to the entry of this cpu in \array minus \bias, entries
+// are 1 << \shift bytes. \bias is defined here so the accesses through
+// \reg add it to their offset instead of needing a second register
+.macro VEC_ASM_CPU reg, array, shift, bias
+	mrc p15, 0, \reg, c0, c0, 5 // MPIDR
+	and \reg, \reg, $(CPU_NUMBER_OF_CPUS - 1)
+	\bias = \array - (. + 8)
+	add \reg, pc, \reg, lsl $\shift
+.endm
 
-// boolean to determine if the event was handled or not
-VARIABLE(vec_handled_\name) .byte 0x0
-VARIABLE(vec_old_stack_\name) .word 0x0
-VARIABLE(vec_new_stack_\name) .word 0x0
+// switches to the microvisor stack of the vector on this cpu. the stubs
+// have no free register before the stack is switched, so lr is parked in
+// the TPIDRPRW while it indexes vec_stacks_\name. the microvisor owns the
+// TPIDRPRW, vec_init checks that the operating system leaves it free. an
+// fiq taken in between would park its own lr there, so the other stubs
+// mask fiqs for the switch and unmask them again when the interrupted
+// code had them enabled. old_stack only carries the interrupted sp until
+// VEC_ASM_DISPATCH moves it into the frame. nothing in between can fault
+// and interrupts are masked so a nested exception cannot overwrite it. a
+// nested exception in the same mode is already on the microvisor stack
+// and carries on below the interrupted frame
+.macro VEC_ASM_ENTER name, fiq=0
+	.if \fiq == 0
+	cpsid f
+	.endif
+	mcr p15, 0, lr, c13, c0, 4 // TPIDRPRW
+	VEC_ASM_CPU lr, vec_stacks_\name, VEC_STACK_SHIFT, .Lvec_enter_\name
+	str sp, [lr, $(.Lvec_enter_\name + VEC_STACK_OLD_OFFSET)]
+	ldr sp, [lr, $(.Lvec_enter_\name + VEC_STACK_DEPTH_OFFSET)]
+	cmp sp, $0
+	ldreq sp, [lr, $(.Lvec_enter_\name + VEC_STACK_NEW_OFFSET)]
+	ldrne sp, [lr, $(.Lvec_enter_\name + VEC_STACK_OLD_OFFSET)]
+	mrc p15, 0, lr, c13, c0, 4 // TPIDRPRW
+	.if \fiq == 0
+	push {lr}
+	mrs lr, spsr
+	tst lr, $VEC_PSR_FIQ_DISABLE
+	mrseq lr, cpsr
+	biceq lr, $VEC_PSR_FIQ_DISABLE
+	msreq cpsr_c, lr
+	pop {lr}
+	.endif
+.endm
 
-FUNCTION(vec_asm_handler_\name)
-	// backup and switch the stack pointer
-	str sp, vec_old_stack_\name
-	ldr sp, vec_new_stack_\name
+// builds the gen_general_purpose_registers_t frame on the microvisor
+// stack, calls vec_dispatch_handler and then either returns to the
+// originator or chains to the operating system handler. the stack
+// pointer must already have been switched by VEC_ASM_ENTER. the
+// interrupted sp, spsr and the handled flag are kept in the frame so
+// the stub is re-entrant
+.macro VEC_ASM_DISPATCH name, vector
+	// space for the words above the frame
+	sub sp, $VEC_FRAME_EXTRA_SIZE
 
 	// backup the registers which will in turn load the
 	// gen_general_purpose_registers_t structure
@@ -155,6 +401,24 @@ FUNCTION(vec_asm_handler_\name)
 	push {lr}
 	push {r0 - r12}
 
+	// r4 and r5 survive the call, the cpu cannot change under the stub
+	VEC_ASM_CPU r4, vec_stacks_\name, VEC_STACK_SHIFT, .Lvec_stack_\name
+	VEC_ASM_CPU r5, vec_depth, 2, .Lvec_depth_\name
+
+	ldr r0, [r4, $(.Lvec_stack_\name + VEC_STACK_OLD_OFFSET)]
+	str r0, [sp, $VEC_FRAME_STACK_OFFSET]
+	mrs r0, spsr
+	str r0, [sp, $VEC_FRAME_SPSR_OFFSET]
+
+	ldr r0, [r4, $(.Lvec_stack_\name + VEC_STACK_DEPTH_OFFSET)]
+	add r0, $1
+	str r0, [r4, $(.Lvec_stack_\name + VEC_STACK_DEPTH_OFFSET)]
+
+	// the depth of the cpu before this exception goes in r3
+	ldr r3, [r5, $.Lvec_depth_\name]
+	add r0, r3, $1
+	str r0, [r5, $.Lvec_depth_\name]
+
 	// put the vector into r0
 	mov r0, $\vector
 
@@ -162,35 +426,233 @@ FUNCTION(vec_asm_handler_\name)
 	// be used as the gen_general_purpose_registers_t *
 	mov r1, sp
 
+	// put the address of the handled flag in r2
+	add r2, sp, $VEC_FRAME_HANDLED_OFFSET
+
 	// call the associated c function
 	bl vec_dispatch_handler
 
+	ldr r0, [r5, $.Lvec_depth_\name]
+	sub r0, $1
+	str r0, [r5, $.Lvec_depth_\name]
+
+	ldr r0, [r4, $(.Lvec_stack_\name + VEC_STACK_DEPTH_OFFSET)]
+	sub r0, $1
+	str r0, [r4, $(.Lvec_stack_\name + VEC_STACK_DEPTH_OFFSET)]
+
+	// a nested exception in this mode overwrote spsr
+	ldr r0, [sp, $VEC_FRAME_SPSR_OFFSET]
+	msr spsr_cxsf, r0
+
 	// see if the event was handled
-	mov r0, $0
-	ldrb r0, vec_handled_\name
+	ldrb r0, [sp, $VEC_FRAME_HANDLED_OFFSET]
 	cmp r0, $FALSE
-	bne 1f
 
-	// it was not handled jump to the operating system handler
+	// pop, add and ldr do not modify the flags
 	pop {r0 - r12}
 	add sp, $4 // space for size_t sp
 	pop {lr}
 
-	// restore the old stack pointer
-	ldr sp, vec_old_stack_\name
-	// branch to the operating system handler
+	// restore the old stack pointer from the frame, this drops the
+	// words above the frame
+	ldr sp, [sp, $(VEC_FRAME_STACK_OFFSET - VEC_FRAME_HANDLED_OFFSET)]
+
+	// it was handled switch the mode to the one in spsr and return
+	movnes pc, lr
+
+	// it was not handled jump to the operating system handler
 	ldr pc, vec_handler_\name
+.endm
 
-	// it was handled return to the originator
-	1:
-	pop {r0 - r12}
-	add sp, $4 // space for size_t sp
-	pop {lr}
+.macro VEC_ASM_HANDLER name, vector
 
-	// restore the old stack pointer
-	ldr sp, vec_old_stack_\name
-	// switch the mode to the one in spsr and return
+// the address of the original handler
+VARIABLE(vec_handler_\name) .word 0x0
+
+// the stack of each cpu, see vec_stack_t
+VARIABLE(vec_stacks_\name) .fill (CPU_NUMBER_OF_CPUS << VEC_STACK_SHIFT), 1, 0x0
+
+FUNCTION(vec_asm_handler_\name)
+	VEC_ASM_ENTER \name
+	VEC_ASM_DISPATCH \name, \vector
+.endm
+
+// the svc stub checks the system call number against vec_svc_bitmap
+// before building a frame. system calls that are not selected go
+// straight to the operating system handler so they only pay for the
+// bitmap check. numbers past the end of the bitmap are always dispatched
+.macro VEC_ASM_SVC_HANDLER name, vector
+
+// the address of the original handler
+VARIABLE(vec_handler_\name) .word 0x0
+
+// one bit per system call number, see vec_update_svc_bitmap. every
+// system call is dispatched until vec_init has run
+VARIABLE(vec_svc_bitmap) .fill VEC_SVC_BITMAP_WORDS, 4, 0xFFFFFFFF
+
+// the stack of each cpu, see vec_stack_t
+VARIABLE(vec_stacks_\name) .fill (CPU_NUMBER_OF_CPUS << VEC_STACK_SHIFT), 1, 0x0
+
+FUNCTION(vec_asm_handler_\name)
+	VEC_ASM_ENTER \name
+
+	push {r0, r1}
+
+	cmp VEC_SVC_NUMBER_REGISTER, $VEC_SVC_BITMAP_SIZE
+	bhs 2f
+
+	// test bit (number % 32) of word (number / 32)
+	adr r0, vec_svc_bitmap
+	mov r1, VEC_SVC_NUMBER_REGISTER, lsr $5
+	ldr r0, [r0, r1, lsl $2]
+	and r1, VEC_SVC_NUMBER_REGISTER, $31
+	mov r0, r0, lsr r1
+	tst r0, $1
+	bne 2f
+
+	// not selected, chain to the operating system handler. the
+	// interrupted sp is put below r0 and r1, interrupts are masked
+	// so nothing can overwrite it before it is loaded
+	VEC_ASM_CPU r0, vec_stacks_\name, VEC_STACK_SHIFT, .Lvec_chain_\name
+	ldr r0, [r0, $(.Lvec_chain_\name + VEC_STACK_OLD_OFFSET)]
+	str r0, [sp, $-4]
+	pop {r0, r1}
+	ldr sp, [sp, $-12]
+	ldr pc, vec_handler_\name
+
+	2:
+	pop {r0, r1}
+
+	VEC_ASM_DISPATCH \name, \vector
+.endm
+
+// the und stub handles the leaf hypercalls without building a frame,
+// calling into vec_dispatch_handler or switching the paging system.
+// r0 = CALLSIGN and r1 = VEC_LEAF_IDENTIFIER_BASE + index select the
+// function in vec_leaf_table. it is called with r2 and r3 of the
+// hypercall and its return value is placed in r1 with r0 = SUCCESS,
+// every other register is preserved. anything else, including an
+// empty entry, takes the normal path. the stack is switched before
+// anything is pushed, the und stack of the operating system only has
+// room for its own stub
+.macro VEC_ASM_UND_HANDLER name, vector
+
+// the address of the original handler
+VARIABLE(vec_handler_\name) .word 0x0
+
+// absolute addresses of the leaf functions, 0 if there is none
+VARIABLE(vec_leaf_table) .fill VEC_LEAF_TABLE_SIZE, 4, 0x0
+
+// the stack of each cpu, see vec_stack_t
+VARIABLE(vec_stacks_\name) .fill (CPU_NUMBER_OF_CPUS << VEC_STACK_SHIFT), 1, 0x0
+
+FUNCTION(vec_asm_handler_\name)
+	VEC_ASM_ENTER \name
+
+	push {r2, r3}
+
+	ldr r2, =CALLSIGN
+	cmp r0, r2
+	bne 2f
+
+	sub r2, r1, $VEC_LEAF_IDENTIFIER_BASE
+	cmp r2, $VEC_LEAF_TABLE_SIZE
+	bhs 2f
+
+	adr r3, vec_leaf_table
+	ldr r3, [r3, r2, lsl $2]
+	cmp r3, $0
+	beq 2f
+
+	// the leaf counts as a level of the stack so a nested und does
+	// not start at its top again. the interrupted sp is kept on the
+	// stack, the nested und would overwrite old_stack
+	VEC_ASM_CPU r2, vec_stacks_\name, VEC_STACK_SHIFT, .Lvec_leaf_\name
+	ldr r0, [r2, $(.Lvec_leaf_\name + VEC_STACK_DEPTH_OFFSET)]
+	add r0, $1
+	str r0, [r2, $(.Lvec_leaf_\name + VEC_STACK_DEPTH_OFFSET)]
+	ldr r0, [r2, $(.Lvec_leaf_\name + VEC_STACK_OLD_OFFSET)]
+
+	// r0 - r3 and r12 are corrupted by the leaf function, r2 and r3
+	// of the hypercall are above the saved words
+	push {r0, r2, r12, lr}
+	mov r12, r3
+	ldr r0, [sp, $16]
+	ldr r1, [sp, $20]
+	blx r12
+	mov r1, r0
+
+	ldr r2, [sp, $4]
+	ldr r0, [r2, $(.Lvec_leaf_\name + VEC_STACK_DEPTH_OFFSET)]
+	sub r0, $1
+	str r0, [r2, $(.Lvec_leaf_\name + VEC_STACK_DEPTH_OFFSET)]
+
+	mov r0, $SUCCESS
+	ldr r12, [sp, $8]
+	ldr lr, [sp, $12]
+	ldr r2, [sp, $16]
+	ldr r3, [sp, $20]
+
+	// back to the stack of the operating system
+	ldr sp, [sp]
+
+	// return past the hypercall instruction
 	movs pc, lr
+
+	2:
+	// still on the microvisor stack with old_stack intact
+	pop {r2, r3}
+
+	VEC_ASM_DISPATCH \name, \vector
+.endm
+
+// the fiq stub does not build a gen_general_purpose_registers_t. r8 - r12
+// are banked in fiq mode and r8 - r11 are preserved by any aapcs function
+// so only r0 - r3, r12 and lr need to be saved before calling into c. the
+// handled flag and the interrupted sp are kept above them. fiqs do not
+// nest so the stack of the cpu is always switched to its top
+.macro VEC_ASM_FIQ_HANDLER name
+
+// the address of the original handler
+VARIABLE(vec_handler_\name) .word 0x0
+
+// the stack of each cpu, see vec_stack_t
+VARIABLE(vec_stacks_\name) .fill (CPU_NUMBER_OF_CPUS << VEC_STACK_SHIFT), 1, 0x0
+
+FUNCTION(vec_asm_handler_\name)
+	VEC_ASM_ENTER \name, 1
+
+	// space for the handled flag and the interrupted sp
+	sub sp, $8
+	push {r0 - r3, r12, lr}
+
+	VEC_ASM_CPU r0, vec_stacks_\name, VEC_STACK_SHIFT, .Lvec_fiq_\name
+	ldr r0, [r0, $(.Lvec_fiq_\name + VEC_STACK_OLD_OFFSET)]
+	str r0, [sp, $28]
+
+	// call the associated c function with the address of the flag
+	add r0, sp, $24
+	bl vec_dispatch_fiq_handler
+
+	// see if the event was handled
+	ldrb r0, [sp, $24]
+	cmp r0, $FALSE
+
+	// pop and ldr do not modify the flags
+	pop {r0 - r3, r12, lr}
+
+	// restore the old stack pointer
+	ldr sp, [sp, $4]
+
+	// it was handled return to the originator
+	subnes pc, lr, $4
+
+// it was not handled chain to the operating system handler. vec_patch
+// replaces this instruction with the displaced vector instruction when
+// it is register based (mov pc, r9) so the banked registers select the
+// target exactly as they would have from the vector table
+VARIABLE(vec_chain_\name)
+	ldr pc, vec_handler_\name
 .endm
 
 VEC_C_HANDLER(rst)
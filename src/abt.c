@@ -0,0 +1,345 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/vmsa/flt.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/abt.h>
+#include <kernel/cpu.h>
+#include <kernel/mas.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(abt_dbg, DBG_LEVEL_2);
+
+abt_index_t *abt_indexes[ABT_NUMBER_OF_TYPES];
+
+result_t abt_init(void) {
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	memset(gen_add_base(&abt_indexes), 0, sizeof(abt_indexes));
+
+	// the range handlers run before anything registered on the vectors
+	// directly and stop the chain once one of them claims the fault
+
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_DATA_ABORT_VECTOR, gen_add_base(&abt_vec_data_abort_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST, VEC_HANDLER_FLAG_TERMINAL), "unable to register the data abort handler", FAILURE, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_PREFETCH_ABORT_VECTOR, gen_add_base(&abt_vec_prefetch_abort_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST, VEC_HANDLER_FLAG_TERMINAL), "unable to register the prefetch abort handler", FAILURE, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t abt_fini(void) {
+
+	abt_index_t **indexes;
+	abt_index_t *index;
+	size_t i, j;
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_DATA_ABORT_VECTOR, gen_add_base(&abt_vec_data_abort_handler)), "unable to unregister the data abort handler", FAILURE, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_PREFETCH_ABORT_VECTOR, gen_add_base(&abt_vec_prefetch_abort_handler)), "unable to unregister the prefetch abort handler", FAILURE, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	indexes = gen_add_base(&abt_indexes);
+
+	for(i = 0; i < ABT_NUMBER_OF_TYPES; i++) {
+
+		if(indexes[i] == NULL) {
+			continue;
+		}
+
+		index = indexes[i];
+		indexes[i] = NULL;
+
+		// another cpu may still be walking the index
+		for(j = 0; j < index->size; j++) {
+			vec_retire(index->entries[j].handler);
+		}
+
+		vec_retire(index);
+	}
+
+	return SUCCESS;
+}
+
+// rebuilds the index of type with handler added (remove == FALSE) or
+// without it (remove == TRUE). the index is replaced in one store so
+// a concurrent lookup sees either the old or the new one, the old one
+// is retired as abt_dispatch may still be walking it on another cpu.
+result_t abt_rebuild_index(size_t type, abt_handler_t *handler, bool_t remove) {
+
+	abt_index_t **indexes;
+	abt_index_t *old;
+	abt_index_t *new;
+	size_t size;
+	size_t maximum;
+	size_t i, j;
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	indexes = gen_add_base(&abt_indexes);
+
+	old = indexes[type];
+
+	size = (old == NULL) ? 0 : old->size;
+	size = (remove == TRUE) ? (size - 1) : (size + 1);
+
+	new = malloc(sizeof(abt_index_t) + (size * sizeof(abt_entry_t)));
+
+	CHECK_NOT_NULL(new, "unable to allocate memory for the index", size, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	new->size = size;
+
+	j = 0;
+
+	if(old != NULL) {
+
+		for(i = 0; i < old->size; i++) {
+
+			if(old->entries[i].handler == handler) {
+				continue;
+			}
+
+			// insertion sort, the new handler goes in front of the
+			// first entry that starts after it
+			if((remove == FALSE) && (j == i) && (handler->start < old->entries[i].start)) {
+				new->entries[j++].handler = handler;
+			}
+
+			new->entries[j++].handler = old->entries[i].handler;
+		}
+	}
+
+	if((remove == FALSE) && (j < size)) {
+		new->entries[j++].handler = handler;
+	}
+
+	maximum = 0;
+
+	for(i = 0; i < size; i++) {
+
+		new->entries[i].start = new->entries[i].handler->start;
+		new->entries[i].end = new->entries[i].handler->end;
+
+		if(new->entries[i].end > maximum) {
+			maximum = new->entries[i].end;
+		}
+
+		new->entries[i].maximum = maximum;
+	}
+
+	cpu_data_memory_barrier();
+
+	indexes[type] = new;
+
+	// the index is leaked if it can not be retired
+	vec_retire(old);
+
+	return SUCCESS;
+}
+
+result_t abt_register_handler(size_t type, size_t start, size_t size, abt_function_t function, void *data) {
+
+	abt_handler_t *handler;
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	CHECK(type < ABT_NUMBER_OF_TYPES, "type is out of range", type, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK(size != 0, "size equals 0", size, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK((start + (size - 1)) >= start, "range wraps around the address space", start, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	handler = malloc(sizeof(abt_handler_t));
+
+	CHECK_NOT_NULL(handler, "unable to allocate memory for the handler", handler, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	handler->type = type;
+	handler->start = start;
+	handler->end = start + (size - 1);
+	handler->function = function;
+	handler->data = data;
+
+	CHECK_SUCCESS(abt_rebuild_index(type, handler, FALSE), "unable to add the handler to the index", start, abt_dbg, DBG_LEVEL_2)
+		free(handler);
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t abt_unregister_handler(size_t type, size_t start, abt_function_t function) {
+
+	abt_index_t *index;
+	abt_handler_t *handler;
+	size_t i;
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	CHECK(type < ABT_NUMBER_OF_TYPES, "type is out of range", type, abt_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	index = ((abt_index_t **)gen_add_base(&abt_indexes))[type];
+
+	if(index == NULL) {
+		return FAILURE;
+	}
+
+	for(i = 0; i < index->size; i++) {
+
+		handler = index->entries[i].handler;
+
+		if((handler->start == start) && (handler->function == function)) {
+
+			CHECK_SUCCESS(abt_rebuild_index(type, handler, TRUE), "unable to remove the handler from the index", start, abt_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+
+			// the handler may be running on another cpu
+			vec_retire(handler);
+
+			return SUCCESS;
+		}
+	}
+
+	return FAILURE;
+}
+
+result_t abt_dispatch(size_t type, size_t address, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	abt_index_t *index;
+	abt_entry_t *entry;
+	size_t low, high, middle;
+
+	// no logging, this runs for every abort the operating system takes
+
+	index = ((abt_index_t **)gen_add_base(&abt_indexes))[type];
+
+	if((index == NULL) || (index->size == 0)) {
+		return SUCCESS;
+	}
+
+	// find the number of entries that start at or before the address
+	low = 0;
+	high = index->size;
+
+	while(low < high) {
+
+		middle = low + ((high - low) / 2);
+
+		if(index->entries[middle].start <= address) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	// walk back through the candidates until no earlier range can reach
+	while(low > 0) {
+
+		entry = &(index->entries[--low]);
+
+		if(entry->maximum < address) {
+			break;
+		}
+
+		if(entry->end < address) {
+			continue;
+		}
+
+		if(entry->handler->function(entry->handler, address, handled, registers) != SUCCESS) {
+			return FAILURE;
+		}
+
+		if(*handled == TRUE) {
+			break;
+		}
+	}
+
+	return SUCCESS;
+}
+
+result_t abt_vec_data_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	flt_data_fault_address_register_t dfar;
+
+	UNUSED_VARIABLE(handler);
+
+	dfar = flt_get_dfar();
+
+	return abt_dispatch(ABT_DATA_ABORT, dfar.all, handled, registers);
+}
+
+result_t abt_vec_prefetch_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	flt_instruction_fault_address_register_t ifar;
+
+	UNUSED_VARIABLE(handler);
+
+	ifar = flt_get_ifar();
+
+	return abt_dispatch(ABT_PREFETCH_ABORT, ifar.all, handled, registers);
+}
+
+result_t abt_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(abt_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t abt_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(abt_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(abt_dbg, level);
+
+	return SUCCESS;
+}
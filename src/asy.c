@@ -0,0 +1,425 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/asy.h>
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
+#include <kernel/mas.h>
+
+DBG_DEFINE_VARIABLE(asy_dbg, DBG_LEVEL_2);
+
+asy_cpu_t *asy_cpus[CPU_NUMBER_OF_CPUS];
+
+// the sub-functions of ASY_CALL_IDENTIFIER indexed by r2
+call_function_t asy_call_functions[ASY_NUMBER_OF_FUNCTIONS];
+
+// the hypercalls that run one slice per deferred item
+asy_slices_t asy_slices[ASY_SLICES_SIZE];
+
+result_t asy_init(void) {
+
+	asy_cpu_t **cpus;
+	call_function_t *functions;
+	size_t i;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	cpus = gen_add_base(&asy_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		cpus[i] = malloc(sizeof(asy_cpu_t));
+
+		CHECK_NOT_NULL(cpus[i], "unable to allocate memory for the cpu", i, asy_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(cpus[i], 0, sizeof(asy_cpu_t));
+	}
+
+	memset(gen_add_base(&asy_slices), 0, sizeof(asy_slices));
+
+	functions = gen_add_base(&asy_call_functions);
+
+	functions[ASY_FUNCTION_SUBMIT] = gen_add_base(&asy_call_submit_handler);
+	functions[ASY_FUNCTION_POLL] = gen_add_base(&asy_call_poll_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(ASY_CALL_IDENTIFIER, functions, ASY_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+// pending tickets still sit in the deferred queues, they have to be
+// drained before this is called
+result_t asy_fini(void) {
+
+	asy_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(call_unregister_handler_table(ASY_CALL_IDENTIFIER, gen_add_base(&asy_call_functions)), "unable to unregister the call handler", FAILURE, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpus = gen_add_base(&asy_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] != NULL) {
+			free(cpus[i]);
+			cpus[i] = NULL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+// the hypercall runs from the deferred queue of this cpu at a later
+// exception entry, any pointers it is given must stay valid whatever
+// process is running by then
+result_t asy_submit(call_descriptor_t *descriptor, gen_general_purpose_registers_t *registers, size_t *ticket) {
+
+	asy_cpu_t *cpu;
+	asy_ticket_t *tmp;
+	size_t generation;
+	size_t index;
+	size_t i;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	cpu = ((asy_cpu_t **)gen_add_base(&asy_cpus))[cpu_get_id()];
+
+	tmp = NULL;
+
+	for(i = 0; i < ASY_TICKETS_SIZE; i++) {
+
+		index = (cpu->next + i) % ASY_TICKETS_SIZE;
+
+		if((cpu->tickets[index].state & ASY_STATE_MASK) == ASY_STATE_FREE) {
+			tmp = &(cpu->tickets[index]);
+			break;
+		}
+	}
+
+	CHECK_NOT_NULL(tmp, "no free tickets", ASY_TICKETS_SIZE, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(&(tmp->descriptor), descriptor, sizeof(call_descriptor_t));
+	memset(tmp->descriptor.results, 0, sizeof(tmp->descriptor.results));
+
+	tmp->context = NULL;
+
+	generation = ((tmp->state >> ASY_TICKET_GENERATION_SHIFT) + 1) & ASY_TICKET_GENERATION_MASK;
+
+	// the descriptor is written before a poll can see the generation
+	cpu_data_memory_barrier();
+
+	tmp->state = (generation << ASY_TICKET_GENERATION_SHIFT) | ASY_STATE_PENDING;
+
+	CHECK_SUCCESS(dfr_enqueue(gen_add_base(&asy_deferred_handler), tmp, 0, registers), "unable to queue the hypercall", descriptor->identifier, asy_dbg, DBG_LEVEL_2)
+		tmp->state = (generation << ASY_TICKET_GENERATION_SHIFT) | ASY_STATE_FREE;
+		return FAILURE;
+	CHECK_END
+
+	cpu->next = index + 1;
+	cpu->submitted++;
+
+	*ticket = (generation << ASY_TICKET_GENERATION_SHIFT) | (cpu_get_id() << ASY_TICKET_CPU_SHIFT) | index;
+
+	return SUCCESS;
+}
+
+// copies the results into descriptor and releases the ticket once
+// state is ASY_STATE_DONE
+result_t asy_poll(size_t ticket, size_t *state, call_descriptor_t *descriptor) {
+
+	asy_ticket_t *tmp;
+	size_t value;
+	size_t index;
+	size_t cpu;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	index = ticket & ASY_TICKET_INDEX_MASK;
+	cpu = (ticket >> ASY_TICKET_CPU_SHIFT) & ASY_TICKET_CPU_MASK;
+
+	CHECK((index < ASY_TICKETS_SIZE) && (cpu < CPU_NUMBER_OF_CPUS), "ticket is out of range", ticket, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	tmp = &(((asy_cpu_t **)gen_add_base(&asy_cpus))[cpu]->tickets[index]);
+
+	value = tmp->state;
+
+	*state = value & ASY_STATE_MASK;
+
+	CHECK((*state != ASY_STATE_FREE) && ((ticket >> ASY_TICKET_GENERATION_SHIFT) == (value >> ASY_TICKET_GENERATION_SHIFT)), "ticket is not in use", ticket, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	if(*state == ASY_STATE_DONE) {
+
+		// the results were written before the state
+		cpu_data_memory_barrier();
+
+		memcpy(descriptor, &(tmp->descriptor), sizeof(call_descriptor_t));
+
+		cpu_data_memory_barrier();
+
+		// another poll of the same ticket may have released it and the
+		// entry may have been handed out again while the results were
+		// copied, only the poll that swaps the exact word owns the copy
+		CHECK_EQUAL(cpu_atomic_compare_and_swap(&(tmp->state), value, ((value & ~ASY_STATE_MASK) | ASY_STATE_FREE)), value, "ticket was released by another poll", ticket, asy_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+	}
+
+	return SUCCESS;
+}
+
+// a sliced hypercall runs one slice per item, the next slice is queued
+// behind the items that are already waiting. item->argument is the slice
+result_t asy_deferred_handler(dfr_item_t *item) {
+
+	asy_ticket_t *ticket;
+	asy_cpu_t *cpu;
+	asy_slice_function_t slice;
+	bool_t done;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	ticket = item->data;
+
+	slice = asy_lookup_slices(ticket->descriptor.identifier, ticket->descriptor.function);
+
+	if(ticket->descriptor.identifier == ASY_CALL_IDENTIFIER) {
+		ticket->descriptor.results[0] = FAILURE;
+	}
+	else if(slice != NULL) {
+
+		done = FALSE;
+
+		if(slice(&(ticket->descriptor), item->argument, &(ticket->context), &(item->registers), &done) != SUCCESS) {
+			ticket->descriptor.results[0] = FAILURE;
+			done = TRUE;
+		}
+
+		if(done == FALSE) {
+
+			if(dfr_enqueue(gen_add_base(&asy_deferred_handler), ticket, (item->argument + 1), &(item->registers)) == SUCCESS) {
+				return SUCCESS;
+			}
+
+			DBG_LOG_STATEMENT("unable to queue the next slice", item->argument, asy_dbg, DBG_LEVEL_2);
+
+			slice(&(ticket->descriptor), ASY_SLICE_CANCEL, &(ticket->context), &(item->registers), &done);
+
+			ticket->descriptor.results[0] = FAILURE;
+		}
+	}
+	else {
+		call_execute_descriptor(&(ticket->descriptor), &(item->registers));
+	}
+
+	cpu = ((asy_cpu_t **)gen_add_base(&asy_cpus))[cpu_get_id()];
+
+	cpu->completed++;
+
+	// the results must be visible before the state, a pending entry is
+	// only written by this cpu
+	cpu_data_memory_barrier();
+
+	ticket->state = (ticket->state & ~ASY_STATE_MASK) | ASY_STATE_DONE;
+
+	return (ticket->descriptor.results[0] == SUCCESS) ? SUCCESS : FAILURE;
+}
+
+// the slice function is called from the deferred queue of the cpu the
+// hypercall was submitted on, it has to stay registered while any such
+// hypercall is pending
+result_t asy_register_slices(size_t identifier, size_t function, asy_slice_function_t slice) {
+
+	asy_slices_t *slices;
+	size_t i;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(slice, "slice is null", identifier, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK(asy_lookup_slices(identifier, function) == NULL, "the hypercall is already sliced", identifier, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	slices = gen_add_base(&asy_slices);
+
+	for(i = 0; i < ASY_SLICES_SIZE; i++) {
+
+		if(slices[i].slice == NULL) {
+			break;
+		}
+	}
+
+	CHECK(i < ASY_SLICES_SIZE, "no free slice entries", ASY_SLICES_SIZE, asy_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	slices[i].identifier = identifier;
+	slices[i].function = function;
+
+	// the entry is complete before the deferred queues can match it
+	cpu_data_memory_barrier();
+
+	slices[i].slice = slice;
+
+	return SUCCESS;
+}
+
+result_t asy_unregister_slices(size_t identifier, size_t function) {
+
+	asy_slices_t *slices;
+	size_t i;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	slices = gen_add_base(&asy_slices);
+
+	for(i = 0; i < ASY_SLICES_SIZE; i++) {
+
+		if((slices[i].slice != NULL) && (slices[i].identifier == identifier) && (slices[i].function == function)) {
+			slices[i].slice = NULL;
+			return SUCCESS;
+		}
+	}
+
+	DBG_LOG_STATEMENT("the hypercall is not sliced", identifier, asy_dbg, DBG_LEVEL_2);
+
+	return FAILURE;
+}
+
+asy_slice_function_t asy_lookup_slices(size_t identifier, size_t function) {
+
+	asy_slices_t *slices;
+	size_t i;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	slices = gen_add_base(&asy_slices);
+
+	for(i = 0; i < ASY_SLICES_SIZE; i++) {
+
+		if((slices[i].slice != NULL) && (slices[i].identifier == identifier) && (slices[i].function == function)) {
+			return slices[i].slice;
+		}
+	}
+
+	return NULL;
+}
+
+result_t asy_call_submit_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	call_descriptor_t descriptor;
+	size_t ticket;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	descriptor.identifier = registers->r3;
+	descriptor.function = registers->r4;
+	descriptor.arguments[0] = registers->r5;
+	descriptor.arguments[1] = registers->r6;
+	descriptor.arguments[2] = registers->r7;
+	descriptor.arguments[3] = registers->r8;
+	descriptor.arguments[4] = registers->r9;
+	descriptor.arguments[5] = registers->r10;
+
+	CHECK_SUCCESS(asy_submit(&descriptor, registers, &ticket), "unable to submit the hypercall", descriptor.identifier, asy_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = ticket;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t asy_call_poll_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	call_descriptor_t descriptor;
+	size_t state;
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(asy_poll(registers->r3, &state, &descriptor), "unable to poll the ticket", registers->r3, asy_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = state;
+
+	if(state == ASY_STATE_DONE) {
+		registers->r2 = descriptor.results[0];
+		registers->r3 = descriptor.results[1];
+		registers->r4 = descriptor.results[2];
+		registers->r5 = descriptor.results[3];
+		registers->r6 = descriptor.results[4];
+	}
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t asy_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(asy_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t asy_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(asy_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(asy_dbg, level);
+
+	return SUCCESS;
+}
@@ -8,22 +8,56 @@
 #include <stdlib/string.h>
 
 #include <kernel/call.h>
+#include <kernel/cpu.h>
 #include <kernel/vec.h>
 #include <kernel/lst.h>
 #include <kernel/mas.h>
 
 DBG_DEFINE_VARIABLE(call_dbg, DBG_LEVEL_2);
 
+// the lookup, the metrics and the leaf do not log, they run on every
+// hypercall
+
 lst_item_t *call_list = NULL;
 
+// hashed index of call_list, see call_rebuild_table
+call_handler_t **call_table = NULL;
+call_handler_t *call_default = NULL;
+
+// the sub-functions of CALL_BATCH_IDENTIFIER indexed by r2
+call_function_t call_batch_functions[CALL_BATCH_NUMBER_OF_FUNCTIONS];
+
+// the sub-functions of CALL_METRICS_IDENTIFIER indexed by r2
+call_function_t call_metrics_functions[CALL_METRICS_NUMBER_OF_FUNCTIONS];
+
+// CALL_METRICS_HANDLERS rows of CALL_METRICS_FUNCTIONS entries, each cpu
+// has a separate allocation so the cpus do not share cache lines
+call_metrics_t *call_metrics[CPU_NUMBER_OF_CPUS];
+
 result_t call_init(void) {
 
 	lst_item_t **cl;
 	lst_item_t *tmp;
 	call_handler_t *handler;
+	call_function_t *functions;
+	call_metrics_t **metrics;
+	size_t i;
 
 	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
 
+	metrics = gen_add_base(&call_metrics);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		metrics[i] = malloc(CALL_METRICS_HANDLERS * CALL_METRICS_FUNCTIONS * sizeof(call_metrics_t));
+
+		CHECK_NOT_NULL(metrics[i], "unable to allocate memory for the metrics", i, call_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(metrics[i], 0, (CALL_METRICS_HANDLERS * CALL_METRICS_FUNCTIONS * sizeof(call_metrics_t)));
+	}
+
 	cl = gen_add_base(&call_list);
 
 	handler = malloc(sizeof(call_handler_t));
@@ -39,8 +73,11 @@ result_t call_init(void) {
 
 	*cl = tmp;
 
+	memset(handler, 0, sizeof(call_handler_t));
+
 	handler->function = gen_add_base(&call_default_handler);
 	handler->identifier = CALL_DEFAULT_HANDLER;
+	handler->index = 0;
 
 	CHECK_SUCCESS(lst_add_item(&tmp), "unable to add handler", handler, call_dbg, DBG_LEVEL_2)
 		free(handler);
@@ -49,6 +86,31 @@ result_t call_init(void) {
 
 	lst_set_data(tmp, handler);
 
+	CHECK_SUCCESS(call_rebuild_table(), "unable to build the call table", FAILURE, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	functions = gen_add_base(&call_batch_functions);
+
+	functions[CALL_BATCH_FUNCTION_EXECUTE] = gen_add_base(&call_batch_execute_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(CALL_BATCH_IDENTIFIER, functions, CALL_BATCH_NUMBER_OF_FUNCTIONS, NULL), "unable to register the batch handler", FAILURE, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	functions = gen_add_base(&call_metrics_functions);
+
+	functions[CALL_METRICS_FUNCTION_READ] = gen_add_base(&call_metrics_read_handler);
+	functions[CALL_METRICS_FUNCTION_RESET] = gen_add_base(&call_metrics_reset_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(CALL_METRICS_IDENTIFIER, functions, CALL_METRICS_NUMBER_OF_FUNCTIONS, NULL), "unable to register the metrics handler", FAILURE, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_register_leaf(CALL_LEAF_CYCLE_COUNT, gen_add_base(&call_leaf_cycle_count)), "unable to register the cycle count leaf", FAILURE, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	return SUCCESS;
 }
 
@@ -57,9 +119,13 @@ result_t call_fini(void) {
 	lst_item_t *cl;
 	lst_item_t *tmp_0, *tmp_1;
 	call_handler_t *handler;
+	call_metrics_t **metrics;
+	size_t i;
 
 	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_2);
 
+	call_unregister_leaf(CALL_LEAF_CYCLE_COUNT, gen_add_base(&call_leaf_cycle_count));
+
 	cl = *(lst_item_t **)gen_add_base(&call_list);
 
 	CHECK_SUCCESS(lst_get_first_item(cl, &tmp_0), "unable to get the first item", tmp_0, call_dbg, DBG_LEVEL_2)
@@ -87,39 +153,119 @@ result_t call_fini(void) {
 		return FAILURE;
 	CHECK_END
 
+	free(*(call_handler_t ***)gen_add_base(&call_table));
+
+	metrics = gen_add_base(&call_metrics);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(metrics[i] != NULL) {
+			free(metrics[i]);
+			metrics[i] = NULL;
+		}
+	}
+
+	*(call_handler_t ***)gen_add_base(&call_table) = NULL;
+	*(call_handler_t **)gen_add_base(&call_default) = NULL;
+
 	return SUCCESS;
 }
 
 result_t call_register_handler(size_t identifier, call_function_t function, void *data) {
 
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	return call_add_handler(identifier, function, NULL, 0, data);
+}
+
+result_t call_unregister_handler(size_t identifier, call_function_t function) {
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	return call_remove_handler(identifier, function, NULL);
+}
+
+// registers a dense table of sub-functions indexed by r2, each entry is
+// called like a handler and sets r0. entries may be null and must be
+// absolute addresses, the table must stay valid until it is unregistered
+result_t call_register_handler_table(size_t identifier, call_function_t *functions, size_t size, void *data) {
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(functions, "functions is null", functions, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return call_add_handler(identifier, gen_add_base(&call_table_handler), functions, size, data);
+}
+
+result_t call_unregister_handler_table(size_t identifier, call_function_t *functions) {
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	return call_remove_handler(identifier, gen_add_base(&call_table_handler), functions);
+}
+
+result_t call_add_handler(size_t identifier, call_function_t function, call_function_t *functions, size_t size, void *data) {
+
 	lst_item_t *cl;
 	call_handler_t *handler;
+	call_metrics_t **metrics;
+	size_t index;
+	size_t i;
 
 	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
 
 	cl = *(lst_item_t **)gen_add_base(&call_list);
 
+	// a handler without a row still works, it is just not measured
+	if(call_get_metrics_index(&index) != SUCCESS) {
+		DBG_LOG_STATEMENT("no free metrics rows", identifier, call_dbg, DBG_LEVEL_2);
+		index = CALL_METRICS_NO_INDEX;
+	}
+
 	handler = malloc(sizeof(call_handler_t));
 
 	CHECK_NOT_NULL(handler, "unable to allocate memory for the handler", handler, call_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	CHECK_SUCCESS(lst_add_item(&cl), "unable to add item", handler, call_dbg, DBG_LEVEL_2)
-		free(handler);
-		return FAILURE;
-	CHECK_END
-
 	handler->identifier = identifier;
 	handler->function = function;
 	handler->data = data;
+	handler->flags = CALL_HANDLER_FLAG_NONE;
+	handler->functions = functions;
+	handler->size = size;
+	handler->index = index;
 
-	lst_set_data(cl, handler);
+	memset(&(handler->statistics), 0, sizeof(cpu_statistics_t));
+
+	if(index != CALL_METRICS_NO_INDEX) {
+
+		metrics = gen_add_base(&call_metrics);
+
+		for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+			memset(&(metrics[i][index * CALL_METRICS_FUNCTIONS]), 0, (CALL_METRICS_FUNCTIONS * sizeof(call_metrics_t)));
+		}
+	}
+
+	// the handler is complete before it can be found on the list
+	CHECK_SUCCESS(lst_publish_after_item(&cl, handler), "unable to add item", handler, call_dbg, DBG_LEVEL_2)
+		free(handler);
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_rebuild_table(), "unable to rebuild the call table", identifier, call_dbg, DBG_LEVEL_2)
+		lst_unlink_item(cl);
+		vec_retire(handler);
+		vec_retire(cl);
+		return FAILURE;
+	CHECK_END
 
 	return SUCCESS;
 }
 
-result_t call_unregister_handler(size_t identifier, call_function_t function) {
+result_t call_remove_handler(size_t identifier, call_function_t function, call_function_t *functions) {
 
 	lst_item_t *cl;
 	call_handler_t *handler;
@@ -128,17 +274,33 @@ result_t call_unregister_handler(size_t identifier, call_function_t function) {
 
 	cl = *(lst_item_t **)gen_add_base(&call_list);
 
+	CHECK_SUCCESS(lst_get_first_item(cl, &cl), "unable to get the first item", cl, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	while((call_find_handler(&cl, identifier) == SUCCESS) && (cl != NULL)) {
 
-    	lst_get_data(cl, (void **)&handler);
+		lst_get_data(cl, (void **)&handler);
 
-		if (handler->function == function) {
+		// call_find_handler falls back to the default handler
+		if(handler->identifier != identifier) {
+			break;
+		}
+
+		if((handler->function == function) && (handler->functions == functions)) {
 
-			CHECK_SUCCESS(lst_remove_item(cl), "unable to remove item", cl, call_dbg, DBG_LEVEL_2)
+			CHECK_SUCCESS(lst_unlink_item(cl), "unable to unlink item", cl, call_dbg, DBG_LEVEL_2)
 				return FAILURE;
 			CHECK_END
 
-			free(handler);
+			// the table must not point at the handler once it is retired
+			CHECK_SUCCESS(call_rebuild_table(), "unable to rebuild the call table", identifier, call_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+
+			// the handler and its item may be in use on another cpu
+			vec_retire(handler);
+			vec_retire(cl);
 			break;
 		}
 
@@ -148,9 +310,133 @@ result_t call_unregister_handler(size_t identifier, call_function_t function) {
 	return SUCCESS;
 }
 
+// builds a new table from call_list and replaces the old one in one
+// store so call_lookup_handler sees either the old or the new table.
+// the old table is retired, see vec_retire
+result_t call_rebuild_table(void) {
+
+	lst_item_t *cl;
+	call_handler_t **table;
+	call_handler_t **old;
+	call_handler_t *handler;
+	call_handler_t *fallback;
+	size_t count;
+	size_t index;
+	size_t i;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	cl = *(lst_item_t **)gen_add_base(&call_list);
+
+	CHECK_SUCCESS(lst_get_first_item(cl, &cl), "unable to get the first item", cl, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	table = malloc(CALL_TABLE_SIZE * sizeof(call_handler_t *));
+
+	CHECK_NOT_NULL(table, "unable to allocate memory for the table", CALL_TABLE_SIZE, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(table, 0, (CALL_TABLE_SIZE * sizeof(call_handler_t *)));
+
+	fallback = NULL;
+	count = 0;
+
+	// the list is walked in the same order as call_find_handler so
+	// the same handler wins when an identifier is registered twice
+	while(cl != NULL) {
+
+		lst_get_data(cl, (void **)&handler);
+
+		if(handler->identifier == CALL_DEFAULT_HANDLER) {
+
+			if(fallback == NULL) {
+				fallback = handler;
+			}
+		}
+		else {
+
+			index = CALL_TABLE_INDEX(handler->identifier);
+
+			for(i = 0; i < CALL_TABLE_SIZE; i++) {
+
+				index &= (CALL_TABLE_SIZE - 1);
+
+				if(table[index] == NULL) {
+					table[index] = handler;
+					count++;
+					break;
+				}
+
+				if(table[index]->identifier == handler->identifier) {
+					break;
+				}
+
+				index++;
+			}
+
+			CHECK(count <= (CALL_TABLE_SIZE / 2), "too many call identifiers", count, call_dbg, DBG_LEVEL_2)
+				free(table);
+				return FAILURE;
+			CHECK_END
+		}
+
+		CHECK_SUCCESS(lst_get_next_item(cl, &cl), "unable to get the next item", cl, call_dbg, DBG_LEVEL_2)
+			free(table);
+			return FAILURE;
+		CHECK_END
+	}
+
+	*(call_handler_t **)gen_add_base(&call_default) = fallback;
+
+	old = *(call_handler_t ***)gen_add_base(&call_table);
+
+	cpu_data_memory_barrier();
+
+	*(call_handler_t ***)gen_add_base(&call_table) = table;
+
+	// call_lookup_handler may still be probing the old table on another
+	// cpu, it is leaked if it can not be retired
+	vec_retire(old);
+
+	return SUCCESS;
+}
+
+// an exact match always wins, the default handler is only
+// used when no handler is registered for the identifier
+result_t call_lookup_handler(size_t identifier, call_handler_t **handler) {
+
+	call_handler_t **table;
+	size_t index;
+	size_t i;
+
+	table = *(call_handler_t ***)gen_add_base(&call_table);
+
+	index = CALL_TABLE_INDEX(identifier);
+
+	for(i = 0; i < CALL_TABLE_SIZE; i++) {
+
+		*handler = table[(index + i) & (CALL_TABLE_SIZE - 1)];
+
+		if(*handler == NULL) {
+			break;
+		}
+
+		if((*handler)->identifier == identifier) {
+			return SUCCESS;
+		}
+	}
+
+	*handler = *(call_handler_t **)gen_add_base(&call_default);
+
+	return (*handler == NULL) ? FAILURE : SUCCESS;
+}
+
 result_t call_find_handler(lst_item_t **item, size_t identifier) {
 
 	call_handler_t *handler;
+	lst_item_t *fallback = NULL;
 
 	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
 
@@ -158,61 +444,551 @@ result_t call_find_handler(lst_item_t **item, size_t identifier) {
 		return FAILURE;
 	CHECK_END
 
+	// an exact match always wins, the default handler is only
+	// used when no handler is registered for the identifier
     while((*item) != NULL) {
 
     	lst_get_data(*item, (void **)&handler);
 
-    	if(handler->identifier == identifier || handler->identifier == CALL_DEFAULT_HANDLER) {
+    	if(handler->identifier == identifier) {
             return SUCCESS;
         }
 
+    	if((handler->identifier == CALL_DEFAULT_HANDLER) && (fallback == NULL)) {
+    		fallback = *item;
+    	}
+
     	CHECK_SUCCESS(lst_get_next_item(*item, item), "unable to get the next item", *item, call_dbg, DBG_LEVEL_2)
     		return FAILURE;
     	CHECK_END
     }
 
+    *item = fallback;
+
     return SUCCESS;
 }
 
 result_t call_dispatch(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
 
-	lst_item_t *cl;
-	call_handler_t *tmp;
-	size_t identifier;
-
 	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
 
 	UNUSED_VARIABLE(handler);
 
 	if(registers->r0 == CALLSIGN) {
 
+		CHECK_SUCCESS(call_invoke(registers->r1, registers), "unable to invoke the call handler", registers->r1, call_dbg, DBG_LEVEL_3)
+			return FAILURE;
+		CHECK_END
+
+		*handled = TRUE;
+	}
+
+	return SUCCESS;
+}
+
+// runs the handler of identifier on registers, shared by call_dispatch
+// and the batches
+result_t call_invoke(size_t identifier, gen_general_purpose_registers_t *registers) {
+
+	call_handler_t *tmp;
+	size_t function;
+	size_t start;
+	size_t cycles;
+	result_t result;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(call_lookup_handler(identifier, &tmp), "unable to locate call handler", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("identifier", tmp->identifier, call_dbg, DBG_LEVEL_3);
+	DBG_LOG_STATEMENT("function", tmp->function, call_dbg, DBG_LEVEL_3);
+
+	// the handler may overwrite r2 with a result
+	function = registers->r2;
+
+	start = cpu_get_cycle_count();
+
+	result = tmp->function(tmp, tmp->data, registers);
+
+	cycles = cpu_get_cycle_count() - start;
+
+	call_update_metrics(tmp, function, cycles, ((result != SUCCESS) || (registers->r0 != SUCCESS)));
+
+	// a call handler returns its results in the registers so it
+	// can not be moved to the deferred queue, it is only flagged
+	if(cpu_update_statistics(&(tmp->statistics), cycles) == TRUE) {
+
+		DBG_LOG_STATEMENT("handler is over budget", tmp->identifier, call_dbg, DBG_LEVEL_2);
+
+		cpu_atomic_or(&(tmp->flags), CALL_HANDLER_FLAG_OVER_BUDGET);
+	}
+
+	CHECK_SUCCESS(result, "handler returned failure", FAILURE, call_dbg, DBG_LEVEL_3)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+// finds the lowest metrics row that no registered handler uses
+result_t call_get_metrics_index(size_t *index) {
+
+	lst_item_t *cl;
+	call_handler_t *handler;
+	bool_t used;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	for(*index = 0; *index < CALL_METRICS_HANDLERS; (*index)++) {
+
 		cl = *(lst_item_t **)gen_add_base(&call_list);
 
 		CHECK_SUCCESS(lst_get_first_item(cl, &cl), "unable to get the first item", cl, call_dbg, DBG_LEVEL_2)
 			return FAILURE;
 		CHECK_END
 
-		identifier = registers->r1;
+		used = FALSE;
 
-		CHECK_SUCCESS(call_find_handler(&cl, identifier), "unable to locate call handler", identifier, call_dbg, DBG_LEVEL_2)
-			return FAILURE;
-		CHECK_END
+		while(cl != NULL) {
+
+			lst_get_data(cl, (void **)&handler);
+
+			if(handler->index == *index) {
+				used = TRUE;
+				break;
+			}
+
+			lst_get_next_item(cl, &cl);
+		}
+
+		if(used == FALSE) {
+			return SUCCESS;
+		}
+	}
+
+	return FAILURE;
+}
+
+// the metrics of a cpu are only written by that cpu with interrupts masked
+void call_update_metrics(call_handler_t *handler, size_t function, size_t cycles, bool_t failed) {
+
+	call_metrics_t *metrics;
+
+	if(handler->index == CALL_METRICS_NO_INDEX) {
+		return;
+	}
+
+	if(function >= CALL_METRICS_FUNCTIONS) {
+		function = CALL_METRICS_FUNCTIONS - 1;
+	}
+
+	metrics = &(((call_metrics_t **)gen_add_base(&call_metrics))[cpu_get_id()][(handler->index * CALL_METRICS_FUNCTIONS) + function]);
+
+	metrics->calls++;
+
+	if(failed == TRUE) {
+		metrics->failures++;
+	}
+
+	metrics->total_low += cycles;
+
+	if(metrics->total_low < cycles) {
+		metrics->total_high++;
+	}
+
+	if((metrics->calls == 1) || (cycles < metrics->minimum)) {
+		metrics->minimum = cycles;
+	}
+
+	if(cycles > metrics->maximum) {
+		metrics->maximum = cycles;
+	}
+}
+
+// sums the metrics of a sub-function of the first handler registered
+// for identifier over the cpus
+result_t call_get_metrics(size_t identifier, size_t function, call_metrics_t *metrics) {
+
+	call_handler_t *handler;
+	call_metrics_t **cpus;
+	call_metrics_t *tmp;
+	size_t i;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(call_lookup_handler(identifier, &handler), "unable to locate call handler", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK((handler->identifier == identifier) && (handler->index != CALL_METRICS_NO_INDEX), "handler has no metrics", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	if(function >= CALL_METRICS_FUNCTIONS) {
+		function = CALL_METRICS_FUNCTIONS - 1;
+	}
+
+	memset(metrics, 0, sizeof(call_metrics_t));
+
+	cpus = gen_add_base(&call_metrics);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		tmp = &(cpus[i][(handler->index * CALL_METRICS_FUNCTIONS) + function]);
+
+		if(tmp->calls == 0) {
+			continue;
+		}
+
+		if((metrics->calls == 0) || (tmp->minimum < metrics->minimum)) {
+			metrics->minimum = tmp->minimum;
+		}
+
+		if(tmp->maximum > metrics->maximum) {
+			metrics->maximum = tmp->maximum;
+		}
+
+		metrics->calls += tmp->calls;
+		metrics->failures += tmp->failures;
+		metrics->total_high += tmp->total_high;
+		metrics->total_low += tmp->total_low;
+
+		if(metrics->total_low < tmp->total_low) {
+			metrics->total_high++;
+		}
+	}
+
+	return SUCCESS;
+}
+
+// one record per sub-function that has been called, for every handler
+// that call_lookup_handler would pick
+result_t call_metrics_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	lst_item_t *cl;
+	call_handler_t *tmp;
+	call_handler_t *found;
+	call_metrics_record_t record;
+	call_metrics_record_t *records;
+	size_t size;
+	size_t count;
+	size_t i;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	records = (call_metrics_record_t *)(registers->r3);
+	size = registers->r4;
+	count = 0;
+
+	CHECK((records != NULL) || (size == 0), "records is null", records, call_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	cl = *(lst_item_t **)gen_add_base(&call_list);
+
+	CHECK_SUCCESS(lst_get_first_item(cl, &cl), "unable to get the first item", cl, call_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	while(cl != NULL) {
 
 		lst_get_data(cl, (void **)&tmp);
 
-		DBG_LOG_STATEMENT("identifier", tmp->identifier, call_dbg, DBG_LEVEL_3);
-		DBG_LOG_STATEMENT("function", tmp->function, call_dbg, DBG_LEVEL_3);
+		lst_get_next_item(cl, &cl);
 
-		CHECK_SUCCESS(tmp->function(tmp, tmp->data, registers), "handler returned failure", FAILURE, call_dbg, DBG_LEVEL_3)
-			return FAILURE;
-		CHECK_END
+		// skip handlers shadowed by an earlier one with the same identifier
+		if((tmp->identifier == CALL_DEFAULT_HANDLER) || (call_lookup_handler(tmp->identifier, &found) != SUCCESS) || (found != tmp)) {
+			continue;
+		}
 
-		*handled = TRUE;
+		for(i = 0; i < CALL_METRICS_FUNCTIONS; i++) {
+
+			if((call_get_metrics(tmp->identifier, i, &(record.metrics)) != SUCCESS) || (record.metrics.calls == 0)) {
+				continue;
+			}
+
+			record.identifier = tmp->identifier;
+			record.function = i;
+
+			if(count < size) {
+				memcpy(&(records[count]), &record, sizeof(call_metrics_record_t));
+			}
+
+			count++;
+		}
+	}
+
+	registers->r1 = (count < size) ? count : size;
+	registers->r2 = count;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t call_metrics_reset_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	call_metrics_t **metrics;
+	size_t i;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	metrics = gen_add_base(&call_metrics);
+
+	// the other cpus may be updating their rows, a count can
+	// survive the reset but the rows stay consistent enough
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+		memset(metrics[i], 0, (CALL_METRICS_HANDLERS * CALL_METRICS_FUNCTIONS * sizeof(call_metrics_t)));
+	}
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+// a leaf runs on the und stack of the microvisor with the paging
+// system of the operating system and interrupts masked. it can only use
+// the registers and the memory of the microvisor that is mapped for the
+// vector stubs, it must not fault or log
+result_t call_register_leaf(size_t identifier, vec_leaf_function_t function) {
+
+	vec_leaf_function_t *table;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK((identifier >= CALL_LEAF_IDENTIFIER_BASE) && (identifier < CALL_LEAF_IDENTIFIER_END), "identifier is not a leaf identifier", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_NOT_NULL(function, "function is null", function, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	table = gen_add_base(&vec_leaf_table);
+
+	CHECK_EQUAL(table[identifier - CALL_LEAF_IDENTIFIER_BASE], NULL, "leaf is already registered", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_set_leaf_function((identifier - CALL_LEAF_IDENTIFIER_BASE), function), "unable to set the leaf function", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+// a cpu may still be running the leaf, the caller has to make sure
+// it is not freed or unloaded straight away
+result_t call_unregister_leaf(size_t identifier, vec_leaf_function_t function) {
+
+	vec_leaf_function_t *table;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK((identifier >= CALL_LEAF_IDENTIFIER_BASE) && (identifier < CALL_LEAF_IDENTIFIER_END), "identifier is not a leaf identifier", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	table = gen_add_base(&vec_leaf_table);
+
+	CHECK_EQUAL(table[identifier - CALL_LEAF_IDENTIFIER_BASE], function, "leaf is not registered", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_set_leaf_function((identifier - CALL_LEAF_IDENTIFIER_BASE), NULL), "unable to clear the leaf function", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+size_t call_leaf_cycle_count(size_t function, size_t argument) {
+
+	UNUSED_VARIABLE(function);
+	UNUSED_VARIABLE(argument);
+
+	return cpu_get_cycle_count();
+}
+
+// runs descriptor on its own copy of registers so the handlers are the
+// same as for a single hypercall. a handler that returns FAILURE is
+// reported as FAILURE in results[0] and batches do not nest
+result_t call_execute_descriptor(call_descriptor_t *descriptor, gen_general_purpose_registers_t *registers) {
+
+	gen_general_purpose_registers_t tmp;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	memset(&tmp, 0, sizeof(gen_general_purpose_registers_t));
+
+	tmp.r0 = CALLSIGN;
+	tmp.r1 = descriptor->identifier;
+	tmp.r2 = descriptor->function;
+	tmp.r3 = descriptor->arguments[0];
+	tmp.r4 = descriptor->arguments[1];
+	tmp.r5 = descriptor->arguments[2];
+	tmp.r6 = descriptor->arguments[3];
+	tmp.r7 = descriptor->arguments[4];
+	tmp.r8 = descriptor->arguments[5];
+	tmp.sp = registers->sp;
+	tmp.lr = registers->lr;
+
+	if((tmp.r1 == CALL_BATCH_IDENTIFIER) || (call_invoke(tmp.r1, &tmp) != SUCCESS)) {
+		tmp.r0 = FAILURE;
+	}
+
+	descriptor->results[0] = tmp.r0;
+	descriptor->results[1] = tmp.r1;
+	descriptor->results[2] = tmp.r2;
+	descriptor->results[3] = tmp.r3;
+	descriptor->results[4] = tmp.r4;
+
+	return (tmp.r0 == SUCCESS) ? SUCCESS : FAILURE;
+}
+
+result_t call_batch_execute_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	call_descriptor_t *descriptors;
+	size_t number;
+	size_t flags;
+	size_t i;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	descriptors = (call_descriptor_t *)(registers->r3);
+	number = registers->r4;
+	flags = registers->r5;
+
+	registers->r1 = 0;
+
+	CHECK_NOT_NULL(descriptors, "descriptors is null", descriptors, call_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	// a longer batch is not an error, the operating system traps again
+	// for the descriptors that are left
+	if(number > CALL_BATCH_LIMIT) {
+		number = CALL_BATCH_LIMIT;
 	}
 
+	registers->r0 = SUCCESS;
+
+	for(i = 0; i < number; i++) {
+
+		registers->r1 = i + 1;
+
+		if(call_execute_descriptor(&(descriptors[i]), registers) != SUCCESS) {
+
+			registers->r0 = FAILURE;
+
+			if((flags & CALL_BATCH_FLAG_STOP_ON_ERROR) != 0) {
+				break;
+			}
+		}
+	}
+
+	registers->r2 = registers->r4 - registers->r1;
+
 	return SUCCESS;
 }
 
+result_t call_get_handler(size_t identifier, call_function_t function, call_handler_t **handler) {
+
+	lst_item_t *cl;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(handler, "handler is null", handler, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cl = *(lst_item_t **)gen_add_base(&call_list);
+
+	CHECK_SUCCESS(lst_get_first_item(cl, &cl), "unable to get the first item", cl, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	while((call_find_handler(&cl, identifier) == SUCCESS) && (cl != NULL)) {
+
+		lst_get_data(cl, (void **)handler);
+
+		// call_find_handler falls back to the default handler
+		if((*handler)->identifier != identifier) {
+			break;
+		}
+
+		if((*handler)->function == function) {
+			return SUCCESS;
+		}
+
+		lst_get_next_item(cl, &cl);
+	}
+
+	DBG_LOG_STATEMENT("handler is not registered", identifier, call_dbg, DBG_LEVEL_2);
+
+	return FAILURE;
+}
+
+// a budget of CPU_STATISTICS_NO_BUDGET turns the checks off
+result_t call_set_handler_budget(size_t identifier, call_function_t function, size_t budget) {
+
+	call_handler_t *handler;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(call_get_handler(identifier, function, &handler), "unable to get the handler", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	handler->statistics.budget = budget;
+	handler->statistics.consecutive = 0;
+	cpu_atomic_clear(&(handler->flags), CALL_HANDLER_FLAG_OVER_BUDGET);
+
+	return SUCCESS;
+}
+
+result_t call_get_handler_statistics(size_t identifier, call_function_t function, cpu_statistics_t *statistics) {
+
+	call_handler_t *handler;
+
+	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(statistics, "statistics is null", statistics, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_get_handler(identifier, function, &handler), "unable to get the handler", identifier, call_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(statistics, &(handler->statistics), sizeof(cpu_statistics_t));
+
+	return SUCCESS;
+}
+
+result_t call_table_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	if((registers->r2 >= handler->size) || (handler->functions[registers->r2] == NULL)) {
+		DBG_LOG_STATEMENT("unhandled function", registers->r2, call_dbg, DBG_LEVEL_3);
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	}
+
+	return handler->functions[registers->r2](handler, data, registers);
+}
+
 result_t call_default_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
 
 	DBG_LOG_FUNCTION(call_dbg, DBG_LEVEL_3);
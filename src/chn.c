@@ -0,0 +1,410 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/vmsa/tt.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/chn.h>
+#include <kernel/cpu.h>
+#include <kernel/mas.h>
+#include <kernel/mmu.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(chn_dbg, DBG_LEVEL_2);
+
+// the drain and the vector handler do not log, they run on every
+// exception entry
+
+chn_channel_t chn_channels[CHN_CHANNELS_SIZE];
+
+// number of channels bound to each cpu so exception entries
+// without channels only pay for one load
+size_t chn_counts[CPU_NUMBER_OF_CPUS];
+
+// the sub-functions of CHN_CALL_IDENTIFIER indexed by r2
+call_function_t chn_call_functions[CHN_NUMBER_OF_FUNCTIONS];
+
+result_t chn_init(void) {
+
+	call_function_t *functions;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	CHECK(sizeof(chn_shared_t) <= FOUR_KILOBYTES, "chn_shared_t does not fit in a page", sizeof(chn_shared_t), chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(gen_add_base(&chn_channels), 0, sizeof(chn_channels));
+	memset(gen_add_base(&chn_counts), 0, sizeof(chn_counts));
+
+	functions = gen_add_base(&chn_call_functions);
+
+	functions[CHN_FUNCTION_CREATE] = gen_add_base(&chn_call_create_handler);
+	functions[CHN_FUNCTION_DESTROY] = gen_add_base(&chn_call_destroy_handler);
+	functions[CHN_FUNCTION_KICK] = gen_add_base(&chn_call_kick_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(CHN_CALL_IDENTIFIER, functions, CHN_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drain ahead of call_dispatch because it terminates the chain
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&chn_vec_handler), NULL, VEC_HANDLER_PRIORITY_DEFAULT + 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec call handler", FAILURE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drain after every other interrupt handler has had a chance to claim the interrupt
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&chn_vec_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST + 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec interrupt handler", FAILURE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t chn_fini(void) {
+
+	chn_channel_t *channels;
+	size_t i;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&chn_vec_handler)), "unable to unregister the vec interrupt handler", FAILURE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&chn_vec_handler)), "unable to unregister the vec call handler", FAILURE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_unregister_handler_table(CHN_CALL_IDENTIFIER, gen_add_base(&chn_call_functions)), "unable to unregister the call handler", FAILURE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	channels = gen_add_base(&chn_channels);
+
+	for(i = 0; i < CHN_CHANNELS_SIZE; i++) {
+
+		if(channels[i].used == TRUE) {
+
+			CHECK_SUCCESS(chn_destroy(i), "unable to destroy the channel", i, chn_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+		}
+	}
+
+	return SUCCESS;
+}
+
+// the shared page is allocated by the microvisor, which already has it
+// mapped, and mapped into the operating system paging system as well
+result_t chn_create(size_t *channel, tt_virtual_address_t *va) {
+
+	chn_channel_t *channels;
+	chn_shared_t *shared;
+	tt_virtual_address_t tmp;
+	tt_physical_address_t pa;
+	size_t i;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	channels = gen_add_base(&chn_channels);
+
+	for(i = 0; i < CHN_CHANNELS_SIZE; i++) {
+
+		if(channels[i].used == FALSE) {
+			break;
+		}
+	}
+
+	CHECK(i < CHN_CHANNELS_SIZE, "no free channels", CHN_CHANNELS_SIZE, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	shared = memalign(FOUR_KILOBYTES, FOUR_KILOBYTES);
+
+	CHECK_NOT_NULL(shared, "unable to allocate memory for the shared page", shared, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(shared, 0, FOUR_KILOBYTES);
+
+	tmp.all = (size_t)shared;
+
+	CHECK_SUCCESS(mmu_lookup_pa(tmp, &pa), "unable to lookup the pa of the shared page", shared, chn_dbg, DBG_LEVEL_2)
+		free(shared);
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, chn_dbg, DBG_LEVEL_2)
+		free(shared);
+		return FAILURE;
+	CHECK_END
+
+	// the operating system owns everything below 3 GB
+	va->all = ((u32_t)ONE_GIGABYTE * 3);
+
+	// the requests are executed without checking who wrote them so the
+	// page is not accessible from user mode
+	CHECK_SUCCESS(mmu_map(pa, FOUR_KILOBYTES, MMU_MAP_EXTERNAL | MMU_MAP_NORMAL_MEMORY | MMU_MAP_EXECUTE_NEVER | MMU_MAP_PRIVILEGED, va), "unable to map the shared page", pa.all, chn_dbg, DBG_LEVEL_2)
+		free(shared);
+		return FAILURE;
+	CHECK_END
+
+	channels[i].shared = shared;
+	channels[i].va = *va;
+	channels[i].cpu = cpu_get_id();
+	channels[i].executed = 0;
+
+	cpu_data_memory_barrier();
+
+	channels[i].used = TRUE;
+
+	((size_t *)gen_add_base(&chn_counts))[channels[i].cpu]++;
+
+	*channel = i;
+
+	return SUCCESS;
+}
+
+// called on the cpu of the channel, or from any cpu by chn_fini once the
+// handlers that drain the channels are gone
+result_t chn_destroy(size_t channel) {
+
+	chn_channel_t *channels;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	channels = gen_add_base(&chn_channels);
+
+	CHECK((channel < CHN_CHANNELS_SIZE) && (channels[channel].used == TRUE), "channel is not in use", channel, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// a failed unmap leaves the channel whole and still in use
+	CHECK_SUCCESS(mmu_unmap(channels[channel].va, FOUR_KILOBYTES, MMU_MAP_EXTERNAL), "unable to unmap the shared page", channels[channel].va.all, chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	channels[channel].used = FALSE;
+
+	((size_t *)gen_add_base(&chn_counts))[channels[channel].cpu]--;
+
+	// a drain that found the channel before it was released may still
+	// be running on the cpu of the channel
+	CHECK_SUCCESS(vec_retire(channels[channel].shared), "unable to retire the shared page", (size_t)(channels[channel].shared), chn_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	channels[channel].shared = NULL;
+
+	return SUCCESS;
+}
+
+// executes up to limit requests and returns the number executed. it
+// stops early when the completion ring is full so no result is lost.
+// the request is copied out first as the operating system owns the page
+size_t chn_drain(chn_channel_t *channel, size_t limit, gen_general_purpose_registers_t *registers) {
+
+	chn_shared_t *shared;
+	chn_completion_t *completion;
+	call_descriptor_t descriptor;
+	size_t tag;
+	size_t tail;
+	size_t head;
+	size_t count;
+
+	shared = channel->shared;
+
+	for(count = 0; count < limit; count++) {
+
+		tail = shared->sq_tail;
+		head = shared->cq_head;
+
+		if((tail == shared->sq_head) || ((head - shared->cq_tail) >= CHN_RING_SIZE)) {
+			break;
+		}
+
+		// read the request only after seeing sq_head
+		cpu_data_memory_barrier();
+
+		tag = shared->requests[tail & (CHN_RING_SIZE - 1)].tag;
+
+		descriptor.identifier = shared->requests[tail & (CHN_RING_SIZE - 1)].identifier;
+		descriptor.function = shared->requests[tail & (CHN_RING_SIZE - 1)].function;
+
+		memcpy(descriptor.arguments, shared->requests[tail & (CHN_RING_SIZE - 1)].arguments, sizeof(descriptor.arguments));
+
+		if(descriptor.identifier == CHN_CALL_IDENTIFIER) {
+			memset(descriptor.results, 0, sizeof(descriptor.results));
+			descriptor.results[0] = FAILURE;
+		}
+		else {
+			call_execute_descriptor(&descriptor, registers);
+		}
+
+		completion = &(shared->completions[head & (CHN_RING_SIZE - 1)]);
+
+		completion->tag = tag;
+
+		memcpy(completion->results, descriptor.results, sizeof(completion->results));
+
+		// the completion must be visible before cq_head
+		cpu_data_memory_barrier();
+
+		shared->cq_head = head + 1;
+		shared->sq_tail = tail + 1;
+	}
+
+	channel->executed += count;
+
+	return count;
+}
+
+result_t chn_call_create_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	tt_virtual_address_t va;
+	size_t channel;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(chn_create(&channel, &va), "unable to create a channel", FAILURE, chn_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = channel;
+	registers->r2 = va.all;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t chn_call_destroy_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	chn_channel_t *channels;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	channels = gen_add_base(&chn_channels);
+
+	CHECK((registers->r3 < CHN_CHANNELS_SIZE) && (channels[registers->r3].cpu == cpu_get_id()), "channel is not bound to this cpu", registers->r3, chn_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	CHECK_SUCCESS(chn_destroy(registers->r3), "unable to destroy the channel", registers->r3, chn_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t chn_call_kick_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	chn_channel_t *channels;
+	size_t channel;
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	channels = gen_add_base(&chn_channels);
+	channel = registers->r3;
+
+	CHECK((channel < CHN_CHANNELS_SIZE) && (channels[channel].used == TRUE), "channel is not in use", channel, chn_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	CHECK(channels[channel].cpu == cpu_get_id(), "channel is not bound to this cpu", channel, chn_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	// one ring worth of requests so a producer that keeps
+	// posting can not hold the cpu in the microvisor
+	registers->r1 = chn_drain(&(channels[channel]), CHN_RING_SIZE, registers);
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+// drains a few requests of the channels of this cpu on every exception
+// entry it is registered on, it never claims the exception
+result_t chn_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	chn_channel_t *channels;
+	size_t cpu;
+	size_t i;
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+
+	cpu = cpu_get_id();
+
+	if(((size_t *)gen_add_base(&chn_counts))[cpu] == 0) {
+		return SUCCESS;
+	}
+
+	channels = gen_add_base(&chn_channels);
+
+	for(i = 0; i < CHN_CHANNELS_SIZE; i++) {
+
+		if((channels[i].used == TRUE) && (channels[i].cpu == cpu)) {
+			chn_drain(&(channels[i]), CHN_DRAIN_LIMIT, registers);
+		}
+	}
+
+	return SUCCESS;
+}
+
+result_t chn_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(chn_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t chn_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(chn_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(chn_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,247 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+#include <armv7lib/int.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+
+#include <kernel/cpu.h>
+
+// nothing here logs, the functions are called from the exception
+// handling paths and from the log
+
+// set from ID_PFR1 by the first timestamp, the log takes one before
+// cpu_init runs
+size_t cpu_timestamp_source = CPU_TIMESTAMP_SOURCE_UNKNOWN;
+
+// the timestamps of the cpus when there is no generic timer
+cpu_clock_t cpu_clocks[CPU_NUMBER_OF_CPUS];
+
+// TRUE once the cycle counter of the cpu has been turned on
+size_t cpu_cycle_counters[CPU_NUMBER_OF_CPUS];
+
+result_t cpu_init(void) {
+
+	cpu_prepare_cycle_counter();
+
+	cpu_get_timestamp_source();
+
+	return SUCCESS;
+}
+
+size_t cpu_get_id(void) {
+
+	gen_multiprocessor_affinity_register_t mpidr;
+
+	mpidr = gen_get_mpidr();
+
+	return (mpidr.fields.al_0 & (CPU_NUMBER_OF_CPUS - 1));
+}
+
+// the microvisor takes over the cycle counter of the pmu on every cpu and
+// the operating system must leave it running. cpu_init turns it on for the
+// boot cpu, the others turn it on once at their first exception or clock
+// calibration, whichever comes first. only the cpu itself writes its entry
+void cpu_prepare_cycle_counter(void) {
+
+	size_t *enabled;
+
+	enabled = &(((size_t *)gen_add_base(&cpu_cycle_counters))[cpu_get_id()]);
+
+	if(*enabled == FALSE) {
+		cpu_enable_cycle_counter();
+		*enabled = TRUE;
+	}
+}
+
+bool_t cpu_update_statistics(cpu_statistics_t *statistics, size_t cycles) {
+
+	statistics->count++;
+	statistics->last = cycles;
+
+	if((statistics->count == 1) || (cycles < statistics->minimum)) {
+		statistics->minimum = cycles;
+	}
+
+	if(cycles > statistics->maximum) {
+		statistics->maximum = cycles;
+	}
+
+	if(cycles > statistics->average) {
+		statistics->average += ((cycles - statistics->average) >> CPU_STATISTICS_AVERAGE_SHIFT);
+	}
+	else {
+		statistics->average -= ((statistics->average - cycles) >> CPU_STATISTICS_AVERAGE_SHIFT);
+	}
+
+	if((statistics->budget == CPU_STATISTICS_NO_BUDGET) || (cycles <= statistics->budget)) {
+		statistics->consecutive = 0;
+		return FALSE;
+	}
+
+	statistics->exceeded++;
+	statistics->consecutive++;
+
+	// only report once per run of overruns
+	return (statistics->consecutive == CPU_STATISTICS_OVERRUN_LIMIT) ? TRUE : FALSE;
+}
+
+size_t cpu_get_timestamp_source(void) {
+
+	size_t *source;
+	size_t features;
+
+	source = gen_add_base(&cpu_timestamp_source);
+
+	if(*source == CPU_TIMESTAMP_SOURCE_UNKNOWN) {
+
+		features = cpu_get_processor_feature_1();
+
+		if(((features >> CPU_ID_PFR1_GENERIC_TIMER_SHIFT) & CPU_ID_PFR1_GENERIC_TIMER_MASK) != 0) {
+			*source = CPU_TIMESTAMP_SOURCE_GENERIC_TIMER;
+		}
+		else {
+			*source = CPU_TIMESTAMP_SOURCE_CYCLE_COUNT;
+		}
+	}
+
+	return *source;
+}
+
+bool_t cpu_has_generic_timer(void) {
+
+	return (cpu_get_timestamp_source() == CPU_TIMESTAMP_SOURCE_GENERIC_TIMER) ? TRUE : FALSE;
+}
+
+// the generic timer count is the same on every cpu. without it the cycle
+// count of the cpu is used, extended to 64 bits and moved by the offset
+// the cpu was calibrated with. the cycle counters run at the core clock
+// and stop in some low power states so the timestamps of two cpus are
+// only roughly ordered, and the count has to be read at least once per
+// wrap for the extension to hold. a smaller count than last time is only
+// a wrap when the overflow flag says so, otherwise the operating system
+// wrote the counter and the offset absorbs the jump. the timestamp can be
+// taken by a handler that interrupts another one, so interrupts are
+// masked while the clock is updated
+size_t cpu_get_timestamp(size_t *high) {
+
+	gen_program_status_register_t cpsr;
+	cpu_clock_t *clock;
+	size_t count;
+	size_t jump;
+	size_t low;
+
+	if(cpu_get_timestamp_source() == CPU_TIMESTAMP_SOURCE_GENERIC_TIMER) {
+		return cpu_get_physical_count(high);
+	}
+
+	cpsr = gen_get_cpsr();
+
+	int_disable_irq();
+	int_disable_fiq();
+
+	clock = &(((cpu_clock_t *)gen_add_base(&cpu_clocks))[cpu_get_id()]);
+
+	if(clock->calibrated == FALSE) {
+		cpu_calibrate_clock(clock);
+	}
+
+	count = cpu_get_cycle_count();
+
+	if(count < clock->last) {
+
+		if(cpu_clear_cycle_count_overflow() == TRUE) {
+			clock->wraps++;
+		}
+		else {
+			jump = clock->last - count;
+			clock->offset_high += ((clock->offset_low + jump) < clock->offset_low) ? 1 : 0;
+			clock->offset_low += jump;
+		}
+	}
+
+	clock->last = count;
+
+	low = count + clock->offset_low;
+	*high = clock->wraps + clock->offset_high + ((low < count) ? 1 : 0);
+
+	clock->latest_high = *high;
+	clock->latest_low = low;
+
+	if(cpsr.fields.f == FALSE) {
+		int_enable_fiq();
+	}
+
+	if(cpsr.fields.i == FALSE) {
+		int_enable_irq();
+	}
+
+	return low;
+}
+
+// starts the clock of this cpu at the latest timestamp taken by the cpus
+// that are already calibrated so its records do not sort before theirs.
+// a torn read of another clock only moves the starting point
+void cpu_calibrate_clock(cpu_clock_t *clock) {
+
+	cpu_clock_t *clocks;
+	size_t latest_low;
+	size_t latest_high;
+	size_t i;
+
+	clocks = gen_add_base(&cpu_clocks);
+
+	latest_low = 0;
+	latest_high = 0;
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(clocks[i].calibrated == FALSE) {
+			continue;
+		}
+
+		if((clocks[i].latest_high > latest_high) ||
+		   ((clocks[i].latest_high == latest_high) && (clocks[i].latest_low > latest_low))) {
+			latest_high = clocks[i].latest_high;
+			latest_low = clocks[i].latest_low;
+		}
+	}
+
+	cpu_prepare_cycle_counter();
+
+	// a wrap from before the calibration is not one of this clock
+	cpu_clear_cycle_count_overflow();
+
+	clock->last = cpu_get_cycle_count();
+	clock->wraps = 0;
+	clock->offset_low = latest_low - clock->last;
+	clock->offset_high = latest_high - ((latest_low < clock->last) ? 1 : 0);
+	clock->latest_low = latest_low;
+	clock->latest_high = latest_high;
+
+	cpu_data_memory_barrier();
+
+	clock->calibrated = TRUE;
+}
@@ -0,0 +1,300 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
+#include <kernel/mas.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(dfr_dbg, DBG_LEVEL_2);
+
+// each queue is a separate allocation so the cpus do not share cache lines
+dfr_queue_t *dfr_queues[CPU_NUMBER_OF_CPUS];
+
+// the sub-functions of DFR_CALL_IDENTIFIER indexed by r2
+call_function_t dfr_call_functions[DFR_NUMBER_OF_FUNCTIONS];
+
+result_t dfr_init(void) {
+
+	dfr_queue_t **queues;
+	call_function_t *functions;
+	size_t i;
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	queues = gen_add_base(&dfr_queues);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		queues[i] = malloc(sizeof(dfr_queue_t));
+
+		CHECK_NOT_NULL(queues[i], "unable to allocate memory for the queue", i, dfr_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(queues[i], 0, sizeof(dfr_queue_t));
+
+		CHECK_SUCCESS(rng_init(&(queues[i]->ring), sizeof(dfr_item_t), DFR_QUEUE_SIZE), "unable to initialize the ring", i, dfr_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+	}
+
+	functions = gen_add_base(&dfr_call_functions);
+
+	functions[DFR_FUNCTION_DRAIN] = gen_add_base(&dfr_call_drain_handler);
+	functions[DFR_FUNCTION_STATISTICS] = gen_add_base(&dfr_call_statistics_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(DFR_CALL_IDENTIFIER, functions, DFR_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drain ahead of call_dispatch because it terminates the chain
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&dfr_vec_call_handler), NULL, VEC_HANDLER_PRIORITY_DEFAULT + 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec call handler", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drain after every other interrupt handler has had a chance to claim the interrupt
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&dfr_vec_interrupt_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST + 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec interrupt handler", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t dfr_fini(void) {
+
+	dfr_queue_t **queues;
+	size_t i;
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&dfr_vec_interrupt_handler)), "unable to unregister the vec interrupt handler", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&dfr_vec_call_handler)), "unable to unregister the vec call handler", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_unregister_handler_table(DFR_CALL_IDENTIFIER, gen_add_base(&dfr_call_functions)), "unable to unregister the call handler", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	queues = gen_add_base(&dfr_queues);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(queues[i] != NULL) {
+			rng_fini(&(queues[i]->ring));
+			free(queues[i]);
+			queues[i] = NULL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+// dfr_enqueue is meant to be called from handler context, it does not
+// log and never waits. FAILURE means the item was dropped.
+result_t dfr_enqueue(dfr_function_t function, void *data, size_t argument, gen_general_purpose_registers_t *registers) {
+
+	dfr_queue_t *queue;
+	dfr_item_t item;
+
+	queue = ((dfr_queue_t **)gen_add_base(&dfr_queues))[cpu_get_id()];
+
+	if((queue == NULL) || (function == NULL)) {
+		return FAILURE;
+	}
+
+	item.function = function;
+	item.data = data;
+	item.argument = argument;
+
+	if(registers != NULL) {
+		memcpy(&(item.registers), registers, sizeof(gen_general_purpose_registers_t));
+	}
+	else {
+		memset(&(item.registers), 0, sizeof(gen_general_purpose_registers_t));
+	}
+
+	return rng_put(&(queue->ring), &item);
+}
+
+result_t dfr_drain(size_t limit, size_t *count) {
+
+	dfr_queue_t *queue;
+	dfr_item_t item;
+	size_t head;
+	size_t i;
+
+	queue = ((dfr_queue_t **)gen_add_base(&dfr_queues))[cpu_get_id()];
+
+	if(queue == NULL) {
+		return FAILURE;
+	}
+
+	// the work queued by the items, such as the next slice of a
+	// hypercall, waits for the next drain. a pass never runs past
+	// the items that were there when it started
+	head = queue->ring.head;
+
+	for(i = 0; (limit == DFR_DRAIN_ALL) || (i < limit); i++) {
+
+		if(queue->ring.tail == head) {
+			break;
+		}
+
+		if(rng_get(&(queue->ring), &item) != SUCCESS) {
+			break;
+		}
+
+		if(item.function(&item) != SUCCESS) {
+			queue->failed++;
+		}
+
+		queue->executed++;
+	}
+
+	if(count != NULL) {
+		*count = i;
+	}
+
+	return SUCCESS;
+}
+
+result_t dfr_get_statistics(size_t cpu, size_t *depth, size_t *dropped, size_t *executed, size_t *failed) {
+
+	dfr_queue_t *queue;
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	queue = ((dfr_queue_t **)gen_add_base(&dfr_queues))[cpu];
+
+	CHECK_NOT_NULL(queue, "queue is null", cpu, dfr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	*depth = rng_get_depth(&(queue->ring));
+	*dropped = queue->ring.dropped;
+	*executed = queue->executed;
+	*failed = queue->failed;
+
+	return SUCCESS;
+}
+
+result_t dfr_call_drain_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	dfr_queue_t *queue;
+	size_t count;
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	// a trap only runs a bounded number of items, the operating
+	// system calls again until nothing is left
+	CHECK_SUCCESS(dfr_drain(DFR_DRAIN_LIMIT, &count), "unable to drain the queue", FAILURE, dfr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = count;
+	queue = ((dfr_queue_t **)gen_add_base(&dfr_queues))[cpu_get_id()];
+	registers->r2 = rng_get_depth(&(queue->ring));
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t dfr_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(dfr_get_statistics(registers->r3, &(registers->r1), &(registers->r2), &(registers->r3), &(registers->r4)), "unable to get the statistics", registers->r3, dfr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t dfr_vec_call_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+
+	// every hypercall is a point where the operating system
+	// has already agreed to spend time in the microvisor, but
+	// only a few items go ahead of the hypercall itself
+	if(registers->r0 == CALLSIGN) {
+		dfr_drain(DFR_CALL_LIMIT, NULL);
+	}
+
+	return SUCCESS;
+}
+
+result_t dfr_vec_interrupt_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+	UNUSED_VARIABLE(registers);
+
+	dfr_drain(DFR_INTERRUPT_LIMIT, NULL);
+
+	return SUCCESS;
+}
+
+result_t dfr_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(dfr_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t dfr_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(dfr_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(dfr_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,377 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+#include <armv7lib/int.h>
+#include <armv7lib/cmsa/cac.h>
+#include <armv7lib/vmsa/tt.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/cpu.h>
+#include <kernel/hok.h>
+#include <kernel/mas.h>
+#include <kernel/mmu.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(hok_dbg, DBG_LEVEL_2);
+
+// the hooks are allocated once and never move while the operating
+// system may be executing their trampolines
+hok_hook_t *hok_hooks;
+
+// the trampolines, the page is mapped executable into the operating
+// system paging system at hok_trampolines_va
+u32_t *hok_trampolines;
+tt_virtual_address_t hok_trampolines_va;
+
+// hooks are handed out round robin, see hok_remove
+size_t hok_next;
+
+result_t hok_init(void) {
+
+	hok_hook_t **hooks;
+	u32_t **trampolines;
+	tt_virtual_address_t *va;
+	tt_virtual_address_t tmp;
+	tt_physical_address_t pa;
+	size_t i;
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	CHECK(HOK_TRAMPOLINES_SIZE <= FOUR_KILOBYTES, "the trampolines do not fit in a page", HOK_TRAMPOLINES_SIZE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	hooks = gen_add_base(&hok_hooks);
+	trampolines = gen_add_base(&hok_trampolines);
+	va = gen_add_base(&hok_trampolines_va);
+
+	*hooks = malloc(HOK_HOOKS_SIZE * sizeof(hok_hook_t));
+
+	CHECK_NOT_NULL(*hooks, "unable to allocate memory for the hooks", FAILURE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(*hooks, 0, (HOK_HOOKS_SIZE * sizeof(hok_hook_t)));
+
+	*trampolines = memalign(FOUR_KILOBYTES, FOUR_KILOBYTES);
+
+	CHECK_NOT_NULL(*trampolines, "unable to allocate memory for the trampolines", FAILURE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(*trampolines, 0, FOUR_KILOBYTES);
+
+	tmp.all = (size_t)(*trampolines);
+
+	CHECK_SUCCESS(mmu_lookup_pa(tmp, &pa), "unable to lookup the pa of the trampolines", *trampolines, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// the operating system owns everything below 3 GB
+	va->all = ((u32_t)ONE_GIGABYTE * 3);
+
+	// the hooked functions branch to the trampolines in whatever
+	// privileged mode they run in, so the page is executable and not
+	// accessible from user mode
+	CHECK_SUCCESS(mmu_map(pa, FOUR_KILOBYTES, MMU_MAP_EXTERNAL | MMU_MAP_NORMAL_MEMORY | MMU_MAP_PRIVILEGED, va), "unable to map the trampolines", pa.all, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	for(i = 0; i < HOK_HOOKS_SIZE; i++) {
+		(*hooks)[i].trampoline = &((*trampolines)[i * HOK_TRAMPOLINE_SIZE]);
+		(*hooks)[i].trampoline_address = va->all + (i * HOK_TRAMPOLINE_SIZE * sizeof(u32_t));
+	}
+
+	*(size_t *)gen_add_base(&hok_next) = 0;
+
+	return SUCCESS;
+}
+
+result_t hok_fini(void) {
+
+	hok_hook_t **hooks;
+	size_t i;
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	hooks = gen_add_base(&hok_hooks);
+
+	for(i = 0; i < HOK_HOOKS_SIZE; i++) {
+
+		if((*hooks)[i].used == TRUE) {
+
+			CHECK_SUCCESS(hok_remove((*hooks)[i].address), "unable to remove the hook", (*hooks)[i].address, hok_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+		}
+	}
+
+	CHECK_SUCCESS(mmu_unmap(*(tt_virtual_address_t *)gen_add_base(&hok_trampolines_va), FOUR_KILOBYTES, MMU_MAP_EXTERNAL), "unable to unmap the trampolines", FAILURE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	free(*(u32_t **)gen_add_base(&hok_trampolines));
+	*(u32_t **)gen_add_base(&hok_trampolines) = NULL;
+
+	free(*hooks);
+	*hooks = NULL;
+
+	return SUCCESS;
+}
+
+// the function is patched with a single branch so the patch is one word
+// write that a cpu executing the function sees either before or after.
+// a hook whose trampoline is out of branch range is refused, the two word
+// form would have to stop the other cpus. only arm state functions can
+// be hooked
+result_t hok_add(size_t address, hok_function_t function, void *data) {
+
+	hok_hook_t *hooks;
+	hok_hook_t *hook;
+	tt_virtual_address_t va;
+	size_t instruction;
+	size_t patch;
+	size_t offset;
+	size_t *next;
+	size_t index;
+	size_t i;
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	CHECK_EQUAL((address & (sizeof(u32_t) - 1)), 0, "address is not word aligned", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_NOT_NULL(function, "function is null", function, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_FAILURE(hok_find(address, &hook), "address is already hooked", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// the address is an operating system address, it is looked at
+	// through its paging system
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_EQUAL((cpu_translate_address(address) & CPU_PAR_FAULT), 0, "address is not mapped", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// kernel code is only accessible from the privileged modes
+	CHECK_NOT_EQUAL((cpu_translate_user_address(address) & CPU_PAR_FAULT), 0, "address is accessible from user mode", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_probe_read(address, &instruction), "unable to read the instruction", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_TRUE(vec_instruction_is_relocatable(instruction), "instruction is not relocatable", instruction, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	hooks = *(hok_hook_t **)gen_add_base(&hok_hooks);
+	next = gen_add_base(&hok_next);
+
+	hook = NULL;
+
+	for(i = 0; i < HOK_HOOKS_SIZE; i++) {
+
+		index = (*next + i) % HOK_HOOKS_SIZE;
+
+		if(hooks[index].used == FALSE) {
+			hook = &(hooks[index]);
+			break;
+		}
+	}
+
+	CHECK_NOT_NULL(hook, "no free hooks", HOK_HOOKS_SIZE, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	offset = hook->trampoline_address - (address + VEC_PREFETCH_OPERATION_ADJUSTMENT);
+
+	CHECK((offset + HOK_BRANCH_RANGE) < (2 * HOK_BRANCH_RANGE), "the trampoline is out of branch range", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	patch = HOK_BRANCH_INSTRUCTION | ((offset >> 2) & VEC_ARM_BRANCH_OFFSET_MASK);
+
+	memcpy(hook->trampoline, gen_add_base(&hok_trampoline), (HOK_TRAMPOLINE_SIZE * sizeof(u32_t)));
+
+	hook->prologue = instruction;
+
+	hook->trampoline[HOK_TRAMPOLINE_PROLOGUE_INDEX] = instruction;
+	hook->trampoline[HOK_TRAMPOLINE_HOOK_INDEX] = (size_t)hook;
+	hook->trampoline[HOK_TRAMPOLINE_DISPATCH_INDEX] = (size_t)gen_add_base(&hok_dispatch);
+	hook->trampoline[HOK_TRAMPOLINE_RETURN_INDEX] = address + sizeof(u32_t);
+
+	hook->address = address;
+	hook->function = function;
+	hook->data = data;
+
+	memset(hook->statistics, 0, sizeof(hook->statistics));
+
+	// the operating system fetches the trampoline through its own mapping
+	cac_flush_cache_region(hook->trampoline, (HOK_TRAMPOLINE_SIZE * sizeof(u32_t)));
+	cac_flush_cache_region((void *)(hook->trampoline_address), (HOK_TRAMPOLINE_SIZE * sizeof(u32_t)));
+
+	va.all = address;
+
+	CHECK_SUCCESS(mmu_write_external(va, &patch, sizeof(u32_t)), "unable to patch the function", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	hook->used = TRUE;
+
+	*next = index + 1;
+
+	return SUCCESS;
+}
+
+result_t hok_remove(size_t address) {
+
+	hok_hook_t *hook;
+	tt_virtual_address_t va;
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(hok_find(address, &hook), "address is not hooked", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	va.all = address;
+
+	CHECK_SUCCESS(mmu_write_external(va, &(hook->prologue), sizeof(u32_t)), "unable to restore the function", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// a cpu may still be in the trampoline, hok_add hands the
+	// hooks out round robin so it is not reused straight away
+	hook->used = FALSE;
+
+	return SUCCESS;
+}
+
+result_t hok_find(size_t address, hok_hook_t **hook) {
+
+	hok_hook_t *hooks;
+	size_t i;
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	hooks = *(hok_hook_t **)gen_add_base(&hok_hooks);
+
+	for(i = 0; i < HOK_HOOKS_SIZE; i++) {
+
+		if((hooks[i].used == TRUE) && (hooks[i].address == address)) {
+			*hook = &(hooks[i]);
+			return SUCCESS;
+		}
+	}
+
+	return FAILURE;
+}
+
+result_t hok_get_statistics(size_t address, size_t cpu, cpu_statistics_t *statistics) {
+
+	hok_hook_t *hook;
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(hok_find(address, &hook), "address is not hooked", address, hok_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(statistics, &(hook->statistics[cpu]), sizeof(cpu_statistics_t));
+
+	return SUCCESS;
+}
+
+// called from the trampolines in the operating system context, there
+// is no exception involved so this must not log or switch paging systems.
+// the hooked function can run on every cpu at once, each one only updates
+// its own statistics. interrupts are masked for the update so the caller
+// can neither move to another cpu nor be interrupted by another call of
+// the hooked function in the middle of it
+void hok_dispatch(hok_hook_t *hook, hok_registers_t *registers) {
+
+	gen_program_status_register_t cpsr;
+	size_t cycles;
+	size_t start;
+
+	start = cpu_get_cycle_count();
+
+	hook->function(hook, registers);
+
+	cycles = cpu_get_cycle_count() - start;
+
+	cpsr = gen_get_cpsr();
+
+	int_disable_irq();
+	int_disable_fiq();
+
+	cpu_update_statistics(&(hook->statistics[cpu_get_id()]), cycles);
+
+	if(cpsr.fields.f == FALSE) {
+		int_enable_fiq();
+	}
+
+	if(cpsr.fields.i == FALSE) {
+		int_enable_irq();
+	}
+}
+
+result_t hok_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(hok_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t hok_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(hok_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(hok_dbg, level);
+
+	return SUCCESS;
+}
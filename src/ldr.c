@@ -35,6 +35,7 @@
 #include <stdlib/check.h>
 #include <stdlib/string.h>
 
+#include <kernel/asy.h>
 #include <kernel/call.h>
 #include <kernel/mas.h>
 #include <kernel/mmu.h>
@@ -46,22 +47,189 @@ DBG_DEFINE_VARIABLE(ldr_dbg, DBG_LEVEL_2);
 ldr_module_t *ldr_modules = NULL;
 ldr_function_t *ldr_functions = NULL;
 
+// the sub-functions of LDR_CALL_IDENTIFIER indexed by r2
+call_function_t ldr_call_functions[LDR_NUMBER_OF_FUNCTIONS];
+
 result_t ldr_init(void) {
 
+	call_function_t *functions;
+
 	DBG_LOG_FUNCTION(ldr_dbg, DBG_LEVEL_3);
 
-	CHECK_SUCCESS(call_register_handler(LDR_CALL_IDENTIFIER, gen_add_base(&ldr_call_handler), NULL), "unable to register the call handler", FAILURE, ldr_dbg, DBG_LEVEL_2)
+	functions = gen_add_base(&ldr_call_functions);
+
+	functions[LDR_ADD_MODULE] = gen_add_base(&ldr_call_add_module_handler);
+	functions[LDR_REMOVE_MODULE] = gen_add_base(&ldr_call_remove_module_handler);
+	functions[LDR_COPY_MODULE_HEADER] = gen_add_base(&ldr_call_copy_module_header_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(LDR_CALL_IDENTIFIER, functions, LDR_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, ldr_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// an asynchronous LDR_ADD_MODULE copies, resolves and initializes the
+	// module at separate exception entries instead of in one go
+	CHECK_SUCCESS(asy_register_slices(LDR_CALL_IDENTIFIER, LDR_ADD_MODULE, gen_add_base(&ldr_slice_add_module)), "unable to register the add module slices", FAILURE, ldr_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
 	return SUCCESS;
 }
 
-result_t ldr_call_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+// the arguments are the registers of LDR_ADD_MODULE starting at r3, the
+// pointers are read at a later exception entry and have to stay valid
+// whatever process is running by then
+result_t ldr_slice_add_module(call_descriptor_t *descriptor, size_t slice, void **context, gen_general_purpose_registers_t *registers, bool_t *done) {
+
+	ldr_add_context_t *tmp;
+	u8_t **argv;
+	size_t size;
+	size_t i;
+
+	DBG_LOG_FUNCTION(ldr_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(registers);
+
+	tmp = *context;
+
+	if(slice == ASY_SLICE_CANCEL) {
+		ldr_free_add_context(tmp);
+		*context = NULL;
+		return SUCCESS;
+	}
+
+	if(slice == LDR_SLICE_COPY) {
+
+		CHECK_NOT_NULL(descriptor->arguments[0], "the module is null", descriptor->arguments[0], ldr_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		CHECK(descriptor->arguments[2] != 0, "argc equals 0", descriptor->arguments[2], ldr_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		tmp = malloc(sizeof(ldr_add_context_t));
+
+		CHECK_NOT_NULL(tmp, "unable to allocate memory for the context", tmp, ldr_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(tmp, 0, sizeof(ldr_add_context_t));
+
+		*context = tmp;
+
+		tmp->size = descriptor->arguments[1];
+		tmp->buffer = malloc(tmp->size);
+		tmp->argv = malloc(descriptor->arguments[2] * sizeof(u8_t *));
+
+		CHECK((tmp->buffer != NULL) && (tmp->argv != NULL), "unable to allocate memory for the module", tmp->size, ldr_dbg, DBG_LEVEL_2)
+			ldr_free_add_context(tmp);
+			*context = NULL;
+			return FAILURE;
+		CHECK_END
+
+		argv = (u8_t **)(descriptor->arguments[3]);
+
+		for(i = 0; i < descriptor->arguments[2]; i++) {
+
+			tmp->argv[i] = malloc(strlen((char *)(argv[i])) + 1);
+
+			CHECK_NOT_NULL(tmp->argv[i], "unable to allocate memory for the argument", i, ldr_dbg, DBG_LEVEL_2)
+				ldr_free_add_context(tmp);
+				*context = NULL;
+				return FAILURE;
+			CHECK_END
+
+			memset(tmp->argv[i], 0, strlen((char *)(argv[i])) + 1);
+			memcpy(tmp->argv[i], argv[i], strlen((char *)(argv[i])));
+
+			tmp->argc++;
+		}
+
+		return SUCCESS;
+	}
+
+	// one chunk of the module per slice so a large module does not
+	// hold up the other deferred work on the cpu
+	if(tmp->copied < tmp->size) {
+
+		size = tmp->size - tmp->copied;
+
+		if(size > LDR_SLICE_COPY_SIZE) {
+			size = LDR_SLICE_COPY_SIZE;
+		}
+
+		memcpy(((u8_t *)(tmp->buffer) + tmp->copied), (u8_t *)(descriptor->arguments[0]) + tmp->copied, size);
+
+		tmp->copied += size;
+
+		return SUCCESS;
+	}
+
+	if(tmp->added == FALSE) {
+
+		CHECK_SUCCESS(ldr_add_module(tmp->buffer), "failed to add module", tmp->buffer, ldr_dbg, DBG_LEVEL_2)
+			ldr_free_add_context(tmp);
+			*context = NULL;
+			return FAILURE;
+		CHECK_END
+
+		tmp->added = TRUE;
+
+		return SUCCESS;
+	}
+
+	// the last slice, the module stays loaded even when its init fails
+	// the same as it does for the synchronous hypercall
+	cac_flush_cache_region(tmp->buffer, tmp->size);
+
+	descriptor->results[0] = ldr_init_module(tmp->buffer, tmp->argc, tmp->argv);
+
+	tmp->buffer = NULL;
+	ldr_free_add_context(tmp);
+	*context = NULL;
+
+	*done = TRUE;
+
+	return SUCCESS;
+}
+
+// a module that was already added is removed again, removing it frees
+// its buffer
+void ldr_free_add_context(ldr_add_context_t *context) {
 
-	ldr_module_t **head;
 	ldr_module_t *module;
-	mod_header_t *hdr;
+	size_t i;
+
+	DBG_LOG_FUNCTION(ldr_dbg, DBG_LEVEL_3);
+
+	if(context == NULL) {
+		return;
+	}
+
+	if(context->buffer != NULL) {
+
+		if((context->added == TRUE) && (ldr_lookup_module(((mod_header_t *)(context->buffer))->string, &module) == SUCCESS)) {
+			ldr_remove_module(module);
+		}
+		else {
+			free(context->buffer);
+		}
+	}
+
+	if(context->argv != NULL) {
+
+		for(i = 0; i < context->argc; i++) {
+			free(context->argv[i]);
+		}
+
+		free(context->argv);
+	}
+
+	free(context);
+}
+
+result_t ldr_call_add_module_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
 	void *buffer = NULL;
 	u8_t **argv;
 	size_t argc = 0;
@@ -69,6 +237,7 @@ result_t ldr_call_handler(call_handler_t *handler, void *data, gen_general_purpo
 	size_t i;
 
 	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
 
 	DBG_LOG_FUNCTION(ldr_dbg, DBG_LEVEL_3);
 
@@ -79,177 +248,195 @@ result_t ldr_call_handler(call_handler_t *handler, void *data, gen_general_purpo
 	// TODO: maybe we should just use registers to pass things or physical addresses
 	// registers would eliminate the need to sync memory between the microvisor and OS
 
-	if(registers->r2 == LDR_ADD_MODULE) {
+	CHECK_NOT_NULL(registers->r3, "registers->r3 is null", registers->r3, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-		CHECK_NOT_NULL(registers->r3, "registers->r3 is null", registers->r3, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	size = registers->r4;
 
-		size = registers->r4;
+	buffer = malloc(size);
 
-		buffer = malloc(size);
+	CHECK_NOT_NULL(buffer, "buffer is null", size, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-		CHECK_NOT_NULL(buffer, "buffer is null", size, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	memcpy(buffer, (void *)(registers->r3), size);
 
-		memcpy(buffer, (void *)(registers->r3), size);
+	argc = registers->r5;
 
-		argc = registers->r5;
+	CHECK(argc != 0, "argc equals 0", argc, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-		CHECK(argc != 0, "argc equals 0", argc, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	argv = malloc(argc * sizeof(u8_t *));
 
-		argv = malloc(argc * sizeof(u8_t *));
+	CHECK_NOT_NULL(argv, "argv is null", argv, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-		CHECK_NOT_NULL(argv, "argv is null", argv, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	for(i = 0; i < argc; i++) {
+		argv[i] = malloc(strlen((char *)(((u8_t **)registers->r6)[i])) + 1);
+		memset(argv[i], 0, strlen((char *)(((u8_t **)registers->r6)[i])) + 1);
+		memcpy(argv[i], ((u8_t **)(registers->r6))[i], strlen((char *)(((u8_t **)registers->r6)[i])));
+		DBG_LOG_STATEMENT(gen_subtract_base(argv[i]), 0, ldr_dbg, DBG_LEVEL_3);
+	}
 
+	CHECK_SUCCESS(ldr_add_module(buffer), "failed to add module", buffer, ldr_dbg, DBG_LEVEL_2)
 		for(i = 0; i < argc; i++) {
-			argv[i] = malloc(strlen((char *)(((u8_t **)registers->r6)[i])) + 1);
-			memset(argv[i], 0, strlen((char *)(((u8_t **)registers->r6)[i])) + 1);
-			memcpy(argv[i], ((u8_t **)(registers->r6))[i], strlen((char *)(((u8_t **)registers->r6)[i])));
-			DBG_LOG_STATEMENT(gen_subtract_base(argv[i]), 0, ldr_dbg, DBG_LEVEL_3);
+			free(argv[i]);
 		}
 
-		CHECK_SUCCESS(ldr_add_module(buffer), "failed to add module", buffer, ldr_dbg, DBG_LEVEL_2)
-			for(i = 0; i < argc; i++) {
-				free(argv[i]);
-			}
-
-			free(argv);
-
-			registers->r0 = FAILURE;
-
-			return SUCCESS;
-		CHECK_END
-
-		cac_flush_cache_region(buffer, size);
-
-		CHECK_SUCCESS(ldr_init_module(buffer, argc, argv), "failed to initialize the module", buffer, ldr_dbg, DBG_LEVEL_2)
-			for(i = 0; i < argc; i++) {
-				free(argv[i]);
-			}
+		free(argv);
 
-			free(argv);
+		registers->r0 = FAILURE;
 
-			registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-			return SUCCESS;
-		CHECK_END
+	cac_flush_cache_region(buffer, size);
 
+	CHECK_SUCCESS(ldr_init_module(buffer, argc, argv), "failed to initialize the module", buffer, ldr_dbg, DBG_LEVEL_2)
 		for(i = 0; i < argc; i++) {
 			free(argv[i]);
 		}
 
 		free(argv);
 
-		registers->r0 = SUCCESS;
+		registers->r0 = FAILURE;
+
+		return SUCCESS;
+	CHECK_END
+
+	for(i = 0; i < argc; i++) {
+		free(argv[i]);
 	}
-	else if(registers->r2 == LDR_REMOVE_MODULE) {
 
-		CHECK_SUCCESS(ldr_lookup_module((u8_t *)(registers->r3), &module), "failed to lookup the module", FAILURE, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	free(argv);
 
-		argc = registers->r4;
+	registers->r0 = SUCCESS;
 
-		CHECK(argc != 0, "argc equals 0", argc, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	return SUCCESS;
+}
 
-		argv = malloc(argc * sizeof(u8_t *));
+result_t ldr_call_remove_module_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
 
-		CHECK_NOT_NULL(argv, "argv is null", argv, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	ldr_module_t *module;
+	u8_t **argv;
+	size_t argc = 0;
+	size_t i;
 
-		for(i = 0; i < argc; i++) {
-			argv[i] = malloc(strlen((char *)(((u8_t **)registers->r5)[i])) + 1);
-			memset(argv[i], 0, strlen((char *)(((u8_t **)registers->r5)[i])) + 1);
-			memcpy(argv[i], ((u8_t **)(registers->r5))[i], strlen((char *)(((u8_t **)registers->r5)[i])));
-			DBG_LOG_STATEMENT(gen_subtract_base(argv[i]), 0, ldr_dbg, DBG_LEVEL_3);
-		}
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
 
-		CHECK_SUCCESS(ldr_fini_module(module, argc, argv), "failed to finish the module", module, ldr_dbg, DBG_LEVEL_2)
-			for(i = 0; i < argc; i++) {
-				free(argv[i]);
-			}
+	DBG_LOG_FUNCTION(ldr_dbg, DBG_LEVEL_3);
 
-			free(argv);
+	CHECK_SUCCESS(ldr_lookup_module((u8_t *)(registers->r3), &module), "failed to lookup the module", FAILURE, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-			registers->r0 = FAILURE;
+	argc = registers->r4;
 
-			return SUCCESS;
-		CHECK_END
+	CHECK(argc != 0, "argc equals 0", argc, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-		CHECK_SUCCESS(ldr_remove_module(module), "failed to remove the module", module, ldr_dbg, DBG_LEVEL_2)
-			for(i = 0; i < argc; i++) {
-				free(argv[i]);
-			}
+	argv = malloc(argc * sizeof(u8_t *));
 
-			free(argv);
+	CHECK_NOT_NULL(argv, "argv is null", argv, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-			registers->r0 = FAILURE;
+	for(i = 0; i < argc; i++) {
+		argv[i] = malloc(strlen((char *)(((u8_t **)registers->r5)[i])) + 1);
+		memset(argv[i], 0, strlen((char *)(((u8_t **)registers->r5)[i])) + 1);
+		memcpy(argv[i], ((u8_t **)(registers->r5))[i], strlen((char *)(((u8_t **)registers->r5)[i])));
+		DBG_LOG_STATEMENT(gen_subtract_base(argv[i]), 0, ldr_dbg, DBG_LEVEL_3);
+	}
 
-			return SUCCESS;
-		CHECK_END
+	CHECK_SUCCESS(ldr_fini_module(module, argc, argv), "failed to finish the module", module, ldr_dbg, DBG_LEVEL_2)
+		for(i = 0; i < argc; i++) {
+			free(argv[i]);
+		}
+
+		free(argv);
+
+		registers->r0 = FAILURE;
+
+		return SUCCESS;
+	CHECK_END
 
+	CHECK_SUCCESS(ldr_remove_module(module), "failed to remove the module", module, ldr_dbg, DBG_LEVEL_2)
 		for(i = 0; i < argc; i++) {
 			free(argv[i]);
 		}
 
 		free(argv);
 
-		registers->r0 = SUCCESS;
+		registers->r0 = FAILURE;
+
+		return SUCCESS;
+	CHECK_END
+
+	for(i = 0; i < argc; i++) {
+		free(argv[i]);
 	}
-	else if(registers->r2 == LDR_COPY_MODULE_HEADER) {
 
-		head = gen_add_base(&ldr_modules);
+	free(argv);
 
-		CHECK_NOT_NULL(head, "head is null", head, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	registers->r0 = SUCCESS;
 
-		CHECK_NOT_NULL(registers->r4, "registers->r4 is null", registers->r4, ldr_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	return SUCCESS;
+}
 
-		module = *head;
+result_t ldr_call_copy_module_header_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
 
+	ldr_module_t **head;
+	ldr_module_t *module;
+	mod_header_t *hdr;
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	DBG_LOG_FUNCTION(ldr_dbg, DBG_LEVEL_3);
+
+	head = gen_add_base(&ldr_modules);
+
+	CHECK_NOT_NULL(head, "head is null", head, ldr_dbg, DBG_LEVEL_2)
 		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
 
-		while(module != NULL) {
-			if(registers->r3 == 0) {
-				hdr = (mod_header_t *)(module->pointer);
-
-				CHECK(registers->r5 >= (sizeof(mod_header_t) + strlen((char *)(hdr->string))), "not enough space", sizeof(mod_header_t) + strlen((char *)(hdr->string)), ldr_dbg, DBG_LEVEL_2)
-					registers->r0 = FAILURE;
-					return SUCCESS;
-				CHECK_END
-
-				memcpy((void *)(registers->r4), hdr, sizeof(mod_header_t) + strlen((char *)(hdr->string)));
-				registers->r0 = SUCCESS;
-				break;
-			}
-			(registers->r3)--;
-			module = module->next;
+	CHECK_NOT_NULL(registers->r4, "registers->r4 is null", registers->r4, ldr_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	module = *head;
+
+	registers->r0 = FAILURE;
+
+	while(module != NULL) {
+		if(registers->r3 == 0) {
+			hdr = (mod_header_t *)(module->pointer);
+
+			CHECK(registers->r5 >= (sizeof(mod_header_t) + strlen((char *)(hdr->string))), "not enough space", sizeof(mod_header_t) + strlen((char *)(hdr->string)), ldr_dbg, DBG_LEVEL_2)
+				registers->r0 = FAILURE;
+				return SUCCESS;
+			CHECK_END
+
+			memcpy((void *)(registers->r4), hdr, sizeof(mod_header_t) + strlen((char *)(hdr->string)));
+			registers->r0 = SUCCESS;
+			break;
 		}
-	}
-	else {
-		DBG_LOG_STATEMENT("register->r2 option is unknown", registers->r2, ldr_dbg, DBG_LEVEL_2);
-		return FAILURE;
+		(registers->r3)--;
+		module = module->next;
 	}
 
 	return SUCCESS;
@@ -8,17 +8,34 @@
 #include <stdlib/stdarg.h>
 #include <stdlib/string.h>
 
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
 #include <kernel/log.h>
 #include <kernel/mas.h>
+#include <kernel/utx.h>
 #include <kernel/vec.h>
 
 DBG_DEFINE_VARIABLE(log_dbg, DBG_LEVEL_2);
 
+// the functions that write, archive and read the records do not log
+// since the log would end up calling itself, neither does the leaf
+
 log_state_t *ls = NULL;
 
+// one ring per cpu written from any exception on that cpu, there is no lock
+log_ring_t log_rings[CPU_NUMBER_OF_CPUS];
+
+// the older records of each ring, compressed
+log_archive_t log_archives[CPU_NUMBER_OF_CPUS];
+
+// the sub-functions of LOG_CALL_IDENTIFIER indexed by r2
+call_function_t log_call_functions[LOG_NUMBER_OF_FUNCTIONS];
+
 result_t log_init(void) {
 
 	log_state_t *state;
+	call_function_t *functions;
+	size_t i;
 
 	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
@@ -30,13 +47,34 @@ result_t log_init(void) {
 
 	memset(state, 0, sizeof(log_state_t));
 
-	CHECK_SUCCESS(call_register_handler(LOG_CALL_IDENTIFIER, gen_add_base(&log_call_handler), state), "unable to register the call handler", FAILURE, log_dbg, DBG_LEVEL_2)
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+		state->caches[i].scratch = state->scratch;
+	}
+
+	functions = gen_add_base(&log_call_functions);
+
+	functions[LOG_FUNCTION_INIT] = gen_add_base(&log_call_init_function);
+	functions[LOG_FUNCTION_BUFFER_SIZE] = gen_add_base(&log_call_buffer_size_function);
+	functions[LOG_FUNCTION_BUFFER_VALUE] = gen_add_base(&log_call_buffer_value_function);
+	functions[LOG_FUNCTION_FINI] = gen_add_base(&log_call_fini_function);
+	functions[LOG_FUNCTION_BUFFER_COPY] = gen_add_base(&log_call_buffer_copy_handler);
+	functions[LOG_FUNCTION_RING_READ] = gen_add_base(&log_call_ring_read_handler);
+	functions[LOG_FUNCTION_ARCHIVE] = gen_add_base(&log_call_archive_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(LOG_CALL_IDENTIFIER, functions, LOG_NUMBER_OF_FUNCTIONS, state), "unable to register the call handler", FAILURE, log_dbg, DBG_LEVEL_2)
 		free(state);
 		return FAILURE;
 	CHECK_END
 
 	*((log_state_t **)gen_add_base(&ls)) = state;
 
+	CHECK_SUCCESS(call_register_leaf(LOG_LEAF_BUFFER_SIZE, gen_add_base(&log_leaf_buffer_size)), "unable to register the buffer size leaf", FAILURE, log_dbg, DBG_LEVEL_2)
+		call_unregister_handler_table(LOG_CALL_IDENTIFIER, gen_add_base(&log_call_functions));
+		*((log_state_t **)gen_add_base(&ls)) = NULL;
+		vec_retire(state);
+		return FAILURE;
+	CHECK_END
+
 	return SUCCESS;
 }
 
@@ -46,105 +84,140 @@ result_t log_fini(void) {
 
 	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
+	// the leaf and the handlers read the state so they go first
+	call_unregister_leaf(LOG_LEAF_BUFFER_SIZE, gen_add_base(&log_leaf_buffer_size));
+
+	CHECK_SUCCESS(call_unregister_handler_table(LOG_CALL_IDENTIFIER, gen_add_base(&log_call_functions)), "unable to unregister the call handler", FAILURE, log_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	state = *(log_state_t **)gen_add_base(&ls);
 
+	*((log_state_t **)gen_add_base(&ls)) = NULL;
+
+	// a hypercall on another cpu may still be using it
 	if(state != NULL) {
-		free(state);
+		vec_retire(state);
 	}
 
-	CHECK_SUCCESS(call_unregister_handler(LOG_CALL_IDENTIFIER, gen_add_base(&log_call_handler)), "unable to unregister the call handler", FAILURE, log_dbg, DBG_LEVEL_2)
-		return FAILURE;
-	CHECK_END
-
 	return SUCCESS;
 }
 
-result_t log_call_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+result_t log_call_init_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
 
-	u32_t identifier;
+	log_state_t *state;
+	log_record_t record;
+	log_line_t line;
+	log_archive_cache_t *caches;
+	size_t sequences[CPU_NUMBER_OF_CPUS];
 
 	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
-	identifier = (u32_t)(registers->r2);
+	UNUSED_VARIABLE(handler);
 
-	DBG_LOG_STATEMENT("identifier", identifier, log_dbg, DBG_LEVEL_3);
+	state = (log_state_t *)data;
 
-	if(identifier == LOG_FUNCTION_INIT) {
-		CHECK_SUCCESS(log_call_init_handler((log_state_t *)data), "call init function handler failure", identifier, log_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
-	}
-	else if(identifier == LOG_FUNCTION_BUFFER_SIZE) {
-		CHECK_SUCCESS(log_call_buffer_size_handler((log_state_t *)data, registers), "buffer size function handler failure", identifier, log_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
-	}
-	else if(identifier == LOG_FUNCTION_BUFFER_VALUE) {
-		CHECK_SUCCESS(log_call_buffer_value_handler((log_state_t *)data, registers), "buffer value function handler failure", identifier, log_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
-	}
-	else if(identifier == LOG_FUNCTION_FINI) {
-		CHECK_SUCCESS(log_call_fini_handler((log_state_t *)data), "call fini function handler failure", identifier, log_dbg, DBG_LEVEL_2)
-			registers->r0 = FAILURE;
-			return SUCCESS;
-		CHECK_END
+	if(state->buffer != NULL) {
+		free(state->buffer);
 	}
-	else {
-		DBG_LOG_STATEMENT("unhandled log function", identifier, log_dbg, DBG_LEVEL_3);
+
+	// the sequences and the caches outlive the buffer
+	state->buffer = NULL;
+	state->size = 0;
+	state->index = 0;
+
+	memcpy(sequences, state->sequences, sizeof(sequences));
+	memcpy(state->next, sequences, sizeof(sequences));
+
+	state->buffer = malloc(LOG_SNAPSHOT_SIZE);
+
+	CHECK_NOT_NULL(state->buffer, "unable to allocate memory for the buffer", state->buffer, log_dbg, DBG_LEVEL_2)
 		registers->r0 = FAILURE;
 		return SUCCESS;
-	}
+	CHECK_END
 
-	registers->r0 = SUCCESS;
-	return SUCCESS;
-}
+	memset(&line, 0, sizeof(log_line_t));
 
-result_t log_call_init_handler(log_state_t *state) {
+	line.destination = state->buffer;
+	line.available = LOG_SNAPSHOT_SIZE;
 
-	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+	// another readout is using the caches, the archives are left out
+	caches = (cpu_atomic_compare_and_swap(&(state->reading), FALSE, TRUE) == FALSE) ? state->caches : NULL;
 
-	if(state->buffer != NULL) {
-		free(state->buffer);
-	}
+	// the records that have not been consumed by LOG_FUNCTION_FINI in
+	// timestamp order, the rings keep on being written so the buffer
+	// bounds how many are taken
+	while(line.available >= (LOG_SNAPSHOT_RECORD_SIZE + line.size)) {
 
-	memset(state, 0, sizeof(log_state_t));
+		if(log_ring_merge(&record, 1, sequences, caches) == 0) {
+			break;
+		}
 
-	mem_get_buffer_size(&(state->size));
+		log_format_record(&line, &record);
+	}
+
+	if(caches != NULL) {
+		cpu_data_memory_barrier();
+		state->reading = FALSE;
+	}
 
-	state->buffer = malloc(state->size);
+	log_line_flush(&line);
 
-	mem_get_buffer(state->buffer);
+	state->size = LOG_SNAPSHOT_SIZE - line.available;
+	memcpy(state->next, sequences, sizeof(sequences));
 
+	registers->r0 = SUCCESS;
 	return SUCCESS;
 }
 
-result_t log_call_buffer_size_handler(log_state_t *state, gen_general_purpose_registers_t *registers) {
+result_t log_call_buffer_size_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	log_state_t *state;
 
 	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
+	UNUSED_VARIABLE(handler);
+
+	state = (log_state_t *)data;
+
 	CHECK_NOT_NULL(state, "unable to allocate memory for the state", state, log_dbg, DBG_LEVEL_2)
-		return FAILURE;
+		registers->r0 = FAILURE;
+		return SUCCESS;
 	CHECK_END
 
 	registers->r1 = (u32_t)(state->size);
 
+	registers->r0 = SUCCESS;
 	return SUCCESS;
 }
 
-result_t log_call_buffer_value_handler(log_state_t *state, gen_general_purpose_registers_t *registers) {
+// the same as log_call_buffer_size_function without leaving the und stub
+size_t log_leaf_buffer_size(size_t function, size_t argument) {
+
+	UNUSED_VARIABLE(function);
+	UNUSED_VARIABLE(argument);
+
+	return (*(log_state_t **)gen_add_base(&ls))->size;
+}
+
+result_t log_call_buffer_value_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	log_state_t *state;
 
 	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
+	UNUSED_VARIABLE(handler);
+
+	state = (log_state_t *)data;
+
 	CHECK_NOT_NULL(state, "unable to allocate memory for the state", state, log_dbg, DBG_LEVEL_2)
-		return FAILURE;
+		registers->r0 = FAILURE;
+		return SUCCESS;
 	CHECK_END
 
 	if(state->index >= state->size) {
-		return FAILURE;
+		registers->r0 = FAILURE;
+		return SUCCESS;
 	}
 
 	if((state->size - state->index) < sizeof(u32_t)) {
@@ -156,163 +229,1381 @@ result_t log_call_buffer_value_handler(log_state_t *state, gen_general_purpose_r
 		state->index += sizeof(u32_t);
 	}
 
+	registers->r0 = SUCCESS;
 	return SUCCESS;
 }
 
-result_t log_call_fini_handler(log_state_t *state) {
+// copies a range of the buffer taken by LOG_FUNCTION_INIT into the
+// operating system in one call, the range is cut at the end of the
+// buffer. it does not move the index used by LOG_FUNCTION_BUFFER_VALUE
+result_t log_call_buffer_copy_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	log_state_t *state;
+	u8_t *destination;
+	size_t offset;
+	size_t size;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+
+	state = (log_state_t *)data;
+	destination = (u8_t *)(registers->r3);
+	offset = registers->r4;
+	size = registers->r5;
+
+	registers->r1 = 0;
+
+	CHECK_NOT_NULL(state, "unable to allocate memory for the state", state, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	CHECK_NOT_NULL(state->buffer, "the buffer has not been taken", FAILURE, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	CHECK_NOT_NULL(destination, "destination is null", destination, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	CHECK(offset <= state->size, "offset is past the end of the buffer", offset, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	if(size > (state->size - offset)) {
+		size = state->size - offset;
+	}
+
+	memcpy(destination, &((state->buffer)[offset]), size);
+
+	registers->r1 = size;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t log_call_fini_function(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	log_state_t *state;
 
 	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
+	UNUSED_VARIABLE(handler);
+
+	state = (log_state_t *)data;
+
 	if(state->buffer != NULL) {
 		free(state->buffer);
 	}
 
-	mem_clear();
+	// the buffer is gone, the copy and value handlers must not touch it
+	state->buffer = NULL;
+	state->size = 0;
+	state->index = 0;
+
+	// the records in the buffer are consumed, the rings are not cleared
+	memcpy(state->sequences, state->next, sizeof(state->sequences));
 
+	registers->r0 = SUCCESS;
 	return SUCCESS;
 }
 
-result_t log_putc(u8_t c) {
+// the entry points modules linked against before the functions were
+// registered as a table, they keep their signatures and forward to it
 
-	#ifdef __SERIAL_DEBUG__
-	if(ser_putc(c) == FAILURE) {
-		return FAILURE;
+result_t log_call_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	call_function_t *functions;
+	u32_t identifier;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	identifier = (u32_t)(registers->r2);
+
+	DBG_LOG_STATEMENT("identifier", identifier, log_dbg, DBG_LEVEL_3);
+
+	if(identifier >= LOG_NUMBER_OF_FUNCTIONS) {
+		DBG_LOG_STATEMENT("unhandled log function", identifier, log_dbg, DBG_LEVEL_3);
+		registers->r0 = FAILURE;
+		return SUCCESS;
 	}
-	#endif //__SERIAL_DEBUG__
 
-	#ifdef __MEMORY_DEBUG__
-	if(mem_putc(c) == FAILURE) {
-		return FAILURE;
+	functions = gen_add_base(&log_call_functions);
+
+	return functions[identifier](handler, data, registers);
+}
+
+result_t log_call_init_handler(log_state_t *state) {
+
+	gen_general_purpose_registers_t registers;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	memset(&registers, 0, sizeof(gen_general_purpose_registers_t));
+
+	log_call_init_function(NULL, state, &registers);
+
+	return (result_t)(registers.r0);
+}
+
+result_t log_call_buffer_size_handler(log_state_t *state, gen_general_purpose_registers_t *registers) {
+
+	size_t r0;
+	result_t result;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	// the old handler left r0 to its caller
+	r0 = registers->r0;
+
+	log_call_buffer_size_function(NULL, state, registers);
+
+	result = (result_t)(registers->r0);
+	registers->r0 = r0;
+
+	return result;
+}
+
+result_t log_call_buffer_value_handler(log_state_t *state, gen_general_purpose_registers_t *registers) {
+
+	size_t r0;
+	result_t result;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	r0 = registers->r0;
+
+	log_call_buffer_value_function(NULL, state, registers);
+
+	result = (result_t)(registers->r0);
+	registers->r0 = r0;
+
+	return result;
+}
+
+result_t log_call_fini_handler(log_state_t *state) {
+
+	gen_general_purpose_registers_t registers;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	memset(&registers, 0, sizeof(gen_general_purpose_registers_t));
+
+	log_call_fini_function(NULL, state, &registers);
+
+	return (result_t)(registers.r0);
+}
+
+// the operating system keeps a sequence per ring and gets the records
+// of all of the rings as one stream in timestamp order. records it
+// missed in the rings are taken from the archives, records that are in
+// neither are skipped
+result_t log_call_ring_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	log_state_t *state;
+	log_record_t *records;
+	log_archive_cache_t *caches;
+	size_t *sequences;
+
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+
+	state = (log_state_t *)data;
+	records = (log_record_t *)(registers->r3);
+	sequences = (size_t *)(registers->r4);
+
+	CHECK_NOT_NULL(records, "records is null", records, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	CHECK_NOT_NULL(sequences, "sequences is null", sequences, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	caches = (cpu_atomic_compare_and_swap(&(state->reading), FALSE, TRUE) == FALSE) ? state->caches : NULL;
+
+	registers->r1 = log_ring_merge(records, registers->r5, sequences, caches);
+
+	if(caches != NULL) {
+		cpu_data_memory_barrier();
+		state->reading = FALSE;
 	}
-	#endif //__MEMORY_DEBUG__
 
+	registers->r0 = SUCCESS;
 	return SUCCESS;
 }
 
-result_t log_write(u8_t *buffer, size_t size) {
+// the compression of the archive of a cpu measured on what was logged
+result_t log_call_archive_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
 
-	if(buffer == NULL) {
-		return FAILURE;
-	}
+	log_archive_t *archive;
 
-	#ifdef __SERIAL_DEBUG__
-	if(ser_write(buffer, size) == FAILURE) {
-		return FAILURE;
-	}
-	#endif //__SERIAL_DEBUG__
+	DBG_LOG_FUNCTION(log_dbg, DBG_LEVEL_3);
 
-	#ifdef __MEMORY_DEBUG__
-	if(mem_write(buffer, size) == FAILURE) {
-		return FAILURE;
-	}
-	#endif //__MEMORY_DEBUG__
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK(registers->r3 < CPU_NUMBER_OF_CPUS, "cpu is out of range", registers->r3, log_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	archive = &(((log_archive_t *)gen_add_base(&log_archives))[registers->r3]);
+
+	registers->r1 = archive->raw;
+	registers->r2 = archive->packed;
+	registers->r3 = archive->cycles;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t log_ring_init(void) {
+
+	memset(gen_add_base(&log_rings), 0, sizeof(log_rings));
+	memset(gen_add_base(&log_archives), 0, sizeof(log_archives));
 
 	return SUCCESS;
 }
 
-result_t log_vprintf(const char *fmt, va_list args) {
+// every record claims its slot in the ring of its cpu with a single
+// atomic add, it only races with the exceptions taken on the same cpu.
+// the sequence is cleared while the record is written and set once it
+// is complete so a reader never takes a partial record. a writer that is
+// LOG_RING_RECORDS records behind may still finish on top of a newer
+// record, the reader sees the older sequence and skips it
+log_record_t *log_ring_claim(size_t *sequence) {
 
-	size_t value;
-	u8_t number[8];
+	log_ring_t *ring;
+	log_record_t *record;
 
-	while(*fmt) {
+	ring = &(((log_ring_t *)gen_add_base(&log_rings))[cpu_get_id()]);
 
-		if(*fmt == '%') {
+	*sequence = cpu_atomic_add(&(ring->head), 1);
 
-			fmt++;
+	record = &(ring->records[*sequence & (LOG_RING_RECORDS - 1)]);
 
-			if(*fmt == 's') {
+	record->sequence = 0;
 
-				value = va_arg(args, size_t);
+	cpu_data_memory_barrier();
 
-				if(log_write((u8_t *)value, strlen((const char *)value)) != SUCCESS) {
-					return FAILURE;
-				}
+	record->timestamp_low = cpu_get_timestamp(&(record->timestamp_high));
 
-				fmt++;
-			}
-			else if(*fmt == 'c') {
+	// the last record of a block, the block is complete by the time the
+	// deferred work runs on this cpu. until dfr is up nothing is archived
+	if((*sequence & (LOG_ARCHIVE_BLOCK_RECORDS - 1)) == (LOG_ARCHIVE_BLOCK_RECORDS - 1)) {
+		dfr_enqueue(gen_add_base(&log_archive_block), NULL, (*sequence - (LOG_ARCHIVE_BLOCK_RECORDS - 1)), NULL);
+	}
 
-				value = va_arg(args, u32_t);
+	return record;
+}
 
-				if(log_putc((u8_t)value) != SUCCESS) {
-					return FAILURE;
-				}
+void log_ring_commit(log_record_t *record, size_t sequence) {
 
-				fmt++;
-			}
-			else if(*fmt == 'o') {
+	cpu_data_memory_barrier();
 
-				value = va_arg(args, u32_t);
+	record->sequence = sequence + 1;
+}
 
-				memset(number, 0, sizeof(number));
+void log_ring_write(u8_t *buffer, size_t size) {
 
-				itoa(value, (char *)number, 8);
+	log_record_t *record;
+	size_t sequence;
+	size_t length;
 
-				if(log_write(number, strlen((const char *)number)) != SUCCESS) {
-					return FAILURE;
-				}
+	while(size > 0) {
 
-				fmt++;
-			}
-			else if(*fmt == 'x') {
+		length = (size < LOG_RING_DATA_SIZE) ? size : LOG_RING_DATA_SIZE;
 
-				value = va_arg(args, u32_t);
+		record = log_ring_claim(&sequence);
 
-				memset(number, 0, sizeof(number));
+		record->type = LOG_RECORD_TYPE_TEXT;
+		record->size = length;
+		memcpy(record->data, buffer, length);
 
-				itoa(value, (char *)number, 16);
+		log_ring_commit(record, sequence);
 
-				if(log_write(number, strlen((const char *)number)) != SUCCESS) {
-					return FAILURE;
-				}
+		buffer += length;
+		size -= length;
+	}
+}
 
-				fmt++;
-			}
-			else if(*fmt == 'd') {
+// copies up to count complete records of the ring of cpu starting at
+// *sequence and moves *sequence past them. a record is checked before
+// and after the copy as a writer may claim the slot in between
+size_t log_ring_read(size_t cpu, log_record_t *records, size_t count, size_t *sequence) {
 
-				value = va_arg(args, u32_t);
+	log_ring_t *ring;
+	log_record_t *record;
+	size_t head;
+	size_t tmp;
+	size_t i;
 
-				memset(number, 0, sizeof(number));
+	ring = &(((log_ring_t *)gen_add_base(&log_rings))[cpu]);
 
-				itoa(value, (char *)number, 10);
+	head = ring->head;
 
-				if(log_write(number, strlen((const char *)number)) != SUCCESS) {
-					return FAILURE;
-				}
+	cpu_data_memory_barrier();
 
-				fmt++;
-			}
-			else if(*fmt == 'p') {
+	// the records before the last ring worth have been overwritten
+	if((head - *sequence) > LOG_RING_RECORDS) {
+		*sequence = head - LOG_RING_RECORDS;
+	}
 
-				value = va_arg(args, size_t);
+	i = 0;
 
-				memset(number, 0, sizeof(number));
+	while((i < count) && (*sequence != head)) {
 
-				ltoa(value, (char *)number, 16);
+		record = &(ring->records[*sequence & (LOG_RING_RECORDS - 1)]);
 
-				if(log_write(number, strlen((const char *)number)) != SUCCESS) {
-					return FAILURE;
-				}
+		tmp = record->sequence;
 
-				fmt++;
-			}
+		// still being written or not even started, the slot holds an
+		// older record. nothing after it is taken either
+		if((tmp == 0) || (tmp < (*sequence + 1))) {
+			break;
 		}
 
-		if(*fmt == '\n') {
+		cpu_data_memory_barrier();
 
-			if(log_putc('\r') != SUCCESS) {
-				return FAILURE;
+		if(tmp == (*sequence + 1)) {
+
+			memcpy(&(records[i]), record, sizeof(log_record_t));
+
+			cpu_data_memory_barrier();
+
+			if(record->sequence == tmp) {
+				records[i].sequence = *sequence;
+				records[i].cpu = cpu;
+				i++;
 			}
 		}
 
-		if(log_putc(*fmt) != SUCCESS) {
-			return FAILURE;
+		// the record was overwritten or it was taken, move on either way
+		(*sequence)++;
+	}
+
+	return i;
+}
+
+// a k way merge of the rings. the next record of every ring is read
+// ahead and the earliest one is taken, a ring only moves on when its
+// record is taken so the rest are read again by the next call. a ring
+// that stops at a record still being written does not hold up the others
+size_t log_ring_merge(log_record_t *records, size_t count, size_t *sequences, log_archive_cache_t *caches) {
+
+	log_record_t next[CPU_NUMBER_OF_CPUS];
+	size_t after[CPU_NUMBER_OF_CPUS];
+	bool_t valid[CPU_NUMBER_OF_CPUS];
+	size_t earliest;
+	size_t cpu;
+	size_t i;
+
+	for(cpu = 0; cpu < CPU_NUMBER_OF_CPUS; cpu++) {
+
+		after[cpu] = sequences[cpu];
+
+		valid[cpu] = (log_read_next(cpu, &(next[cpu]), &(after[cpu]), ((caches == NULL) ? NULL : &(caches[cpu]))) == 1) ? TRUE : FALSE;
+
+		// only the records that are gone were skipped
+		if(valid[cpu] == FALSE) {
+			sequences[cpu] = after[cpu];
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+
+		earliest = CPU_NUMBER_OF_CPUS;
+
+		for(cpu = 0; cpu < CPU_NUMBER_OF_CPUS; cpu++) {
+
+			if(valid[cpu] == FALSE) {
+				continue;
+			}
+
+			if((earliest == CPU_NUMBER_OF_CPUS) || (log_record_is_earlier(&(next[cpu]), &(next[earliest])) == TRUE)) {
+				earliest = cpu;
+			}
+		}
+
+		if(earliest == CPU_NUMBER_OF_CPUS) {
+			break;
+		}
+
+		memcpy(&(records[i]), &(next[earliest]), sizeof(log_record_t));
+
+		sequences[earliest] = after[earliest];
+
+		valid[earliest] = (log_read_next(earliest, &(next[earliest]), &(after[earliest]), ((caches == NULL) ? NULL : &(caches[earliest]))) == 1) ? TRUE : FALSE;
+
+		if(valid[earliest] == FALSE) {
+			sequences[earliest] = after[earliest];
+		}
+	}
+
+	return i;
+}
+
+bool_t log_record_is_earlier(log_record_t *a, log_record_t *b) {
+
+	if(a->timestamp_high != b->timestamp_high) {
+		return (a->timestamp_high < b->timestamp_high) ? TRUE : FALSE;
+	}
+
+	return (a->timestamp_low < b->timestamp_low) ? TRUE : FALSE;
+}
+
+// the next record of the ring of cpu at or after *sequence, moving
+// *sequence past it. records that have been overwritten in the ring are
+// taken from the archive when a cache is given
+size_t log_read_next(size_t cpu, log_record_t *record, size_t *sequence, log_archive_cache_t *cache) {
+
+	log_ring_t *ring;
+
+	ring = &(((log_ring_t *)gen_add_base(&log_rings))[cpu]);
+
+	if((cache != NULL) && ((ring->head - *sequence) > LOG_RING_RECORDS)) {
+
+		// a record that is still in the ring is taken from the ring, a
+		// block that was never archived leaves a gap before it
+		if((log_archive_read(cpu, *sequence, record, cache) == SUCCESS) && ((ring->head - record->sequence) > LOG_RING_RECORDS)) {
+			*sequence = record->sequence + 1;
+			return 1;
+		}
+	}
+
+	return log_ring_read(cpu, record, 1, sequence);
+}
+
+// queued by log_ring_claim on the cpu of the ring with the first sequence
+// of the block. the records are compressed into the scratch and appended
+// to the archive, the oldest blocks are dropped to make room
+result_t log_archive_block(dfr_item_t *item) {
+
+	log_archive_t *archive;
+	log_archive_header_t header;
+	log_archive_header_t oldest;
+	u8_t *block;
+	size_t sequence;
+	size_t count;
+	size_t size;
+	size_t start;
+
+	archive = &(((log_archive_t *)gen_add_base(&log_archives))[cpu_get_id()]);
+
+	sequence = item->argument;
+
+	count = log_ring_read(cpu_get_id(), archive->records, LOG_ARCHIVE_BLOCK_RECORDS, &sequence);
+
+	// the ring skips ahead when the block has been overwritten, the
+	// records read past the end of the block belong to the next one
+	while((count > 0) && ((archive->records[count - 1].sequence - item->argument) >= LOG_ARCHIVE_BLOCK_RECORDS)) {
+		count--;
+	}
+
+	if(count == 0) {
+		return SUCCESS;
+	}
+
+	header.first = archive->records[0].sequence;
+	header.end = archive->records[count - 1].sequence + 1;
+	header.count = count;
+
+	start = cpu_get_cycle_count();
+
+	size = log_compress((u8_t *)(archive->records), (count * sizeof(log_record_t)), archive->scratch, (count * sizeof(log_record_t)));
+
+	archive->cycles += cpu_get_cycle_count() - start;
+
+	if(size == 0) {
+		block = (u8_t *)(archive->records);
+		size = count * sizeof(log_record_t);
+		header.flags = LOG_ARCHIVE_FLAG_RAW;
+	}
+	else {
+		block = archive->scratch;
+		header.flags = 0;
+	}
+
+	header.size = size;
+
+	while((archive->head + sizeof(log_archive_header_t) + size - archive->tail) > LOG_ARCHIVE_SIZE) {
+		log_archive_copy(archive, archive->tail, &oldest, sizeof(log_archive_header_t));
+		archive->tail += sizeof(log_archive_header_t) + oldest.size;
+	}
+
+	// a reader sees the new tail before any of the bytes change
+	cpu_data_memory_barrier();
+
+	log_archive_write(archive, archive->head, &header, sizeof(log_archive_header_t));
+	log_archive_write(archive, (archive->head + sizeof(log_archive_header_t)), block, size);
+
+	cpu_data_memory_barrier();
+
+	archive->head += sizeof(log_archive_header_t) + size;
+
+	archive->raw += count * sizeof(log_record_t);
+	archive->packed += sizeof(log_archive_header_t) + size;
+
+	return SUCCESS;
+}
+
+void log_archive_write(log_archive_t *archive, size_t position, void *buffer, size_t size) {
+
+	size_t offset;
+	size_t length;
+
+	offset = position & (LOG_ARCHIVE_SIZE - 1);
+	length = LOG_ARCHIVE_SIZE - offset;
+
+	if(length > size) {
+		length = size;
+	}
+
+	memcpy(&(archive->data[offset]), buffer, length);
+	memcpy(archive->data, &(((u8_t *)buffer)[length]), (size - length));
+}
+
+void log_archive_copy(log_archive_t *archive, size_t position, void *buffer, size_t size) {
+
+	size_t offset;
+	size_t length;
+
+	offset = position & (LOG_ARCHIVE_SIZE - 1);
+	length = LOG_ARCHIVE_SIZE - offset;
+
+	if(length > size) {
+		length = size;
+	}
+
+	memcpy(buffer, &(archive->data[offset]), length);
+	memcpy(&(((u8_t *)buffer)[length]), archive->data, (size - length));
+}
+
+// finds the first archived record of cpu at or after sequence. the block
+// it is in is decompressed into the cache so the records after it are
+// found there. a block is copied out of the archive before it is used
+// and thrown away if tail moved past it in the meantime
+result_t log_archive_read(size_t cpu, size_t sequence, log_record_t *record, log_archive_cache_t *cache) {
+
+	log_archive_t *archive;
+	log_archive_header_t header;
+	size_t position;
+	size_t head;
+	size_t size;
+	size_t i;
+
+	archive = &(((log_archive_t *)gen_add_base(&log_archives))[cpu]);
+
+	if((cache->valid == FALSE) || (sequence < cache->header.first) || (sequence >= cache->header.end)) {
+
+		cache->valid = FALSE;
+
+		head = archive->head;
+
+		cpu_data_memory_barrier();
+
+		for(position = archive->tail; position != head; position += (sizeof(log_archive_header_t) + header.size)) {
+
+			log_archive_copy(archive, position, &header, sizeof(log_archive_header_t));
+
+			cpu_data_memory_barrier();
+
+			if(((position - archive->tail) > LOG_ARCHIVE_SIZE) || (header.size > LOG_ARCHIVE_BLOCK_SIZE) || (header.count > LOG_ARCHIVE_BLOCK_RECORDS)) {
+				return FAILURE;
+			}
+
+			if(header.end > sequence) {
+				break;
+			}
+		}
+
+		if(position == head) {
+			return FAILURE;
+		}
+
+		log_archive_copy(archive, (position + sizeof(log_archive_header_t)), cache->scratch, header.size);
+
+		cpu_data_memory_barrier();
+
+		if((position - archive->tail) > LOG_ARCHIVE_SIZE) {
+			return FAILURE;
+		}
+
+		if((header.flags & LOG_ARCHIVE_FLAG_RAW) != 0) {
+			size = header.size;
+			memcpy(cache->records, cache->scratch, size);
+		}
+		else {
+			size = log_decompress(cache->scratch, header.size, (u8_t *)(cache->records), sizeof(cache->records));
+		}
+
+		if(size != (header.count * sizeof(log_record_t))) {
+			return FAILURE;
+		}
+
+		memcpy(&(cache->header), &header, sizeof(log_archive_header_t));
+
+		cache->valid = TRUE;
+	}
+
+	for(i = 0; i < cache->header.count; i++) {
+
+		if(cache->records[i].sequence >= sequence) {
+			memcpy(record, &(cache->records[i]), sizeof(log_record_t));
+			return SUCCESS;
+		}
+	}
+
+	return FAILURE;
+}
+
+// returns the compressed size or 0 when it does not fit into capacity.
+// matches are found through a hash of the next four bytes, only the
+// last position with each hash is kept
+size_t log_compress(u8_t *source, size_t size, u8_t *destination, size_t capacity) {
+
+	u16_t table[LOG_COMPRESS_HASH_SIZE];
+	u32_t word;
+	size_t anchor;
+	size_t candidate;
+	size_t hash;
+	size_t match;
+	size_t limit;
+	size_t out;
+	size_t i;
+
+	memset(table, 0, sizeof(table));
+
+	anchor = 0;
+	out = 0;
+	i = 0;
+
+	limit = (size > LOG_COMPRESS_TAIL_SIZE) ? (size - LOG_COMPRESS_TAIL_SIZE) : 0;
+
+	while((i + LOG_COMPRESS_MATCH_MINIMUM) <= limit) {
+
+		word = source[i] | (source[i + 1] << 8) | (source[i + 2] << 16) | (source[i + 3] << 24);
+
+		hash = (word * LOG_COMPRESS_HASH_MULTIPLE) >> (32 - LOG_COMPRESS_HASH_BITS);
+
+		// positions are stored + 1 so 0 is an empty slot
+		candidate = table[hash];
+		table[hash] = i + 1;
+
+		if((candidate == 0) || ((i - (candidate - 1)) > 0xFFFF) || (memcmp(&(source[candidate - 1]), &(source[i]), LOG_COMPRESS_MATCH_MINIMUM) != 0)) {
+			i++;
+			continue;
+		}
+
+		candidate--;
+
+		for(match = LOG_COMPRESS_MATCH_MINIMUM; ((i + match) < limit) && (source[candidate + match] == source[i + match]); match++);
+
+		if(log_compress_sequence(destination, &out, capacity, &(source[anchor]), (i - anchor), match, (i - candidate)) == FALSE) {
+			return 0;
+		}
+
+		i += match;
+		anchor = i;
+	}
+
+	if(log_compress_sequence(destination, &out, capacity, &(source[anchor]), (size - anchor), 0, 0) == FALSE) {
+		return 0;
+	}
+
+	return out;
+}
+
+// writes the literals and the match of one sequence at *out, the last
+// sequence has a match of 0. returns FALSE when it does not fit
+bool_t log_compress_sequence(u8_t *destination, size_t *out, size_t capacity, u8_t *literals, size_t count, size_t match, size_t offset) {
+
+	u8_t *token;
+	size_t length;
+
+	// the most the sequence can take
+	if((*out + 1 + ((count / 255) + 1) + count + 2 + ((match / 255) + 1)) > capacity) {
+		return FALSE;
+	}
+
+	token = &(destination[(*out)++]);
+
+	*token = (count < LOG_COMPRESS_FIELD_LIMIT) ? (count << 4) : (LOG_COMPRESS_FIELD_LIMIT << 4);
+
+	if(count >= LOG_COMPRESS_FIELD_LIMIT) {
+
+		for(length = count - LOG_COMPRESS_FIELD_LIMIT; length >= 255; length -= 255) {
+			destination[(*out)++] = 255;
+		}
+
+		destination[(*out)++] = length;
+	}
+
+	memcpy(&(destination[*out]), literals, count);
+
+	*out += count;
+
+	if(match == 0) {
+		return TRUE;
+	}
+
+	destination[(*out)++] = offset & 0xFF;
+	destination[(*out)++] = (offset >> 8) & 0xFF;
+
+	length = match - LOG_COMPRESS_MATCH_MINIMUM;
+
+	if(length < LOG_COMPRESS_FIELD_LIMIT) {
+		*token |= length;
+		return TRUE;
+	}
+
+	*token |= LOG_COMPRESS_FIELD_LIMIT;
+
+	for(length -= LOG_COMPRESS_FIELD_LIMIT; length >= 255; length -= 255) {
+		destination[(*out)++] = 255;
+	}
+
+	destination[(*out)++] = length;
+
+	return TRUE;
+}
+
+// returns the decompressed size or 0 when source is not valid or the
+// output does not fit into capacity
+size_t log_decompress(u8_t *source, size_t size, u8_t *destination, size_t capacity) {
+
+	size_t in;
+	size_t out;
+	size_t count;
+	size_t match;
+	size_t offset;
+	u8_t token;
+	u8_t byte;
+
+	in = 0;
+	out = 0;
+
+	while(in < size) {
+
+		token = source[in++];
+
+		count = token >> 4;
+
+		if(count == LOG_COMPRESS_FIELD_LIMIT) {
+
+			do {
+
+				if(in >= size) {
+					return 0;
+				}
+
+				byte = source[in++];
+				count += byte;
+
+			} while(byte == 255);
+		}
+
+		if(((size - in) < count) || ((capacity - out) < count)) {
+			return 0;
+		}
+
+		memcpy(&(destination[out]), &(source[in]), count);
+
+		in += count;
+		out += count;
+
+		// the last sequence has no match
+		if(in == size) {
+			break;
+		}
+
+		if((size - in) < 2) {
+			return 0;
+		}
+
+		offset = source[in] | (source[in + 1] << 8);
+		in += 2;
+
+		match = (token & LOG_COMPRESS_FIELD_LIMIT) + LOG_COMPRESS_MATCH_MINIMUM;
+
+		if((token & LOG_COMPRESS_FIELD_LIMIT) == LOG_COMPRESS_FIELD_LIMIT) {
+
+			do {
+
+				if(in >= size) {
+					return 0;
+				}
+
+				byte = source[in++];
+				match += byte;
+
+			} while(byte == 255);
+		}
+
+		if((offset == 0) || (offset > out) || ((capacity - out) < match)) {
+			return 0;
+		}
+
+		// the match may overlap the bytes it produces
+		for(; match > 0; match--, out++) {
+			destination[out] = destination[out - offset];
+		}
+	}
+
+	return out;
+}
+
+result_t log_putc(u8_t c) {
+
+	#ifdef __SERIAL_DEBUG__
+	if(utx_write(&c, sizeof(u8_t)) == FAILURE) {
+		return FAILURE;
+	}
+	#endif //__SERIAL_DEBUG__
+
+	#ifdef __MEMORY_DEBUG__
+	log_ring_write(&c, sizeof(u8_t));
+	#endif //__MEMORY_DEBUG__
+
+	return SUCCESS;
+}
+
+result_t log_write(u8_t *buffer, size_t size) {
+
+	if(buffer == NULL) {
+		return FAILURE;
+	}
+
+	#ifdef __SERIAL_DEBUG__
+	if(utx_write(buffer, size) == FAILURE) {
+		return FAILURE;
+	}
+	#endif //__SERIAL_DEBUG__
+
+	#ifdef __MEMORY_DEBUG__
+	log_ring_write(buffer, size);
+	#endif //__MEMORY_DEBUG__
+
+	return SUCCESS;
+}
+
+result_t log_vprintf(const char *fmt, va_list args) {
+
+	log_line_t line;
+	size_t arguments[LOG_FORMAT_ARGUMENTS];
+	size_t count;
+
+	count = log_get_arguments(fmt, args, arguments);
+
+	memset(&line, 0, sizeof(log_line_t));
+
+	if(log_format(&line, fmt, arguments, count) != SUCCESS) {
+		return FAILURE;
+	}
+
+	return log_line_flush(&line);
+}
+
+// the directives are parsed the same way here and in log_format so the
+// words line up. a 64 bit argument takes two words, low then high
+size_t log_get_arguments(const char *fmt, va_list args, size_t *arguments) {
+
+	log_directive_t directive;
+	unsigned long long wide;
+	size_t count;
+	size_t words;
+
+	count = 0;
+
+	while(*fmt) {
+
+		if(*fmt != '%') {
+			fmt++;
+			continue;
+		}
+
+		fmt += log_parse_directive((fmt + 1), &directive) + 1;
+
+		words = log_get_directive_words(&directive);
+
+		if((count + words) > LOG_FORMAT_ARGUMENTS) {
+			break;
+		}
+
+		if(words == 2) {
+			wide = va_arg(args, unsigned long long);
+			arguments[count++] = (size_t)wide;
+			arguments[count++] = (size_t)(wide >> 32);
+		}
+		else if(words == 1) {
+			arguments[count++] = va_arg(args, size_t);
+		}
+	}
+
+	return count;
+}
+
+// parses the flags, width, precision, length and conversion that follow
+// a '%' and returns the number of characters they take
+size_t log_parse_directive(const char *fmt, log_directive_t *directive) {
+
+	const char *start;
+
+	start = fmt;
+
+	memset(directive, 0, sizeof(log_directive_t));
+
+	directive->precision = LOG_FORMAT_NO_PRECISION;
+
+	while((*fmt == '0') || (*fmt == '-')) {
+
+		if(*fmt == '0') {
+			directive->flags |= LOG_FORMAT_FLAG_ZERO;
+		}
+		else {
+			directive->flags |= LOG_FORMAT_FLAG_LEFT;
+		}
+
+		fmt++;
+	}
+
+	while((*fmt >= '0') && (*fmt <= '9')) {
+		directive->width = (directive->width * 10) + (*fmt - '0');
+		fmt++;
+	}
+
+	if(*fmt == '.') {
+
+		fmt++;
+
+		directive->precision = 0;
+
+		while((*fmt >= '0') && (*fmt <= '9')) {
+			directive->precision = (directive->precision * 10) + (*fmt - '0');
+			fmt++;
 		}
+	}
 
+	// long is a word on this target, only long long is 64 bits
+	while(*fmt == 'l') {
+		directive->length++;
 		fmt++;
 	}
 
+	directive->conversion = *fmt;
+
+	if(*fmt != '\0') {
+		fmt++;
+	}
+
+	if(directive->width > LOG_FORMAT_WIDTH_LIMIT) {
+		directive->width = LOG_FORMAT_WIDTH_LIMIT;
+	}
+
+	// the precision of a string only limits what is read of it
+	if((directive->conversion != 's') && (directive->precision != LOG_FORMAT_NO_PRECISION) && (directive->precision > LOG_FORMAT_PRECISION_LIMIT)) {
+		directive->precision = LOG_FORMAT_PRECISION_LIMIT;
+	}
+
+	return (fmt - start);
+}
+
+size_t log_get_directive_words(log_directive_t *directive) {
+
+	if((directive->conversion == 'd') || (directive->conversion == 'u') || (directive->conversion == 'x') || (directive->conversion == 'X') || (directive->conversion == 'o')) {
+		return (directive->length >= 2) ? 2 : 1;
+	}
+
+	if((directive->conversion == 's') || (directive->conversion == 'c') || (directive->conversion == 'p')) {
+		return 1;
+	}
+
+	return 0;
+}
+
+// writes the digits of the 64 bit value high:low least significant
+// first and returns how many there are. a decimal digit is divided out
+// 16 bits at a time so only 32 bit divisions are needed
+size_t log_format_number(u8_t *digits, size_t low, size_t high, size_t base, bool_t upper) {
+
+	const char *characters;
+	size_t parts[4];
+	size_t remainder;
+	size_t chunk;
+	size_t count;
+	size_t i;
+
+	characters = gen_add_base((upper == TRUE) ? "0123456789ABCDEF" : "0123456789abcdef");
+
+	count = 0;
+
+	do {
+
+		if(base == 10) {
+
+			parts[0] = high >> 16;
+			parts[1] = high & 0xFFFF;
+			parts[2] = low >> 16;
+			parts[3] = low & 0xFFFF;
+
+			remainder = 0;
+
+			for(i = 0; i < 4; i++) {
+				chunk = (remainder << 16) | parts[i];
+				parts[i] = chunk / 10;
+				remainder = chunk % 10;
+			}
+
+			high = (parts[0] << 16) | parts[1];
+			low = (parts[2] << 16) | parts[3];
+
+			digits[count++] = characters[remainder];
+		}
+		else if(base == 16) {
+			digits[count++] = characters[low & 0xF];
+			low = (low >> 4) | (high << 28);
+			high >>= 4;
+		}
+		else {
+			digits[count++] = characters[low & 0x7];
+			low = (low >> 3) | (high << 29);
+			high >>= 3;
+		}
+
+	} while((low != 0) || (high != 0));
+
+	return count;
+}
+
+// builds the whole field of a numeric directive, padding, sign, zeros
+// for the precision and digits, and returns its size. log_parse_directive
+// limits the width and precision so it always fits
+size_t log_format_field(u8_t *field, log_directive_t *directive, size_t *arguments) {
+
+	u8_t digits[LOG_FORMAT_DIGITS_SIZE];
+	size_t low;
+	size_t high;
+	size_t count;
+	size_t zeros;
+	size_t sign;
+	size_t size;
+	size_t base;
+
+	low = arguments[0];
+	high = (directive->length >= 2) ? arguments[1] : 0;
+
+	sign = 0;
+
+	if((directive->conversion == 'd') && ((((directive->length >= 2) ? high : low) & 0x80000000) != 0)) {
+
+		sign = 1;
+
+		low = ~low + 1;
+		high = (directive->length >= 2) ? (~high + ((low == 0) ? 1 : 0)) : 0;
+	}
+
+	if((directive->conversion == 'x') || (directive->conversion == 'X') || (directive->conversion == 'p')) {
+		base = 16;
+	}
+	else if(directive->conversion == 'o') {
+		base = 8;
+	}
+	else {
+		base = 10;
+	}
+
+	count = log_format_number(digits, low, high, base, ((directive->conversion == 'X') ? TRUE : FALSE));
+
+	// an explicit precision of zero prints nothing for zero
+	if((directive->precision == 0) && (low == 0) && (high == 0)) {
+		count = 0;
+	}
+
+	zeros = ((directive->precision != LOG_FORMAT_NO_PRECISION) && (directive->precision > count)) ? (directive->precision - count) : 0;
+
+	// the zero flag is ignored with a precision or left justification
+	if(((directive->flags & (LOG_FORMAT_FLAG_ZERO | LOG_FORMAT_FLAG_LEFT)) == LOG_FORMAT_FLAG_ZERO) && (directive->precision == LOG_FORMAT_NO_PRECISION) && (directive->width > (sign + zeros + count))) {
+		zeros = directive->width - (sign + count);
+	}
+
+	size = 0;
+
+	if((directive->flags & LOG_FORMAT_FLAG_LEFT) == 0) {
+		while((size + sign + zeros + count) < directive->width) {
+			field[size++] = ' ';
+		}
+	}
+
+	if(sign != 0) {
+		field[size++] = '-';
+	}
+
+	while(zeros > 0) {
+		field[size++] = '0';
+		zeros--;
+	}
+
+	while(count > 0) {
+		field[size++] = digits[--count];
+	}
+
+	while(size < directive->width) {
+		field[size++] = ' ';
+	}
+
+	return size;
+}
+
+// formats fmt with arguments taken as log_get_arguments takes them,
+// shared by log_vprintf and the readout of the binary records. runs of
+// literal characters go out with one append, as does each directive
+// apart from the padding of a string
+result_t log_format(log_line_t *line, const char *fmt, size_t *arguments, size_t count) {
+
+	log_directive_t directive;
+	u8_t field[LOG_FORMAT_FIELD_SIZE];
+	const char *run;
+	const char *string;
+	size_t index;
+	size_t words;
+	size_t length;
+	size_t size;
+
+	index = 0;
+
+	while(*fmt) {
+
+		run = fmt;
+
+		while((*fmt != '\0') && (*fmt != '%') && (*fmt != '\n')) {
+			fmt++;
+		}
+
+		if(fmt != run) {
+
+			if(log_line_append(line, (u8_t *)run, (fmt - run)) != SUCCESS) {
+				return FAILURE;
+			}
+		}
+
+		if(*fmt == '\n') {
+
+			if(log_line_append(line, gen_add_base("\r\n"), 2) != SUCCESS) {
+				return FAILURE;
+			}
+
+			fmt++;
+			continue;
+		}
+
+		if(*fmt != '%') {
+			continue;
+		}
+
+		run = fmt;
+
+		fmt += log_parse_directive((fmt + 1), &directive) + 1;
+
+		words = log_get_directive_words(&directive);
+
+		// the arguments ran out, the directive is dropped
+		if((index + words) > count) {
+			index = count;
+			continue;
+		}
+
+		if(directive.conversion == 's') {
+
+			string = (const char *)(arguments[index]);
+
+			if(string == NULL) {
+				string = gen_add_base("(null)");
+			}
+
+			length = strlen(string);
+
+			if((directive.precision != LOG_FORMAT_NO_PRECISION) && (directive.precision < length)) {
+				length = directive.precision;
+			}
+
+			size = (directive.width > length) ? (directive.width - length) : 0;
+
+			if(size > LOG_FORMAT_FIELD_SIZE) {
+				size = LOG_FORMAT_FIELD_SIZE;
+			}
+
+			memset(field, ' ', size);
+
+			if(((directive.flags & LOG_FORMAT_FLAG_LEFT) == 0) && (log_line_append(line, field, size) != SUCCESS)) {
+				return FAILURE;
+			}
+
+			if(log_line_append(line, (u8_t *)string, length) != SUCCESS) {
+				return FAILURE;
+			}
+
+			if(((directive.flags & LOG_FORMAT_FLAG_LEFT) != 0) && (log_line_append(line, field, size) != SUCCESS)) {
+				return FAILURE;
+			}
+		}
+		else if(directive.conversion == 'c') {
+
+			field[0] = (u8_t)(arguments[index]);
+
+			if(log_line_append(line, field, sizeof(u8_t)) != SUCCESS) {
+				return FAILURE;
+			}
+		}
+		else if(words != 0) {
+
+			size = log_format_field(field, &directive, &(arguments[index]));
+
+			if(log_line_append(line, field, size) != SUCCESS) {
+				return FAILURE;
+			}
+		}
+		else if(directive.conversion == '%') {
+
+			if(log_line_append(line, (u8_t *)run, sizeof(u8_t)) != SUCCESS) {
+				return FAILURE;
+			}
+		}
+		else {
+
+			// not a conversion this knows, it is printed as it is
+			if(log_line_append(line, (u8_t *)run, (fmt - run)) != SUCCESS) {
+				return FAILURE;
+			}
+		}
+
+		index += words;
+	}
+
+	return SUCCESS;
+}
+
+// the hot path version of log_printf, a record is claimed and filled in
+// place with the raw argument words. nothing is formatted until the
+// record is read out, either by LOG_FUNCTION_INIT or by the operating
+// system from the raw records of LOG_FUNCTION_RING_READ
+void log_binary_printf(const char *fmt, size_t count, ...) {
+
+	#ifdef __MEMORY_DEBUG__
+	log_record_t *record;
+	log_binary_t *binary;
+	va_list args;
+	size_t sequence;
+	size_t i;
+
+	if(count > LOG_BINARY_ARGUMENTS) {
+		count = LOG_BINARY_ARGUMENTS;
+	}
+
+	record = log_ring_claim(&sequence);
+
+	binary = (log_binary_t *)(record->data);
+
+	binary->format = (size_t)gen_subtract_base(fmt);
+
+	va_start(args, count);
+
+	for(i = 0; i < count; i++) {
+		binary->arguments[i] = va_arg(args, size_t);
+	}
+
+	va_end(args);
+
+	record->type = LOG_RECORD_TYPE_BINARY;
+	record->size = (1 + count) * sizeof(size_t);
+
+	log_ring_commit(record, sequence);
+	#else
+	UNUSED_VARIABLE(fmt);
+	UNUSED_VARIABLE(count);
+	#endif //__MEMORY_DEBUG__
+}
+
+// appends the text of record to line, formatting it if it is binary
+result_t log_format_record(log_line_t *line, log_record_t *record) {
+
+	log_binary_t *binary;
+
+	if(record->type == LOG_RECORD_TYPE_BINARY) {
+
+		binary = (log_binary_t *)(record->data);
+
+		return log_format(line, gen_add_base((void *)(binary->format)), binary->arguments, ((record->size / sizeof(size_t)) - 1));
+	}
+
+	return log_line_append(line, record->data, record->size);
+}
+
+// collects the output of log_vprintf so it goes out in as few writes,
+// and so as few ring records, as possible
+result_t log_line_append(log_line_t *line, u8_t *buffer, size_t size) {
+
+	size_t length;
+
+	if(buffer == NULL) {
+		return FAILURE;
+	}
+
+	while(size > 0) {
+
+		if(line->size == LOG_RING_DATA_SIZE) {
+
+			if(log_line_flush(line) != SUCCESS) {
+				return FAILURE;
+			}
+		}
+
+		length = LOG_RING_DATA_SIZE - line->size;
+
+		if(length > size) {
+			length = size;
+		}
+
+		memcpy(&(line->data[line->size]), buffer, length);
+
+		line->size += length;
+		buffer += length;
+		size -= length;
+	}
+
+	return SUCCESS;
+}
+
+result_t log_line_flush(log_line_t *line) {
+
+	if(line->size == 0) {
+		return SUCCESS;
+	}
+
+	if(line->destination != NULL) {
+
+		if(line->size > line->available) {
+			line->size = line->available;
+		}
+
+		memcpy(line->destination, line->data, line->size);
+
+		line->destination += line->size;
+		line->available -= line->size;
+	}
+	else if(log_write(line->data, line->size) != SUCCESS) {
+		return FAILURE;
+	}
+
+	line->size = 0;
+
 	return SUCCESS;
 }
 
@@ -7,8 +7,10 @@
 #include <stdlib/check.h>
 #include <stdlib/string.h>
 
+#include <kernel/cpu.h>
 #include <kernel/lst.h>
 #include <kernel/mas.h>
+#include <kernel/trc.h>
 
 DBG_DEFINE_VARIABLE(lst_dbg, DBG_LEVEL_2);
 
@@ -67,7 +69,7 @@ result_t lst_add_before_item(lst_item_t **item) {
 	lst_item_t *tmp;
 	void *data;
 
-	DBG_LOG_FUNCTION(lst_dbg, DBG_LEVEL_3);
+	TRC_POINT(lst_add_before_item);
 
 	lst_get_data(*item, &data);
 
@@ -108,7 +110,7 @@ result_t lst_add_after_item(lst_item_t **item) {
 
 	lst_item_t *tmp;
 
-	DBG_LOG_FUNCTION(lst_dbg, DBG_LEVEL_3);
+	TRC_POINT(lst_add_after_item);
 
 	CHECK_NOT_NULL(item, "item is null", item, lst_dbg, DBG_LEVEL_2)
 		return FAILURE;
@@ -139,8 +141,65 @@ result_t lst_add_after_item(lst_item_t **item) {
 	return SUCCESS;
 }
 
+// lst_add_after_item for a list that is walked on other cpus. the data
+// is set and made visible before the item is linked, so a walk never
+// finds the item without it
+result_t lst_publish_after_item(lst_item_t **item, void *data) {
+
+	lst_item_t *tmp;
+
+	TRC_POINT(lst_publish_after_item);
+
+	CHECK_NOT_NULL(item, "item is null", item, lst_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_NOT_NULL(*item, "there is no item to add after", item, lst_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	tmp = (lst_item_t *)malloc(sizeof(lst_item_t));
+
+	CHECK_NOT_NULL(tmp, "tmp is null", tmp, lst_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	tmp->data = data;
+	tmp->previous = (*item);
+	tmp->next = (*item)->next;
+	tmp->head = (*item)->head;
+
+	cpu_data_memory_barrier();
+
+	if((*item)->next != NULL) {
+		(*item)->next->previous = tmp;
+	}
+
+	(*item)->next = tmp;
+
+	(*item) = tmp;
+
+	return SUCCESS;
+}
+
 result_t lst_remove_item(lst_item_t *item) {
 
+	TRC_POINT(lst_remove_item);
+
+	CHECK_SUCCESS(lst_unlink_item(item), "unable to unlink item", item, lst_dbg, DBG_LEVEL_3)
+		return FAILURE;
+	CHECK_END
+
+	free(item);
+
+	return SUCCESS;
+}
+
+// takes the item out of the list without freeing it. its own links are
+// left intact so a walk that already holds the item carries on with the
+// rest of the list, the caller frees it once nothing can be walking it
+result_t lst_unlink_item(lst_item_t *item) {
+
 	void *data;
 
 	DBG_LOG_FUNCTION(lst_dbg, DBG_LEVEL_3);
@@ -162,8 +221,6 @@ result_t lst_remove_item(lst_item_t *item) {
 		item->next->previous = item->previous;
 	}
 
-	free(item);
-
 	return SUCCESS;
 }
 
@@ -30,6 +30,7 @@
 #include <fxplib/gen.h>
 
 #include <kernel/mas.h>
+#include <kernel/trc.h>
 #include <kernel/end.h>
 
 size_t mas_size = 0; // number of blocks in the table
@@ -100,7 +101,7 @@ void * mas_alloc(size_t alignment, size_t size) {
 	size_t i, j;
 	size_t b;
 
-	DBG_LOG_FUNCTION(mas_dbg, DBG_LEVEL_3);
+	TRC_POINT(mas_alloc);
 
 	if (size == 0) { return NULL; }
 
@@ -230,7 +231,7 @@ void mas_free(void *ptr) {
 	mas_block_t **mt;
 	size_t bn;
 
-	DBG_LOG_FUNCTION(mas_dbg, DBG_LEVEL_3);
+	TRC_POINT(mas_free);
 
 	mt = gen_add_base(&mas_table);
 
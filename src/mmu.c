@@ -24,8 +24,10 @@
 #include <types.h>
 
 #include <kernel/config.h>
+#include <kernel/cpu.h>
 #include <kernel/mmu.h>
 #include <kernel/mas.h>
+#include <kernel/trc.h>
 
 #include <armv7lib/cpuid.h>
 #include <armv7lib/cmsa/cac.h>
@@ -485,7 +487,7 @@ result_t mmu_map(tt_physical_address_t pa, size_t size, size_t options, tt_virtu
 
 result_t mmu_map_internal(tt_physical_address_t pa, size_t size, size_t options, tt_virtual_address_t *va) {
 
-	DBG_LOG_FUNCTION(mmu_dbg, DBG_LEVEL_3);
+	TRC_POINT(mmu_map_internal);
 
 	CHECK((va->all == 0) || (va->all >= ((size_t)ONE_GIGABYTE * 3)), "va is incompatable", va->all, mmu_dbg, DBG_LEVEL_2)
 		return FAILURE;
@@ -519,7 +521,7 @@ result_t mmu_map_internal(tt_physical_address_t pa, size_t size, size_t options,
 
 result_t mmu_map_external(tt_physical_address_t pa, size_t size, size_t options, tt_virtual_address_t *va) {
 
-	DBG_LOG_FUNCTION(mmu_dbg, DBG_LEVEL_3);
+	TRC_POINT(mmu_map_external);
 
 	if(((va->all & (TT_SMALL_PAGE_SIZE - 1)) + size) <= TT_SMALL_PAGE_SIZE) {
 		CHECK_SUCCESS(mmu_map_external_small_page(pa, options, va), "unable to map external small page", pa.all, mmu_dbg, DBG_LEVEL_2)
@@ -878,7 +880,12 @@ result_t mmu_map_external_small_page(tt_physical_address_t pa, size_t options, t
 						return FAILURE;
 					CHECK_END
 
-					sld.small_page.fields.ap_0 = TT_AP_0_AP_1_F_S_RW_U_RW;
+					if(options & MMU_MAP_PRIVILEGED) {
+						sld.small_page.fields.ap_0 = TT_AP_0_AP_1_F_S_RW_U_NA;
+					}
+					else {
+						sld.small_page.fields.ap_0 = TT_AP_0_AP_1_F_S_RW_U_RW;
+					}
 					sld.small_page.fields.ap_1 = FALSE;
 
 					if(options & MMU_MAP_EXECUTE_NEVER) {
@@ -985,7 +992,12 @@ result_t mmu_map_external_section(tt_physical_address_t pa, size_t options, tt_v
 				return FAILURE;
 			CHECK_END
 
-			fld.section.fields.ap_0 = TT_AP_0_AP_1_F_S_RW_U_RW;
+			if(options & MMU_MAP_PRIVILEGED) {
+				fld.section.fields.ap_0 = TT_AP_0_AP_1_F_S_RW_U_NA;
+			}
+			else {
+				fld.section.fields.ap_0 = TT_AP_0_AP_1_F_S_RW_U_RW;
+			}
 			fld.section.fields.ap_1 = FALSE;
 
 			if(options & MMU_MAP_EXECUTE_NEVER) {
@@ -1045,7 +1057,7 @@ result_t mmu_unmap(tt_virtual_address_t va, size_t size, size_t options) {
 
 result_t mmu_unmap_internal(tt_virtual_address_t va, size_t size) {
 
-	DBG_LOG_FUNCTION(mmu_dbg, DBG_LEVEL_3);
+	TRC_POINT(mmu_unmap_internal);
 
 	// compensate for the 1/4 size l1
 	va.all -= ((size_t)ONE_GIGABYTE * 3);
@@ -1071,7 +1083,7 @@ result_t mmu_unmap_internal(tt_virtual_address_t va, size_t size) {
 
 result_t mmu_unmap_external(tt_virtual_address_t va, size_t size) {
 
-	DBG_LOG_FUNCTION(mmu_dbg, DBG_LEVEL_3);
+	TRC_POINT(mmu_unmap_external);
 
 	if(size <= TT_SMALL_PAGE_SIZE) {
 		CHECK_SUCCESS(mmu_unmap_external_small_page(va), "unable to unmap external small page", va.all, mmu_dbg, DBG_LEVEL_2)
@@ -1706,6 +1718,58 @@ result_t mmu_set_small_page_attributes(tt_second_level_descriptor_t *sld, size_t
 	return SUCCESS;
 }
 
+// writes to memory the operating system has mapped read only, such as
+// its code. the page is aliased writable in the external paging system
+// for the duration of the write. the write must not cross a small page
+result_t mmu_write_external(tt_virtual_address_t va, void *data, size_t size) {
+
+	tt_physical_address_t pa;
+	tt_virtual_address_t alias;
+	size_t offset;
+	size_t par;
+
+	DBG_LOG_FUNCTION(mmu_dbg, DBG_LEVEL_3);
+
+	offset = va.all & (TT_SMALL_PAGE_SIZE - 1);
+
+	CHECK((offset + size) <= TT_SMALL_PAGE_SIZE, "write crosses a small page", va.all, mmu_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, mmu_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// let the hardware walk the tables so sections and pages are both handled
+	par = cpu_translate_address(va.all);
+
+	CHECK((par & CPU_PAR_FAULT) == 0, "va is not mapped", va.all, mmu_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	pa.all = (par & CPU_PAR_ADDRESS_MASK);
+
+	// the operating system owns everything below 3 GB
+	alias.all = ((u32_t)ONE_GIGABYTE * 3);
+
+	CHECK_SUCCESS(mmu_map(pa, FOUR_KILOBYTES, MMU_MAP_EXTERNAL | MMU_MAP_NORMAL_MEMORY, &alias), "unable to map pa", pa.all, mmu_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy((void *)(alias.all + offset), data, size);
+
+	// clean the alias to the point of unification and drop any stale
+	// instruction cache lines held for the operating system va
+	cac_flush_cache_region((void *)(alias.all + offset), size);
+	cac_flush_cache_region((void *)(va.all), size);
+
+	CHECK_SUCCESS(mmu_unmap(alias, FOUR_KILOBYTES, MMU_MAP_EXTERNAL), "unable to unmap the alias", alias.all, mmu_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
 result_t mmu_get_debug_level(size_t *level) {
 
 	DBG_LOG_FUNCTION(mmu_dbg, DBG_LEVEL_3);
@@ -0,0 +1,521 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+#include <armv7lib/vmsa/flt.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/abt.h>
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/mas.h>
+#include <kernel/mmu.h>
+#include <kernel/pft.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(pft_dbg, DBG_LEVEL_2);
+
+// the functions that record a fault do not log, they run for every
+// abort the operating system takes
+
+// each cpu has its own ring and counters so tracing never shares a cache line
+pft_cpu_t *pft_cpus[CPU_NUMBER_OF_CPUS];
+
+bool_t pft_enabled;
+
+// the sub-functions of PFT_CALL_IDENTIFIER indexed by r2
+call_function_t pft_call_functions[PFT_NUMBER_OF_FUNCTIONS];
+
+result_t pft_init(void) {
+
+	pft_cpu_t **cpus;
+	call_function_t *functions;
+	size_t i;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	*(bool_t *)gen_add_base(&pft_enabled) = FALSE;
+
+	cpus = gen_add_base(&pft_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		cpus[i] = malloc(sizeof(pft_cpu_t));
+
+		CHECK_NOT_NULL(cpus[i], "unable to allocate memory for the cpu", i, pft_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(cpus[i], 0, sizeof(pft_cpu_t));
+
+		CHECK_SUCCESS(rng_init(&(cpus[i]->ring), sizeof(pft_record_t), PFT_RING_SIZE), "unable to initialize the ring", i, pft_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+	}
+
+	functions = gen_add_base(&pft_call_functions);
+
+	functions[PFT_FUNCTION_START] = gen_add_base(&pft_call_start_handler);
+	functions[PFT_FUNCTION_STOP] = gen_add_base(&pft_call_stop_handler);
+	functions[PFT_FUNCTION_READ] = gen_add_base(&pft_call_read_handler);
+	functions[PFT_FUNCTION_STATISTICS] = gen_add_base(&pft_call_statistics_handler);
+	functions[PFT_FUNCTION_PROCESS] = gen_add_base(&pft_call_process_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(PFT_CALL_IDENTIFIER, functions, PFT_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// below the abt handlers so faults the microvisor resolves itself are not traced
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_DATA_ABORT_VECTOR, gen_add_base(&pft_vec_data_abort_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST - 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec data abort handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_PREFETCH_ABORT_VECTOR, gen_add_base(&pft_vec_prefetch_abort_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST - 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec prefetch abort handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// interrupts are the most frequent way back into the microvisor
+	// once the process that faulted is running again
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&pft_vec_interrupt_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST, VEC_HANDLER_FLAG_NONE), "unable to register the vec interrupt handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t pft_fini(void) {
+
+	pft_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&pft_vec_interrupt_handler)), "unable to unregister the vec interrupt handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_PREFETCH_ABORT_VECTOR, gen_add_base(&pft_vec_prefetch_abort_handler)), "unable to unregister the vec prefetch abort handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_DATA_ABORT_VECTOR, gen_add_base(&pft_vec_data_abort_handler)), "unable to unregister the vec data abort handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_unregister_handler_table(PFT_CALL_IDENTIFIER, gen_add_base(&pft_call_functions)), "unable to unregister the call handler", FAILURE, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpus = gen_add_base(&pft_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] != NULL) {
+			rng_fini(&(cpus[i]->ring));
+			free(cpus[i]);
+			cpus[i] = NULL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+result_t pft_start(void) {
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	*(bool_t *)gen_add_base(&pft_enabled) = TRUE;
+
+	return SUCCESS;
+}
+
+result_t pft_stop(void) {
+
+	pft_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	*(bool_t *)gen_add_base(&pft_enabled) = FALSE;
+
+	cpus = gen_add_base(&pft_cpus);
+
+	// a fault left open would be closed with a bogus latency on restart
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] != NULL) {
+			cpus[i]->open = FALSE;
+		}
+	}
+
+	return SUCCESS;
+}
+
+// the rings have a single consumer, only one reader may drain a cpu at a time
+result_t pft_read(size_t cpu, pft_record_t *record) {
+
+	pft_cpu_t *state;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((pft_cpu_t **)gen_add_base(&pft_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// an empty ring is not an error worth logging
+	return rng_get(&(state->ring), record);
+}
+
+result_t pft_get_process(size_t cpu, size_t index, pft_process_t *process) {
+
+	pft_cpu_t *state;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK(index < PFT_PROCESSES_SIZE, "index is out of range", index, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((pft_cpu_t **)gen_add_base(&pft_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(process, &(state->processes[index]), sizeof(pft_process_t));
+
+	return SUCCESS;
+}
+
+// faults must point to ABT_NUMBER_OF_TYPES counters
+result_t pft_get_statistics(size_t cpu, size_t *faults, size_t *depth, size_t *dropped, cpu_statistics_t *latency) {
+
+	pft_cpu_t *state;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((pft_cpu_t **)gen_add_base(&pft_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, pft_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(faults, state->faults, sizeof(state->faults));
+
+	*depth = rng_get_depth(&(state->ring));
+	*dropped = state->ring.dropped;
+
+	memcpy(latency, &(state->latency), sizeof(cpu_statistics_t));
+
+	return SUCCESS;
+}
+
+// the return from the operating system fault handler is not trapped. the
+// first exception taken from user mode by the same process bounds it, so
+// the latency is an upper bound that also holds any user time before it
+void pft_close(pft_cpu_t *state, size_t spsr, size_t ttbr0, size_t cycles) {
+
+	if(state->open == FALSE) {
+		return;
+	}
+
+	if(((spsr & CPU_MODE_MASK) != CPU_MODE_USER) || (ttbr0 != state->open_ttbr0)) {
+		return;
+	}
+
+	cpu_update_statistics(&(state->latency), (cycles - state->open_cycles));
+
+	state->open = FALSE;
+}
+
+result_t pft_trace(size_t type, size_t status, size_t address, gen_general_purpose_registers_t *registers) {
+
+	pft_cpu_t *state;
+	pft_record_t record;
+	pft_process_t *process;
+	mmu_paging_system_t ps;
+	gen_program_status_register_t spsr;
+	size_t index;
+	size_t cpu;
+	size_t i;
+
+	cpu = cpu_get_id();
+
+	state = ((pft_cpu_t **)gen_add_base(&pft_cpus))[cpu];
+
+	if(state == NULL) {
+		return SUCCESS;
+	}
+
+	if(mmu_get_paging_system(MMU_SWITCH_EXTERNAL, &ps) != SUCCESS) {
+		return FAILURE;
+	}
+
+	spsr = gen_get_spsr();
+
+	record.type = type;
+	record.status = status;
+	record.address = address;
+	record.pc = registers->lr - ((type == ABT_DATA_ABORT) ? PFT_DATA_ABORT_RETURN_ADJUSTMENT : PFT_PREFETCH_ABORT_RETURN_ADJUSTMENT);
+	record.ttbr0 = ps.ttbr0.all;
+	record.spsr = spsr.all;
+	record.cycles = cpu_get_cycle_count();
+	record.cpu = cpu;
+
+	// the process is running again if it faults again from user mode
+	pft_close(state, record.spsr, record.ttbr0, record.cycles);
+
+	// kernel mode faults can not be closed by pft_close so they are not timed
+	if((record.spsr & CPU_MODE_MASK) == CPU_MODE_USER) {
+		state->open = TRUE;
+		state->open_ttbr0 = record.ttbr0;
+		state->open_cycles = record.cycles;
+	}
+
+	state->faults[type]++;
+
+	// a full ring drops the record and counts it
+	rng_put(&(state->ring), &record);
+
+	index = ((record.ttbr0 >> PFT_PROCESSES_SHIFT) * PFT_PROCESSES_HASH) >> (32 - PFT_PROCESSES_BITS);
+
+	for(i = 0; i < PFT_PROCESSES_PROBES; i++) {
+
+		process = &(state->processes[(index + i) & (PFT_PROCESSES_SIZE - 1)]);
+
+		if(process->faults == 0) {
+			process->ttbr0 = record.ttbr0;
+		}
+
+		if(process->ttbr0 == record.ttbr0) {
+			process->faults++;
+			return SUCCESS;
+		}
+	}
+
+	state->missed++;
+
+	return SUCCESS;
+}
+
+result_t pft_call_start_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(pft_start(), "unable to start the tracer", FAILURE, pft_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t pft_call_stop_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(pft_stop(), "unable to stop the tracer", FAILURE, pft_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t pft_call_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	pft_record_t record;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	if(pft_read(registers->r3, &record) != SUCCESS) {
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	}
+
+	memcpy(&(registers->r1), &record, sizeof(pft_record_t));
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t pft_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	cpu_statistics_t latency;
+	size_t faults[ABT_NUMBER_OF_TYPES];
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(pft_get_statistics(registers->r3, faults, &(registers->r3), &(registers->r4), &latency), "unable to get the statistics", registers->r3, pft_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = faults[ABT_DATA_ABORT];
+	registers->r2 = faults[ABT_PREFETCH_ABORT];
+	registers->r5 = latency.count;
+	registers->r6 = latency.average;
+	registers->r7 = latency.minimum;
+	registers->r8 = latency.maximum;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t pft_call_process_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	pft_process_t process;
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(pft_get_process(registers->r3, registers->r4, &process), "unable to get the process", registers->r4, pft_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = process.ttbr0;
+	registers->r2 = process.faults;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t pft_vec_data_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	flt_data_fault_status_register_t dfsr;
+	flt_data_fault_address_register_t dfar;
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+
+	if(*(bool_t *)gen_add_base(&pft_enabled) == FALSE) {
+		return SUCCESS;
+	}
+
+	dfsr = flt_get_dfsr();
+	dfar = flt_get_dfar();
+
+	return pft_trace(ABT_DATA_ABORT, dfsr.all, dfar.all, registers);
+}
+
+result_t pft_vec_prefetch_abort_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	flt_instruction_fault_address_register_t ifar;
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+
+	if(*(bool_t *)gen_add_base(&pft_enabled) == FALSE) {
+		return SUCCESS;
+	}
+
+	ifar = flt_get_ifar();
+
+	return pft_trace(ABT_PREFETCH_ABORT, cpu_get_instruction_fault_status(), ifar.all, registers);
+}
+
+result_t pft_vec_interrupt_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	pft_cpu_t *state;
+	mmu_paging_system_t ps;
+	gen_program_status_register_t spsr;
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+	UNUSED_VARIABLE(registers);
+
+	state = ((pft_cpu_t **)gen_add_base(&pft_cpus))[cpu_get_id()];
+
+	// the common case is nothing open, keep it to a load and a compare
+	if((state == NULL) || (state->open == FALSE)) {
+		return SUCCESS;
+	}
+
+	spsr = gen_get_spsr();
+
+	if((spsr.all & CPU_MODE_MASK) != CPU_MODE_USER) {
+		return SUCCESS;
+	}
+
+	if(mmu_get_paging_system(MMU_SWITCH_EXTERNAL, &ps) != SUCCESS) {
+		return FAILURE;
+	}
+
+	pft_close(state, spsr.all, ps.ttbr0.all, cpu_get_cycle_count());
+
+	return SUCCESS;
+}
+
+result_t pft_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(pft_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t pft_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(pft_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(pft_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,513 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+#include <armv7lib/cmsa/cac.h>
+#include <armv7lib/vmsa/tt.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <hdrlib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/ldr.h>
+#include <kernel/mas.h>
+#include <kernel/mmu.h>
+#include <kernel/prb.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(prb_dbg, DBG_LEVEL_2);
+
+// the lookup and the vector handler do not log, they run for every
+// undefined instruction
+
+// the probes hold the out of line copies so they are allocated once
+// and never move while the operating system may be executing them
+prb_probe_t *prb_probes;
+
+// the out of line copies, the page is mapped executable into the
+// operating system paging system at prb_slots_va
+u32_t *prb_slots;
+tt_virtual_address_t prb_slots_va;
+
+// open addressed on the probed address
+prb_probe_t *prb_table[PRB_TABLE_SIZE];
+
+// probes are handed out round robin, see prb_remove
+size_t prb_next;
+
+// lets the undefined instruction path skip the lookup when nothing is probed
+size_t prb_count;
+
+// the sub-functions of PRB_CALL_IDENTIFIER indexed by r2
+call_function_t prb_call_functions[PRB_NUMBER_OF_FUNCTIONS];
+
+result_t prb_init(void) {
+
+	prb_probe_t **probes;
+	u32_t **slots;
+	tt_virtual_address_t *va;
+	tt_virtual_address_t tmp;
+	tt_physical_address_t pa;
+	call_function_t *functions;
+	size_t i;
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	CHECK(PRB_SLOTS_SIZE <= FOUR_KILOBYTES, "the slots do not fit in a page", PRB_SLOTS_SIZE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	probes = gen_add_base(&prb_probes);
+	slots = gen_add_base(&prb_slots);
+	va = gen_add_base(&prb_slots_va);
+
+	*probes = malloc(PRB_PROBES_SIZE * sizeof(prb_probe_t));
+
+	CHECK_NOT_NULL(*probes, "unable to allocate memory for the probes", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(*probes, 0, (PRB_PROBES_SIZE * sizeof(prb_probe_t)));
+
+	*slots = memalign(FOUR_KILOBYTES, FOUR_KILOBYTES);
+
+	CHECK_NOT_NULL(*slots, "unable to allocate memory for the slots", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(*slots, 0, FOUR_KILOBYTES);
+
+	tmp.all = (size_t)(*slots);
+
+	CHECK_SUCCESS(mmu_lookup_pa(tmp, &pa), "unable to lookup the pa of the slots", *slots, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// the operating system owns everything below 3 GB
+	va->all = ((u32_t)ONE_GIGABYTE * 3);
+
+	// the operating system executes the copies in the modes it hit the
+	// probes in, so the page is executable and not accessible from user mode
+	CHECK_SUCCESS(mmu_map(pa, FOUR_KILOBYTES, MMU_MAP_EXTERNAL | MMU_MAP_NORMAL_MEMORY | MMU_MAP_PRIVILEGED, va), "unable to map the slots", pa.all, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	for(i = 0; i < PRB_PROBES_SIZE; i++) {
+		(*probes)[i].slot = &((*slots)[i * PRB_SLOT_SIZE]);
+		(*probes)[i].slot_address = va->all + (i * PRB_SLOT_SIZE * sizeof(u32_t));
+	}
+	memset(gen_add_base(&prb_table), 0, sizeof(prb_table));
+
+	*(size_t *)gen_add_base(&prb_count) = 0;
+	*(size_t *)gen_add_base(&prb_next) = 0;
+
+	functions = gen_add_base(&prb_call_functions);
+
+	functions[PRB_FUNCTION_ADD] = gen_add_base(&prb_call_add_handler);
+	functions[PRB_FUNCTION_REMOVE] = gen_add_base(&prb_call_remove_handler);
+	functions[PRB_FUNCTION_HITS] = gen_add_base(&prb_call_hits_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(PRB_CALL_IDENTIFIER, functions, PRB_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// after call_dispatch so hypercalls never pay for the lookup
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&prb_vec_handler), NULL, VEC_HANDLER_PRIORITY_DEFAULT - 1, VEC_HANDLER_FLAG_TERMINAL), "unable to register the vec handler", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t prb_fini(void) {
+
+	prb_probe_t **probes;
+	size_t i;
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	probes = gen_add_base(&prb_probes);
+
+	// put the operating system code back before the handler goes away
+	for(i = 0; i < PRB_PROBES_SIZE; i++) {
+
+		if((*probes)[i].used == TRUE) {
+
+			CHECK_SUCCESS(prb_remove((*probes)[i].address), "unable to remove the probe", (*probes)[i].address, prb_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+		}
+	}
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&prb_vec_handler)), "unable to unregister the vec handler", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_unregister_handler_table(PRB_CALL_IDENTIFIER, gen_add_base(&prb_call_functions)), "unable to unregister the call handler", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(mmu_unmap(*(tt_virtual_address_t *)gen_add_base(&prb_slots_va), FOUR_KILOBYTES, MMU_MAP_EXTERNAL), "unable to unmap the slots", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	free(*(u32_t **)gen_add_base(&prb_slots));
+	*(u32_t **)gen_add_base(&prb_slots) = NULL;
+
+	free(*probes);
+	*probes = NULL;
+
+	return SUCCESS;
+}
+
+// the probe is published in the table before the instruction is replaced
+// so a cpu can never hit the undefined instruction without finding it.
+// only arm state code can be probed
+result_t prb_add(size_t address, prb_function_t function, void *data) {
+
+	prb_probe_t *probes;
+	prb_probe_t *probe;
+	prb_probe_t **table;
+	tt_virtual_address_t va;
+	size_t instruction;
+	size_t *next;
+	size_t index;
+	size_t i;
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	// bit 0 is the interworking bit, it is set on the addresses of thumb
+	// code. the out of line copy and prb_vec_handler only handle arm code
+	CHECK_EQUAL((address & 1), 0, "address is thumb code", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_EQUAL((address & (sizeof(u32_t) - 1)), 0, "address is not word aligned", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_FAILURE(prb_find(address, &index), "address is already probed", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// the address is an operating system address, it is looked at
+	// through its paging system
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_EQUAL((cpu_translate_address(address) & CPU_PAR_FAULT), 0, "address is not mapped", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// kernel code is only accessible from the privileged modes
+	CHECK_NOT_EQUAL((cpu_translate_user_address(address) & CPU_PAR_FAULT), 0, "address is accessible from user mode", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_probe_read(address, &instruction), "unable to read the instruction", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_TRUE(vec_instruction_is_relocatable(instruction), "instruction is not relocatable", instruction, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	probes = *(prb_probe_t **)gen_add_base(&prb_probes);
+	next = gen_add_base(&prb_next);
+
+	probe = NULL;
+
+	for(i = 0; i < PRB_PROBES_SIZE; i++) {
+
+		index = (*next + i) % PRB_PROBES_SIZE;
+
+		if(probes[index].used == FALSE) {
+			probe = &(probes[index]);
+			*next = index + 1;
+			break;
+		}
+	}
+
+	CHECK_NOT_NULL(probe, "no free probes", PRB_PROBES_SIZE, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	probe->slot[0] = instruction;
+	probe->slot[1] = PRB_LDR_PC_INSTRUCTION;
+	probe->slot[2] = address + sizeof(u32_t);
+	probe->address = address;
+	probe->instruction = instruction;
+	probe->function = function;
+	probe->data = data;
+	probe->hits = 0;
+	probe->used = TRUE;
+
+	// the operating system fetches the copy through its own mapping
+	cac_flush_cache_region(probe->slot, (PRB_SLOT_SIZE * sizeof(u32_t)));
+	cac_flush_cache_region((void *)(probe->slot_address), (PRB_SLOT_SIZE * sizeof(u32_t)));
+
+	table = gen_add_base(&prb_table);
+
+	index = ((address >> 2) * PRB_TABLE_HASH) >> (32 - PRB_TABLE_BITS);
+
+	for(i = 0; i < PRB_TABLE_SIZE; i++) {
+
+		if((table[index] == NULL) || (table[index] == PRB_TABLE_DELETED)) {
+			break;
+		}
+
+		index = (index + 1) & (PRB_TABLE_SIZE - 1);
+	}
+
+	// the table is twice the size of the probe array so this can not happen
+	CHECK_NOT_EQUAL(i, PRB_TABLE_SIZE, "the table is full", address, prb_dbg, DBG_LEVEL_2)
+		probe->used = FALSE;
+		return FAILURE;
+	CHECK_END
+
+	cpu_data_memory_barrier();
+
+	table[index] = probe;
+
+	(*(size_t *)gen_add_base(&prb_count))++;
+
+	va.all = address;
+
+	instruction = PRB_INSTRUCTION;
+
+	CHECK_SUCCESS(mmu_write_external(va, &instruction, sizeof(u32_t)), "unable to write the probe instruction", address, prb_dbg, DBG_LEVEL_2)
+		table[index] = PRB_TABLE_DELETED;
+		(*(size_t *)gen_add_base(&prb_count))--;
+		probe->used = FALSE;
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t prb_remove(size_t address) {
+
+	prb_probe_t **table;
+	prb_probe_t *probe;
+	tt_virtual_address_t va;
+	size_t index;
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(prb_find(address, &index), "address is not probed", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	table = gen_add_base(&prb_table);
+
+	probe = table[index];
+
+	va.all = address;
+
+	// the original instruction goes back first so no cpu can trap on a probe that is not in the table
+	CHECK_SUCCESS(mmu_write_external(va, &(probe->instruction), sizeof(u32_t)), "unable to restore the instruction", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	table[index] = PRB_TABLE_DELETED;
+
+	(*(size_t *)gen_add_base(&prb_count))--;
+
+	// a cpu may still be running the out of line copy, prb_add hands
+	// the probes out round robin so it is not reused straight away
+	probe->used = FALSE;
+
+	return SUCCESS;
+}
+
+result_t prb_find(size_t address, size_t *index) {
+
+	prb_probe_t **table;
+	prb_probe_t *probe;
+	size_t i;
+
+	table = gen_add_base(&prb_table);
+
+	*index = ((address >> 2) * PRB_TABLE_HASH) >> (32 - PRB_TABLE_BITS);
+
+	for(i = 0; i < PRB_TABLE_SIZE; i++) {
+
+		probe = table[*index];
+
+		if(probe == NULL) {
+			return FAILURE;
+		}
+
+		if((probe != PRB_TABLE_DELETED) && (probe->address == address)) {
+			return SUCCESS;
+		}
+
+		*index = (*index + 1) & (PRB_TABLE_SIZE - 1);
+	}
+
+	return FAILURE;
+}
+
+result_t prb_get_hits(size_t address, size_t *hits) {
+
+	size_t index;
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(prb_find(address, &index), "address is not probed", address, prb_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	*hits = ((prb_probe_t **)gen_add_base(&prb_table))[index]->hits;
+
+	return SUCCESS;
+}
+
+result_t prb_call_add_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	ldr_function_t *function;
+	prb_function_t callback;
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	callback = NULL;
+
+	// a null name places a probe that only counts hits
+	if(registers->r4 != (size_t)NULL) {
+
+		CHECK_SUCCESS(ldr_lookup_function((u8_t *)(registers->r4), &function), "unable to lookup the function", registers->r4, prb_dbg, DBG_LEVEL_2)
+			registers->r0 = FAILURE;
+			return SUCCESS;
+		CHECK_END
+
+		callback = (prb_function_t)(((size_t)function->pointer->address) + ((size_t)function->module->pointer));
+	}
+
+	CHECK_SUCCESS(prb_add(registers->r3, callback, (void *)(registers->r5)), "unable to add the probe", registers->r3, prb_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prb_call_remove_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prb_remove(registers->r3), "unable to remove the probe", registers->r3, prb_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prb_call_hits_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prb_get_hits(registers->r3, &(registers->r1)), "unable to get the hits", registers->r3, prb_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prb_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	prb_probe_t *probe;
+	gen_program_status_register_t spsr;
+	size_t index;
+
+	UNUSED_VARIABLE(handler);
+
+	if(*(size_t *)gen_add_base(&prb_count) == 0) {
+		return SUCCESS;
+	}
+
+	spsr = gen_get_spsr();
+
+	if((spsr.all & CPU_PSR_THUMB) != 0) {
+		return SUCCESS;
+	}
+
+	if(prb_find((registers->lr - PRB_UNDEFINED_INSTRUCTION_RETURN_ADJUSTMENT), &index) != SUCCESS) {
+		return SUCCESS;
+	}
+
+	probe = ((prb_probe_t **)gen_add_base(&prb_table))[index];
+
+	probe->hits++;
+
+	if(probe->function != NULL) {
+		probe->function(probe, registers);
+	}
+
+	// resume in the out of line copy, it jumps back to address + 4
+	registers->lr = probe->slot_address;
+
+	*handled = TRUE;
+
+	return SUCCESS;
+}
+
+result_t prb_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(prb_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t prb_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(prb_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(prb_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,481 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/mas.h>
+#include <kernel/prf.h>
+#include <kernel/rng.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(prf_dbg, DBG_LEVEL_2);
+
+// each cpu has its own ring and histogram so sampling never shares a cache line
+prf_cpu_t *prf_cpus[CPU_NUMBER_OF_CPUS];
+
+// zero while the profiler is stopped
+size_t prf_period;
+size_t prf_filter;
+
+// the sub-functions of PRF_CALL_IDENTIFIER indexed by r2
+call_function_t prf_call_functions[PRF_NUMBER_OF_FUNCTIONS];
+
+result_t prf_init(void) {
+
+	prf_cpu_t **cpus;
+	call_function_t *functions;
+	size_t i;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	*(size_t *)gen_add_base(&prf_period) = 0;
+	*(size_t *)gen_add_base(&prf_filter) = PRF_FILTER_NONE;
+
+	cpus = gen_add_base(&prf_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		cpus[i] = malloc(sizeof(prf_cpu_t));
+
+		CHECK_NOT_NULL(cpus[i], "unable to allocate memory for the cpu", i, prf_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(cpus[i], 0, sizeof(prf_cpu_t));
+
+		CHECK_SUCCESS(rng_init(&(cpus[i]->ring), sizeof(prf_sample_t), PRF_RING_SIZE), "unable to initialize the ring", i, prf_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+	}
+
+	functions = gen_add_base(&prf_call_functions);
+
+	functions[PRF_FUNCTION_START] = gen_add_base(&prf_call_start_handler);
+	functions[PRF_FUNCTION_STOP] = gen_add_base(&prf_call_stop_handler);
+	functions[PRF_FUNCTION_READ] = gen_add_base(&prf_call_read_handler);
+	functions[PRF_FUNCTION_HISTOGRAM] = gen_add_base(&prf_call_histogram_handler);
+	functions[PRF_FUNCTION_STATISTICS] = gen_add_base(&prf_call_statistics_handler);
+	functions[PRF_FUNCTION_RESET] = gen_add_base(&prf_call_reset_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(PRF_CALL_IDENTIFIER, functions, PRF_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// sample before any handler can claim the interrupt, the profiler never claims it
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&prf_vec_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST, VEC_HANDLER_FLAG_NONE), "unable to register the vec handler", FAILURE, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t prf_fini(void) {
+
+	prf_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&prf_vec_handler)), "unable to unregister the vec handler", FAILURE, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_unregister_handler_table(PRF_CALL_IDENTIFIER, gen_add_base(&prf_call_functions)), "unable to unregister the call handler", FAILURE, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpus = gen_add_base(&prf_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] != NULL) {
+			rng_fini(&(cpus[i]->ring));
+			free(cpus[i]);
+			cpus[i] = NULL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+// a period of one samples every interrupt. the timer filter reads the
+// generic timer registers and needs the generic timer extension
+result_t prf_start(size_t period, size_t filter) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_EQUAL(period, 0, "period is zero", period, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK((filter == PRF_FILTER_NONE) || (filter == PRF_FILTER_TIMER), "unknown filter", filter, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// the a8 and a9 have no generic timer, reading its registers there
+	// is undefined
+	CHECK((filter != PRF_FILTER_TIMER) || (cpu_has_generic_timer() == TRUE), "the timer filter needs the generic timer", filter, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	*(size_t *)gen_add_base(&prf_filter) = filter;
+
+	// the period is written last as it is what turns the sampling on
+	cpu_data_memory_barrier();
+
+	*(size_t *)gen_add_base(&prf_period) = period;
+
+	return SUCCESS;
+}
+
+result_t prf_stop(void) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	*(size_t *)gen_add_base(&prf_period) = 0;
+
+	return SUCCESS;
+}
+
+// the samples and histograms are written by every cpu, they are
+// only cleared while the profiler is stopped
+result_t prf_reset(void) {
+
+	prf_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	CHECK_EQUAL(*(size_t *)gen_add_base(&prf_period), 0, "the profiler is running", FAILURE, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpus = gen_add_base(&prf_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] == NULL) {
+			continue;
+		}
+
+		// a reader on another cpu may be taking a sample
+		rng_reset(&(cpus[i]->ring));
+
+		cpus[i]->interrupts = 0;
+		cpus[i]->samples = 0;
+		cpus[i]->missed = 0;
+
+		memset(cpus[i]->histogram, 0, sizeof(cpus[i]->histogram));
+	}
+
+	return SUCCESS;
+}
+
+// the rings have a single consumer, only one reader may drain a cpu at a time
+result_t prf_read(size_t cpu, prf_sample_t *sample) {
+
+	prf_cpu_t *state;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((prf_cpu_t **)gen_add_base(&prf_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// an empty ring is not an error worth logging
+	return rng_get(&(state->ring), sample);
+}
+
+result_t prf_get_bucket(size_t cpu, size_t index, prf_bucket_t *bucket) {
+
+	prf_cpu_t *state;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK(index < PRF_HISTOGRAM_SIZE, "index is out of range", index, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((prf_cpu_t **)gen_add_base(&prf_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(bucket, &(state->histogram[index]), sizeof(prf_bucket_t));
+
+	return SUCCESS;
+}
+
+result_t prf_get_statistics(size_t cpu, size_t *samples, size_t *depth, size_t *dropped, size_t *missed) {
+
+	prf_cpu_t *state;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((prf_cpu_t **)gen_add_base(&prf_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, prf_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	*samples = state->samples;
+	*depth = rng_get_depth(&(state->ring));
+	*dropped = state->ring.dropped;
+	*missed = state->missed;
+
+	return SUCCESS;
+}
+
+result_t prf_call_start_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prf_start(registers->r3, registers->r4), "unable to start the profiler", registers->r3, prf_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prf_call_stop_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prf_stop(), "unable to stop the profiler", FAILURE, prf_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prf_call_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	prf_sample_t sample;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	if(prf_read(registers->r3, &sample) != SUCCESS) {
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	}
+
+	memcpy(&(registers->r1), &sample, sizeof(prf_sample_t));
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prf_call_histogram_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	prf_bucket_t bucket;
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prf_get_bucket(registers->r3, registers->r4, &bucket), "unable to get the bucket", registers->r4, prf_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r1 = bucket.address;
+	registers->r2 = bucket.count;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prf_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prf_get_statistics(registers->r3, &(registers->r1), &(registers->r2), &(registers->r3), &(registers->r4)), "unable to get the statistics", registers->r3, prf_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prf_call_reset_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(prf_reset(), "unable to reset the profiler", FAILURE, prf_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t prf_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	prf_cpu_t *state;
+	prf_sample_t sample;
+	prf_bucket_t *bucket;
+	gen_program_status_register_t spsr;
+	size_t period;
+	size_t control;
+	size_t address;
+	size_t index;
+	size_t cpu;
+	size_t i;
+
+	// no logging, this is on the interrupt path
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+
+	period = *(size_t *)gen_add_base(&prf_period);
+
+	if(period == 0) {
+		return SUCCESS;
+	}
+
+	cpu = cpu_get_id();
+
+	state = ((prf_cpu_t **)gen_add_base(&prf_cpus))[cpu];
+
+	if(state == NULL) {
+		return SUCCESS;
+	}
+
+	if(*(size_t *)gen_add_base(&prf_filter) == PRF_FILTER_TIMER) {
+
+		// a timer is asserting its interrupt when it is enabled,
+		// its condition is met and its output is not masked
+		control = cpu_get_virtual_timer_control();
+
+		if((control & (CPU_TIMER_CONTROL_ENABLE | CPU_TIMER_CONTROL_IMASK | CPU_TIMER_CONTROL_ISTATUS)) != (CPU_TIMER_CONTROL_ENABLE | CPU_TIMER_CONTROL_ISTATUS)) {
+
+			control = cpu_get_physical_timer_control();
+
+			if((control & (CPU_TIMER_CONTROL_ENABLE | CPU_TIMER_CONTROL_IMASK | CPU_TIMER_CONTROL_ISTATUS)) != (CPU_TIMER_CONTROL_ENABLE | CPU_TIMER_CONTROL_ISTATUS)) {
+				return SUCCESS;
+			}
+		}
+	}
+
+	state->interrupts++;
+
+	if(state->interrupts < period) {
+		return SUCCESS;
+	}
+
+	state->interrupts = 0;
+	state->samples++;
+
+	spsr = gen_get_spsr();
+
+	sample.pc = registers->lr - PRF_IRQ_RETURN_ADJUSTMENT;
+	sample.spsr = spsr.all;
+	sample.cycles = cpu_get_cycle_count();
+	sample.cpu = cpu;
+
+	// a full ring drops the sample and counts it, the histogram still gets it
+	rng_put(&(state->ring), &sample);
+
+	address = sample.pc & ~((1 << PRF_HISTOGRAM_SHIFT) - 1);
+	index = ((address >> PRF_HISTOGRAM_SHIFT) * PRF_HISTOGRAM_HASH) >> (32 - PRF_HISTOGRAM_BITS);
+
+	for(i = 0; i < PRF_HISTOGRAM_PROBES; i++) {
+
+		bucket = &(state->histogram[(index + i) & (PRF_HISTOGRAM_SIZE - 1)]);
+
+		if(bucket->count == 0) {
+			bucket->address = address;
+		}
+
+		if(bucket->address == address) {
+			bucket->count++;
+			return SUCCESS;
+		}
+	}
+
+	state->missed++;
+
+	return SUCCESS;
+}
+
+result_t prf_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(prf_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t prf_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(prf_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(prf_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,190 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/cpu.h>
+#include <kernel/mas.h>
+#include <kernel/rng.h>
+
+DBG_DEFINE_VARIABLE(rng_dbg, DBG_LEVEL_2);
+
+result_t rng_init(rng_t *ring, size_t size, size_t count) {
+
+	DBG_LOG_FUNCTION(rng_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(ring, "ring is null", ring, rng_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK((count != 0) && ((count & (count - 1)) == 0), "count is not a power of two", count, rng_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memset(ring, 0, sizeof(rng_t));
+
+	ring->buffer = malloc(size * count);
+
+	CHECK_NOT_NULL(ring->buffer, "unable to allocate memory for the buffer", size * count, rng_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	ring->size = size;
+	ring->count = count;
+
+	return SUCCESS;
+}
+
+result_t rng_fini(rng_t *ring) {
+
+	DBG_LOG_FUNCTION(rng_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(ring, "ring is null", ring, rng_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	if(ring->buffer != NULL) {
+		free(ring->buffer);
+	}
+
+	memset(ring, 0, sizeof(rng_t));
+
+	return SUCCESS;
+}
+
+// rng_put and rng_get are called from exception handlers and
+// the log so they intentionally do not log anything themselves
+
+// a producer can be interrupted by another one on the same cpu, an fiq
+// or an abort that queues work of its own, so the slots are claimed with
+// ldrex/strex. head is only moved once every claimed slot has been
+// written, by whichever producer finishes last. one that finds a slot
+// before its own still being written leaves that producer to publish
+// its record as well
+result_t rng_put(rng_t *ring, void *record) {
+
+	size_t reserved;
+	size_t written;
+	size_t head;
+
+	do {
+		reserved = ring->reserved;
+
+		if((reserved - ring->tail) >= ring->count) {
+			cpu_atomic_add(&(ring->dropped), 1);
+			return FAILURE;
+		}
+	} while(cpu_atomic_compare_and_swap((size_t *)&(ring->reserved), reserved, (reserved + 1)) != reserved);
+
+	memcpy(&(ring->buffer[(reserved & (ring->count - 1)) * ring->size]), record, ring->size);
+
+	// the record has to be visible before the consumer sees the new head
+	cpu_data_memory_barrier();
+
+	cpu_atomic_add((size_t *)&(ring->written), 1);
+
+	cpu_data_memory_barrier();
+
+	reserved = ring->reserved;
+	written = ring->written;
+
+	if(written != reserved) {
+		return SUCCESS;
+	}
+
+	// a producer that interrupted this one may have published already
+	head = ring->head;
+
+	if((head != reserved) && ((reserved - head) <= ring->count)) {
+		cpu_atomic_compare_and_swap((size_t *)&(ring->head), head, reserved);
+	}
+
+	return SUCCESS;
+}
+
+result_t rng_get(rng_t *ring, void *record) {
+
+	size_t tail;
+
+	do {
+
+		tail = ring->tail;
+
+		if(tail == ring->head) {
+			return FAILURE;
+		}
+
+		// do not read the record before the head that published it
+		cpu_data_memory_barrier();
+
+		memcpy(record, &(ring->buffer[(tail & (ring->count - 1)) * ring->size]), ring->size);
+
+		// the record has to be copied out before the producer can reuse the slot
+		cpu_data_memory_barrier();
+
+		// another reader took the record first, the copy may be torn
+	} while(cpu_atomic_compare_and_swap((size_t *)&(ring->tail), tail, (tail + 1)) != tail);
+
+	return SUCCESS;
+}
+
+// drops every published record, safe against the readers but not
+// against a producer that is still publishing
+result_t rng_reset(rng_t *ring) {
+
+	size_t tail;
+
+	do {
+		tail = ring->tail;
+	} while(cpu_atomic_compare_and_swap((size_t *)&(ring->tail), tail, ring->head) != tail);
+
+	ring->dropped = 0;
+
+	return SUCCESS;
+}
+
+size_t rng_get_depth(rng_t *ring) {
+
+	return (ring->head - ring->tail);
+}
+
+result_t rng_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(rng_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(rng_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t rng_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(rng_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(rng_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,399 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/mas.h>
+#include <kernel/rng.h>
+#include <kernel/sct.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(sct_dbg, DBG_LEVEL_2);
+
+// each cpu has its own counters and ring so the svc path never shares a cache line
+sct_cpu_t *sct_cpus[CPU_NUMBER_OF_CPUS];
+
+// one bit per system call number, set bits also write trace records
+u32_t sct_records[SCT_NUMBER_OF_SYSTEM_CALLS / 32];
+
+// the sub-functions of SCT_CALL_IDENTIFIER indexed by r2
+call_function_t sct_call_functions[SCT_NUMBER_OF_FUNCTIONS];
+
+result_t sct_init(void) {
+
+	sct_cpu_t **cpus;
+	call_function_t *functions;
+	size_t i;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	cpus = gen_add_base(&sct_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		cpus[i] = malloc(sizeof(sct_cpu_t));
+
+		CHECK_NOT_NULL(cpus[i], "unable to allocate memory for the cpu", i, sct_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		memset(cpus[i], 0, sizeof(sct_cpu_t));
+
+		CHECK_SUCCESS(rng_init(&(cpus[i]->ring), sizeof(sct_record_t), SCT_RING_SIZE), "unable to initialize the ring", i, sct_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+	}
+
+	memset(gen_add_base(&sct_records), 0, sizeof(sct_records));
+
+	functions = gen_add_base(&sct_call_functions);
+
+	functions[SCT_FUNCTION_TRACE] = gen_add_base(&sct_call_trace_handler);
+	functions[SCT_FUNCTION_UNTRACE] = gen_add_base(&sct_call_untrace_handler);
+	functions[SCT_FUNCTION_COUNT] = gen_add_base(&sct_call_count_handler);
+	functions[SCT_FUNCTION_READ] = gen_add_base(&sct_call_read_handler);
+	functions[SCT_FUNCTION_STATISTICS] = gen_add_base(&sct_call_statistics_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(SCT_CALL_IDENTIFIER, functions, SCT_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// the tracer only observes, it never claims the system call. it only
+	// needs the system calls it selects, nothing is traced until it is
+	// asked for. the other svc handlers still see every system call
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_SUPERVISOR_CALL_VECTOR, gen_add_base(&sct_vec_handler), NULL, VEC_HANDLER_PRIORITY_HIGHEST, VEC_HANDLER_FLAG_SELECTED), "unable to register the vec handler", FAILURE, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t sct_fini(void) {
+
+	sct_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_SUPERVISOR_CALL_VECTOR, gen_add_base(&sct_vec_handler)), "unable to unregister the vec handler", FAILURE, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_unregister_handler_table(SCT_CALL_IDENTIFIER, gen_add_base(&sct_call_functions)), "unable to unregister the call handler", FAILURE, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drop the selection of the tracer
+	CHECK_SUCCESS(vec_set_svc_dispatch_all(FALSE), "unable to clear the svc selection", FAILURE, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpus = gen_add_base(&sct_cpus);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] != NULL) {
+			rng_fini(&(cpus[i]->ring));
+			free(cpus[i]);
+			cpus[i] = NULL;
+		}
+	}
+
+	return SUCCESS;
+}
+
+result_t sct_trace(size_t number, bool_t record) {
+
+	u32_t *records;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	CHECK(number < SCT_NUMBER_OF_SYSTEM_CALLS, "number is out of range", number, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	records = gen_add_base(&sct_records);
+
+	if(record == TRUE) {
+		records[number / 32] |= (1 << (number % 32));
+	}
+	else {
+		records[number / 32] &= ~(1 << (number % 32));
+	}
+
+	CHECK_SUCCESS(vec_set_svc_dispatch(number, TRUE), "unable to select the system call", number, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+result_t sct_untrace(size_t number) {
+
+	u32_t *records;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	CHECK(number < SCT_NUMBER_OF_SYSTEM_CALLS, "number is out of range", number, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_set_svc_dispatch(number, FALSE), "unable to deselect the system call", number, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	records = gen_add_base(&sct_records);
+
+	records[number / 32] &= ~(1 << (number % 32));
+
+	return SUCCESS;
+}
+
+result_t sct_get_count(size_t number, size_t *count) {
+
+	sct_cpu_t **cpus;
+	size_t i;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	CHECK(number < SCT_NUMBER_OF_SYSTEM_CALLS, "number is out of range", number, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpus = gen_add_base(&sct_cpus);
+
+	*count = 0;
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(cpus[i] != NULL) {
+			*count += cpus[i]->counts[number];
+		}
+	}
+
+	return SUCCESS;
+}
+
+// the rings have a single consumer, only one reader may drain a cpu at a time
+result_t sct_read(size_t cpu, sct_record_t *record) {
+
+	sct_cpu_t *state;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((sct_cpu_t **)gen_add_base(&sct_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// an empty ring is not an error worth logging
+	return rng_get(&(state->ring), record);
+}
+
+result_t sct_get_statistics(size_t cpu, size_t *depth, size_t *dropped, size_t *other) {
+
+	sct_cpu_t *state;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	CHECK(cpu < CPU_NUMBER_OF_CPUS, "cpu is out of range", cpu, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	state = ((sct_cpu_t **)gen_add_base(&sct_cpus))[cpu];
+
+	CHECK_NOT_NULL(state, "cpu state is null", cpu, sct_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	*depth = rng_get_depth(&(state->ring));
+	*dropped = state->ring.dropped;
+	*other = state->other;
+
+	return SUCCESS;
+}
+
+result_t sct_call_trace_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(sct_trace(registers->r3, (registers->r4 == TRUE) ? TRUE : FALSE), "unable to trace the system call", registers->r3, sct_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t sct_call_untrace_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(sct_untrace(registers->r3), "unable to untrace the system call", registers->r3, sct_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t sct_call_count_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(sct_get_count(registers->r3, &(registers->r1)), "unable to get the count", registers->r3, sct_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t sct_call_read_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	sct_record_t record;
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	if(sct_read(registers->r3, &record) != SUCCESS) {
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	}
+
+	memcpy(&(registers->r1), &record, sizeof(sct_record_t));
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t sct_call_statistics_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(sct_get_statistics(registers->r3, &(registers->r1), &(registers->r2), &(registers->r3)), "unable to get the statistics", registers->r3, sct_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+// the selected system calls and the numbers past the end of the bitmap
+// get here, every system call does while an svc handler is registered
+// without VEC_HANDLER_FLAG_SELECTED
+result_t sct_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	sct_cpu_t *state;
+	sct_record_t record;
+	size_t number;
+	size_t cpu;
+
+	// no logging, this is on the system call path
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+
+	cpu = cpu_get_id();
+
+	state = ((sct_cpu_t **)gen_add_base(&sct_cpus))[cpu];
+
+	if(state == NULL) {
+		return SUCCESS;
+	}
+
+	number = registers->VEC_SVC_NUMBER_REGISTER;
+
+	if(number >= SCT_NUMBER_OF_SYSTEM_CALLS) {
+		state->other++;
+		return SUCCESS;
+	}
+
+	if((((u32_t *)gen_add_base(&vec_svc_selected))[number / 32] & (1 << (number % 32))) == 0) {
+		return SUCCESS;
+	}
+
+	state->counts[number]++;
+
+	if((((u32_t *)gen_add_base(&sct_records))[number / 32] & (1 << (number % 32))) != 0) {
+
+		record.number = number;
+		record.arguments[0] = registers->r0;
+		record.arguments[1] = registers->r1;
+		record.arguments[2] = registers->r2;
+		record.arguments[3] = registers->r3;
+		record.cycles = cpu_get_cycle_count();
+		record.cpu = cpu;
+
+		// a full ring drops the record and counts it
+		rng_put(&(state->ring), &record);
+	}
+
+	return SUCCESS;
+}
+
+result_t sct_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(sct_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t sct_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(sct_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(sct_dbg, level);
+
+	return SUCCESS;
+}
@@ -23,7 +23,10 @@
 #include <types.h>
 
 #include <kernel/config.h>
+#include <kernel/abt.h>
 #include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
 #include <kernel/start.h>
 #include <kernel/end.h>
 #include <kernel/mas.h>
@@ -31,6 +34,15 @@
 #include <kernel/vec.h>
 #include <kernel/ldr.h>
 #include <kernel/log.h>
+#include <kernel/sct.h>
+#include <kernel/prf.h>
+#include <kernel/pft.h>
+#include <kernel/prb.h>
+#include <kernel/hok.h>
+#include <kernel/chn.h>
+#include <kernel/asy.h>
+#include <kernel/utx.h>
+#include <kernel/trc.h>
 #include <kernel/version.h>
 
 #include <armv7lib/gen.h>
@@ -76,6 +88,10 @@ result_t start_c() {
 	CHECK_SUCCESS(mem_init(), "failed to initialize the memory log", FAILURE, start_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
+
+	CHECK_SUCCESS(log_ring_init(), "failed to initialize the log ring", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
 	#endif //__MEMORY_DEBUG__
 
 	DBG_LOG_STATEMENT("[+] memory log initialized", SUCCESS, start_dbg, DBG_LEVEL_2);
@@ -236,6 +252,11 @@ result_t start_run(void) {
 	//   END DEBUG BRING UP   //
 	//------------------------//
 
+	// the cycle counter is used by vec and call to measure the handlers
+	CHECK_SUCCESS(cpu_init(), "unable to initialize the cpu subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	CHECK_SUCCESS(vec_init(), "unable to initialize the vector handling subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
@@ -254,7 +275,7 @@ result_t start_run(void) {
 		return FAILURE;
 	CHECK_END
 
-	CHECK_SUCCESS(vec_register_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&call_dispatch), NULL), "unable to register the vec call handler", FAILURE, start_dbg, DBG_LEVEL_2)
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&call_dispatch), NULL, VEC_HANDLER_PRIORITY_DEFAULT, VEC_HANDLER_FLAG_TERMINAL), "unable to register the vec call handler", FAILURE, start_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
@@ -266,6 +287,75 @@ result_t start_run(void) {
 
 	DBG_LOG_STATEMENT("[+] initialized the log subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
 
+	CHECK_SUCCESS(dfr_init(), "unable to initialize the deferred work subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the deferred work subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(abt_init(), "unable to initialize the abort subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the abort subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(sct_init(), "unable to initialize the system call tracer subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the system call tracer subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(prf_init(), "unable to initialize the profiler subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the profiler subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(pft_init(), "unable to initialize the page fault tracer subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the page fault tracer subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(prb_init(), "unable to initialize the probe subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the probe subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(hok_init(), "unable to initialize the hook subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the hook subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(chn_init(), "unable to initialize the channel subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the channel subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(asy_init(), "unable to initialize the asynchronous call subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the asynchronous call subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
+	// the log waits on the serial port until here
+	#ifdef __SERIAL_DEBUG__
+	CHECK_SUCCESS(utx_init(), "unable to initialize the serial transmit subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the serial transmit subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+	#endif //__SERIAL_DEBUG__
+
+	CHECK_SUCCESS(trc_init(), "unable to initialize the tracepoint subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("[+] initialized the tracepoint subsystem", SUCCESS, start_dbg, DBG_LEVEL_2);
+
 	CHECK_SUCCESS(ldr_init(), "unable to initialize the loader subsystem", FAILURE, start_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
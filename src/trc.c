@@ -0,0 +1,290 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <armv7lib/gen.h>
+#include <armv7lib/cmsa/cac.h>
+
+#include <dbglib/gen.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/trc.h>
+
+DBG_DEFINE_VARIABLE(trc_dbg, DBG_LEVEL_2);
+
+// the sub-functions of TRC_CALL_IDENTIFIER indexed by r2
+call_function_t trc_call_functions[TRC_NUMBER_OF_FUNCTIONS];
+
+result_t trc_init(void) {
+
+	trc_point_t *point;
+	call_function_t *functions;
+	size_t count;
+	size_t i;
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	count = trc_get_count();
+
+	for(i = 0; i < count; i++) {
+
+		trc_get_point(i, &point);
+
+		CHECK_EQUAL(*(u32_t *)gen_add_base((void *)(point->site)), TRC_NOP_INSTRUCTION, "tracepoint is not a nop", point->site, trc_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		point->enabled = FALSE;
+		point->hits = 0;
+	}
+
+	functions = gen_add_base(&trc_call_functions);
+
+	functions[TRC_FUNCTION_LIST] = gen_add_base(&trc_call_list_handler);
+	functions[TRC_FUNCTION_ENABLE] = gen_add_base(&trc_call_enable_handler);
+	functions[TRC_FUNCTION_DISABLE] = gen_add_base(&trc_call_disable_handler);
+
+	CHECK_SUCCESS(call_register_handler_table(TRC_CALL_IDENTIFIER, functions, TRC_NUMBER_OF_FUNCTIONS, NULL), "unable to register the call handler", FAILURE, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	DBG_LOG_STATEMENT("tracepoints", count, trc_dbg, DBG_LEVEL_2);
+
+	return SUCCESS;
+}
+
+result_t trc_fini(void) {
+
+	size_t count;
+	size_t i;
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	count = trc_get_count();
+
+	// put the nops back before trc_dispatch can go away
+	for(i = 0; i < count; i++) {
+
+		CHECK_SUCCESS(trc_disable(i), "unable to disable the tracepoint", i, trc_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+	}
+
+	CHECK_SUCCESS(call_unregister_handler_table(TRC_CALL_IDENTIFIER, gen_add_base(&trc_call_functions)), "unable to unregister the call handler", FAILURE, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	return SUCCESS;
+}
+
+size_t trc_get_count(void) {
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	return (((size_t)gen_add_base(__stop_trc_points)) - ((size_t)gen_add_base(__start_trc_points))) / sizeof(trc_point_t);
+}
+
+result_t trc_get_point(size_t index, trc_point_t **point) {
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	CHECK(index < trc_get_count(), "index is out of range", index, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	*point = &(((trc_point_t *)gen_add_base(__start_trc_points))[index]);
+
+	return SUCCESS;
+}
+
+result_t trc_enable(size_t index) {
+
+	trc_point_t *point;
+	size_t offset;
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(trc_get_point(index, &point), "unable to get the tracepoint", index, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	if(point->enabled == TRUE) {
+		return SUCCESS;
+	}
+
+	// both addresses move with the base so the offset is fixed
+	offset = (((size_t)gen_add_base((void *)(point->stub))) - (((size_t)gen_add_base((void *)(point->site))) + TRC_BL_PC_OFFSET)) >> 2;
+
+	CHECK_SUCCESS(trc_set_site(point, (TRC_BL_INSTRUCTION | (offset & TRC_BL_OFFSET_MASK))), "unable to patch the tracepoint", index, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	point->enabled = TRUE;
+
+	return SUCCESS;
+}
+
+result_t trc_disable(size_t index) {
+
+	trc_point_t *point;
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(trc_get_point(index, &point), "unable to get the tracepoint", index, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	if(point->enabled == FALSE) {
+		return SUCCESS;
+	}
+
+	CHECK_SUCCESS(trc_set_site(point, TRC_NOP_INSTRUCTION), "unable to restore the tracepoint", index, trc_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	point->enabled = FALSE;
+
+	return SUCCESS;
+}
+
+// the architecture allows a nop and a bl to be swapped while another cpu
+// executes them, that cpu sees either the old or the new instruction
+result_t trc_set_site(trc_point_t *point, u32_t instruction) {
+
+	u32_t *site;
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	site = gen_add_base((void *)(point->site));
+
+	*site = instruction;
+
+	cac_clean_data_cache_region(site, sizeof(u32_t));
+	cac_invalidate_instruction_cache_region(site, sizeof(u32_t));
+
+	return SUCCESS;
+}
+
+// called by trc_trampoline on every hit of an enabled tracepoint, the
+// sites are in the allocator and the dispatcher so all it does is count
+void trc_dispatch(trc_point_t *point) {
+	cpu_atomic_add(&(point->hits), 1);
+}
+
+result_t trc_call_list_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	trc_point_t *point;
+	trc_record_t *records;
+	u8_t *name;
+	size_t count;
+	size_t i, j;
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	records = (trc_record_t *)(registers->r3);
+	count = trc_get_count();
+
+	CHECK_NOT_NULL(records, "records is null", registers->r3, trc_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	for(i = 0; (i < registers->r4) && ((registers->r5 + i) < count); i++) {
+
+		trc_get_point((registers->r5 + i), &point);
+
+		records[i].index = registers->r5 + i;
+		records[i].enabled = point->enabled;
+		records[i].hits = point->hits;
+
+		name = gen_add_base((void *)(point->name));
+
+		for(j = 0; (j < (TRC_NAME_SIZE - 1)) && (name[j] != '\0'); j++) {
+			records[i].name[j] = name[j];
+		}
+
+		records[i].name[j] = '\0';
+	}
+
+	registers->r1 = i;
+	registers->r2 = count;
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t trc_call_enable_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(trc_enable(registers->r3), "unable to enable the tracepoint", registers->r3, trc_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t trc_call_disable_handler(call_handler_t *handler, void *data, gen_general_purpose_registers_t *registers) {
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(data);
+
+	CHECK_SUCCESS(trc_disable(registers->r3), "unable to disable the tracepoint", registers->r3, trc_dbg, DBG_LEVEL_2)
+		registers->r0 = FAILURE;
+		return SUCCESS;
+	CHECK_END
+
+	registers->r0 = SUCCESS;
+	return SUCCESS;
+}
+
+result_t trc_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(trc_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t trc_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(trc_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(trc_dbg, level);
+
+	return SUCCESS;
+}
@@ -0,0 +1,273 @@
+/* This file is part of VERTIGO.
+ *
+ * (C) Copyright 2013, Siege Technologies <http://www.siegetechnologies.com>
+ * (C) Copyright 2013, Kirk Swidowski <http://www.swidowski.com>
+ *
+ * VERTIGO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * VERTIGO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with VERTIGO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <defines.h>
+#include <types.h>
+
+#include <dbglib/gen.h>
+#include <dbglib/ser.h>
+#include <fxplib/gen.h>
+#include <stdlib/check.h>
+#include <stdlib/string.h>
+
+#include <kernel/call.h>
+#include <kernel/cpu.h>
+#include <kernel/utx.h>
+#include <kernel/vec.h>
+
+DBG_DEFINE_VARIABLE(utx_dbg, DBG_LEVEL_2);
+
+// utx_write, the drain and the handlers do not log, the log writes
+// through them and the leaf and the handler run on the exception path
+
+utx_queue_t utx_queue;
+
+// the log is written before utx_init, until then utx_write blocks on ser_write
+bool_t utx_started = FALSE;
+
+result_t utx_init(void) {
+
+	utx_queue_t *queue;
+
+	DBG_LOG_FUNCTION(utx_dbg, DBG_LEVEL_3);
+
+	queue = gen_add_base(&utx_queue);
+
+	memset(queue, 0, sizeof(utx_queue_t));
+
+	// the serial port is mapped at the same address in both paging systems
+	CHECK_NOT_NULL(ser_get_virtual_address(), "the serial port is not mapped", FAILURE, utx_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drain ahead of call_dispatch because it terminates the chain
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&utx_vec_handler), NULL, VEC_HANDLER_PRIORITY_DEFAULT + 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec call handler", FAILURE, utx_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	// drain after every other interrupt handler has had a chance to claim
+	// the interrupt, with __UTX_OWNS_UART__ this includes the transmit
+	// interrupt of the uart
+	CHECK_SUCCESS(vec_register_priority_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&utx_vec_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST + 1, VEC_HANDLER_FLAG_NONE), "unable to register the vec interrupt handler", FAILURE, utx_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(call_register_leaf(UTX_LEAF_DROPPED, gen_add_base(&utx_leaf_dropped)), "unable to register the dropped leaf", FAILURE, utx_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	cpu_data_memory_barrier();
+
+	*(bool_t *)gen_add_base(&utx_started) = TRUE;
+
+	return SUCCESS;
+}
+
+// sends what is left with the uart busy waiting, the log goes back to ser_write
+result_t utx_fini(void) {
+
+	utx_queue_t *queue;
+
+	DBG_LOG_FUNCTION(utx_dbg, DBG_LEVEL_3);
+
+	queue = gen_add_base(&utx_queue);
+
+	call_unregister_leaf(UTX_LEAF_DROPPED, gen_add_base(&utx_leaf_dropped));
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_INTERRUPT_VECTOR, gen_add_base(&utx_vec_handler)), "unable to unregister the vec interrupt handler", FAILURE, utx_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_unregister_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(&utx_vec_handler)), "unable to unregister the vec call handler", FAILURE, utx_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	while(queue->tail != queue->head) {
+
+		if(utx_drain(UTX_DRAIN_LIMIT) == 0) {
+
+			// an entry that is claimed but not written yet
+			if((queue->entries[queue->tail & (UTX_QUEUE_SIZE - 1)] & UTX_ENTRY_VALID) == 0) {
+				break;
+			}
+		}
+	}
+
+	*(bool_t *)gen_add_base(&utx_started) = FALSE;
+
+	#ifdef __UTX_OWNS_UART__
+	*(volatile u32_t *)(((size_t)ser_get_virtual_address()) + UTX_PL011_IMSC) &= ~UTX_PL011_INT_TX;
+	#endif //__UTX_OWNS_UART__
+
+	DBG_LOG_STATEMENT("bytes dropped", queue->dropped, utx_dbg, DBG_LEVEL_2);
+
+	return SUCCESS;
+}
+
+// queues the bytes and moves what fits into the fifo, it never waits on
+// the uart. when the queue does not have room for all of the bytes none
+// are queued and they are counted as dropped
+result_t utx_write(u8_t *buffer, size_t size) {
+
+	utx_queue_t *queue;
+	size_t head;
+	size_t i;
+
+	if(*(bool_t *)gen_add_base(&utx_started) == FALSE) {
+		return ser_write(buffer, size);
+	}
+
+	queue = gen_add_base(&utx_queue);
+
+	do {
+
+		head = queue->head;
+
+		if((size > UTX_QUEUE_SIZE) || ((head - queue->tail) > (UTX_QUEUE_SIZE - size))) {
+			cpu_atomic_add(&(queue->dropped), size);
+			return SUCCESS;
+		}
+
+	} while(cpu_atomic_compare_and_swap(&(queue->head), head, (head + size)) != head);
+
+	for(i = 0; i < size; i++) {
+		queue->entries[(head + i) & (UTX_QUEUE_SIZE - 1)] = UTX_ENTRY_VALID | buffer[i];
+	}
+
+	cpu_data_memory_barrier();
+
+	utx_drain(UTX_DRAIN_LIMIT);
+
+	return SUCCESS;
+}
+
+// moves up to limit bytes into the fifo, stopping when it is full or at
+// an entry that has not been written yet. only one drain runs at a time,
+// any other returns straight away. the uart belongs to the operating
+// system so the queue is polled from the writes, the hypercalls and the
+// interrupts. only when __UTX_OWNS_UART__ is defined the transmit
+// interrupt stays unmasked while bytes are left so the fifo empty
+// interrupt drains the rest
+size_t utx_drain(size_t limit) {
+
+	utx_queue_t *queue;
+	size_t base;
+	size_t count;
+	u16_t entry;
+
+	queue = gen_add_base(&utx_queue);
+
+	if(cpu_atomic_compare_and_swap(&(queue->draining), FALSE, TRUE) != FALSE) {
+		return 0;
+	}
+
+	base = (size_t)ser_get_virtual_address();
+
+	for(count = 0; (count < limit) && (queue->tail != queue->head); count++) {
+
+		if((*(volatile u32_t *)(base + UTX_PL011_FR) & UTX_PL011_FR_TXFF) != 0) {
+			break;
+		}
+
+		entry = ((volatile u16_t *)(queue->entries))[queue->tail & (UTX_QUEUE_SIZE - 1)];
+
+		if((entry & UTX_ENTRY_VALID) == 0) {
+			break;
+		}
+
+		*(volatile u32_t *)(base + UTX_PL011_DR) = (entry & 0xFF);
+
+		queue->entries[queue->tail & (UTX_QUEUE_SIZE - 1)] = 0;
+
+		// the entry is clear before a producer can claim it again
+		cpu_data_memory_barrier();
+
+		queue->tail++;
+	}
+
+	#ifdef __UTX_OWNS_UART__
+	if(queue->tail != queue->head) {
+		*(volatile u32_t *)(base + UTX_PL011_IMSC) |= UTX_PL011_INT_TX;
+	}
+	else {
+		*(volatile u32_t *)(base + UTX_PL011_IMSC) &= ~UTX_PL011_INT_TX;
+	}
+
+	*(volatile u32_t *)(base + UTX_PL011_ICR) = UTX_PL011_INT_TX;
+	#endif //__UTX_OWNS_UART__
+
+	cpu_data_memory_barrier();
+
+	queue->draining = FALSE;
+
+	return count;
+}
+
+size_t utx_get_dropped(void) {
+
+	DBG_LOG_FUNCTION(utx_dbg, DBG_LEVEL_3);
+
+	return ((utx_queue_t *)gen_add_base(&utx_queue))->dropped;
+}
+
+size_t utx_leaf_dropped(size_t function, size_t argument) {
+
+	UNUSED_VARIABLE(function);
+	UNUSED_VARIABLE(argument);
+
+	return ((utx_queue_t *)gen_add_base(&utx_queue))->dropped;
+}
+
+// the interrupt is never claimed, the operating system still sees the
+// interrupt it was raised with
+result_t utx_vec_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	utx_queue_t *queue;
+
+	UNUSED_VARIABLE(handler);
+	UNUSED_VARIABLE(handled);
+	UNUSED_VARIABLE(registers);
+
+	queue = gen_add_base(&utx_queue);
+
+	if(queue->tail != queue->head) {
+		utx_drain(UTX_DRAIN_LIMIT);
+	}
+
+	return SUCCESS;
+}
+
+result_t utx_get_debug_level(size_t *level) {
+
+	DBG_LOG_FUNCTION(utx_dbg, DBG_LEVEL_3);
+
+	DBG_GET_VARIABLE(utx_dbg, *level);
+
+	return SUCCESS;
+}
+
+result_t utx_set_debug_level(size_t level) {
+
+	DBG_LOG_FUNCTION(utx_dbg, DBG_LEVEL_3);
+
+	DBG_SET_VARIABLE(utx_dbg, level);
+
+	return SUCCESS;
+}
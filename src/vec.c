@@ -39,16 +39,44 @@
 #include <stdlib/check.h>
 #include <stdlib/string.h>
 
+#include <kernel/cpu.h>
+#include <kernel/dfr.h>
 #include <kernel/log.h>
 #include <kernel/lst.h>
 #include <kernel/mas.h>
 #include <kernel/mmu.h>
+#include <kernel/trc.h>
 #include <kernel/vec.h>
 
 DBG_DEFINE_VARIABLE(vec_dbg, DBG_LEVEL_2);
 
 lst_item_t *vec_list = NULL;
 
+vec_fiq_handler_t vec_fiq_handlers[VEC_FIQ_HANDLERS_SIZE];
+
+// fiqs each cpu has started and finished dispatching, the two only differ
+// while vec_dispatch_fiq_handler runs on the cpu
+size_t vec_fiq_entries[CPU_NUMBER_OF_CPUS];
+size_t vec_fiq_exits[CPU_NUMBER_OF_CPUS];
+
+// TRUE once vec_patch has taken over the fiq vector, it is left with the
+// operating system when its handler can not be found
+bool_t vec_patched_fiq = FALSE;
+
+// the innermost handler running on each cpu, see vec_call_handler
+vec_recovery_t *vec_recoveries[CPU_NUMBER_OF_CPUS];
+
+// exceptions each cpu has finished dispatching from the operating system
+size_t vec_dispatches[CPU_NUMBER_OF_CPUS];
+
+// memory waiting for the cpus to leave the dispatches that may use it
+vec_retired_t *vec_retired = NULL;
+
+// the system calls selected with vec_set_svc_dispatch and the number of
+// svc handlers registered without VEC_HANDLER_FLAG_SELECTED
+u32_t vec_svc_selected[VEC_SVC_BITMAP_WORDS];
+size_t vec_svc_unselected = 0;
+
 result_t vec_init(void) {
 
 	lst_item_t **vl;
@@ -57,6 +85,12 @@ result_t vec_init(void) {
 
 	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
 
+	// the stubs park lr in the TPIDRPRW, the operating system must not
+	// keep a thread or per cpu pointer in it
+	CHECK_EQUAL(cpu_get_privileged_thread_id(), 0, "the operating system uses the TPIDRPRW", cpu_get_privileged_thread_id(), vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	vl = gen_add_base(&vec_list);
 
 	handler = malloc(sizeof(vec_handler_t));
@@ -72,58 +106,82 @@ result_t vec_init(void) {
 
 	*vl = tmp;
 
-	// allocate space for new stacks in each of the vectors
-	*(size_t **)gen_add_base(&vec_new_stack_rst) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
+	// allocate a stack for each of the vectors on every cpu
 
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_rst), "vec_new_stack_rst is null", vec_new_stack_rst, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_rst)), "unable to allocate the rst stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*(size_t **)gen_add_base(&vec_new_stack_svc) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
-
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_svc), "vec_new_stack_svc is null", vec_new_stack_svc, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_svc)), "unable to allocate the svc stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*(size_t **)gen_add_base(&vec_new_stack_und) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
-
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_und), "vec_new_stack_und is null", vec_new_stack_und, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_und)), "unable to allocate the und stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*(size_t **)gen_add_base(&vec_new_stack_pabt) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
-
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_pabt), "vec_new_stack_pabt is null", vec_new_stack_pabt, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_pabt)), "unable to allocate the pabt stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*(size_t **)gen_add_base(&vec_new_stack_dabt) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
-
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_dabt), "vec_new_stack_dabt is null", vec_new_stack_dabt, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_dabt)), "unable to allocate the dabt stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*(size_t **)gen_add_base(&vec_new_stack_irq) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
-
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_irq), "vec_new_stack_irq is null", vec_new_stack_irq, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_irq)), "unable to allocate the irq stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*(size_t **)gen_add_base(&vec_new_stack_fiq) = malloc(FOUR_KILOBYTES * 2) + (FOUR_KILOBYTES * 2);
-
-	CHECK_NOT_NULL(gen_add_base(&vec_new_stack_fiq), "vec_new_stack_fiq is null", vec_new_stack_fiq, vec_dbg, DBG_LEVEL_3)
+	CHECK_SUCCESS(vec_init_stacks(gen_add_base(&vec_stacks_fiq)), "unable to allocate the fiq stacks", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
+	memset(gen_add_base(&vec_recoveries), 0, sizeof(vec_recoveries));
+	memset(gen_add_base(&vec_dispatches), 0, sizeof(vec_dispatches));
+
+	// no system call is selected yet
+	memset(gen_add_base(&vec_svc_selected), 0, sizeof(vec_svc_selected));
+	*(size_t *)gen_add_base(&vec_svc_unselected) = 0;
+
+	vec_update_svc_bitmap();
+
 	// register a default handler for each of the vectors
 
-	vec_register_handler(VEC_RESET_VECTOR, gen_add_base(vec_default_handler), NULL);
-	vec_register_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(vec_default_handler), NULL);
-	vec_register_handler(VEC_SUPERVISOR_CALL_VECTOR, gen_add_base(vec_default_handler), NULL);
-	vec_register_handler(VEC_PREFETCH_ABORT_VECTOR, gen_add_base(vec_default_handler), NULL);
-	vec_register_handler(VEC_DATA_ABORT_VECTOR, gen_add_base(vec_default_handler), NULL);
-	vec_register_handler(VEC_INTERRUPT_VECTOR, gen_add_base(vec_default_handler), NULL);
-	vec_register_handler(VEC_FAST_INTERRUPT_VECTOR, gen_add_base(vec_default_handler), NULL);
+	vec_register_priority_handler(VEC_RESET_VECTOR, gen_add_base(vec_default_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST, VEC_HANDLER_FLAG_NONE);
+	vec_register_priority_handler(VEC_UNDEFINED_INSTRUCTION_VECTOR, gen_add_base(vec_default_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST, VEC_HANDLER_FLAG_NONE);
+	vec_register_priority_handler(VEC_SUPERVISOR_CALL_VECTOR, gen_add_base(vec_default_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST, VEC_HANDLER_FLAG_SELECTED);
+	vec_register_priority_handler(VEC_PREFETCH_ABORT_VECTOR, gen_add_base(vec_default_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST, VEC_HANDLER_FLAG_NONE);
+	vec_register_priority_handler(VEC_DATA_ABORT_VECTOR, gen_add_base(vec_default_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST, VEC_HANDLER_FLAG_NONE);
+	vec_register_priority_handler(VEC_INTERRUPT_VECTOR, gen_add_base(vec_default_handler), NULL, VEC_HANDLER_PRIORITY_LOWEST, VEC_HANDLER_FLAG_NONE);
+
+	// the fiq vector is dispatched from a fixed table instead of the list
+	memset(gen_add_base(&vec_fiq_handlers), 0, sizeof(vec_fiq_handlers));
+
+	*(bool_t *)gen_add_base(&vec_patched_fiq) = FALSE;
+
+	return SUCCESS;
+}
+
+// gives every cpu a microvisor stack for the vector
+result_t vec_init_stacks(vec_stack_t *stacks) {
+
+	u8_t *stack;
+	size_t i;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		stack = malloc(VEC_STACK_SIZE);
+
+		CHECK_NOT_NULL(stack, "unable to allocate memory for the stack", i, vec_dbg, DBG_LEVEL_2)
+			return FAILURE;
+		CHECK_END
+
+		stacks[i].old_stack = 0;
+		stacks[i].new_stack = (size_t)stack + VEC_STACK_SIZE;
+		stacks[i].depth = 0;
+	}
 
 	return SUCCESS;
 }
@@ -138,6 +196,9 @@ result_t vec_patch(mmu_paging_system_t *ps) {
 	tt_second_level_descriptor_t sld;
 	gen_system_control_register_t sctlr;
 	tt_translation_table_base_register_t ttbr;
+	vec_fiq_registers_t fiq;
+	bool_t patch_fiq;
+	size_t *chain;
 	size_t *p;
 
 	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
@@ -221,13 +282,30 @@ result_t vec_patch(mmu_paging_system_t *ps) {
 		return FAILURE;
 	CHECK_END
 
-	//CHECK_SUCCESS(vec_instruction_to_address(&(p[EXC_FAST_INTERRUPT_INDEX]), (size_t *)gen_add_base(&vec_handler_fiq)), "unable to convert fast interrupt vector instruction to address", p[EXC_FAST_INTERRUPT_INDEX], vec_dbg, DBG_LEVEL_2)
-	//	return FAILURE;
-	//CHECK_END
+	// the fiq instruction is usually register based (mov pc, r9 on the iphone 4)
+	// so the banked fiq registers are needed to find the operating system handler
+
+	vec_get_fiq_registers(&fiq);
+
+	patch_fiq = TRUE;
+
+	CHECK_SUCCESS(vec_fiq_instruction_to_address(p[EXC_FAST_INTERRUPT_INDEX], (size_t)&(p[EXC_FAST_INTERRUPT_INDEX]), &fiq, (size_t *)gen_add_base(&vec_handler_fiq)), "unable to convert fast interrupt vector instruction to address", p[EXC_FAST_INTERRUPT_INDEX], vec_dbg, DBG_LEVEL_2)
+		// leave the fiq with the operating system rather than failing the patch
+		patch_fiq = FALSE;
+	CHECK_END
+
+	if((patch_fiq == TRUE) && ((p[EXC_FAST_INTERRUPT_INDEX] & VEC_ARM_MOVE_PC_REGISTER_OPCODE_MASK) == VEC_ARM_MOVE_PC_REGISTER_OPCODE)) {
+
+		// the banked register may be changed by the operating system after
+		// the snapshot so chain by executing the displaced instruction itself
+		chain = gen_add_base(&vec_chain_fiq);
+
+		*chain = p[EXC_FAST_INTERRUPT_INDEX];
+
+		cac_flush_cache_region(chain, sizeof(size_t));
+	}
 
 	// set all the instructions in the table to ldr pc, [pc, #24]
-	// -1 so we don't patch the fiq handler. mainly because the instruction will not be correctly parsed
-	// it is mov pc, r9. So, we would have to switch to fiq mode and read r9 for the address.
 
 	// intentionally not in a loop so a particular vector can be left unpatched
 
@@ -243,8 +321,10 @@ result_t vec_patch(mmu_paging_system_t *ps) {
 	p[EXC_PREFETCH_ABORT_INDEX] = VEC_LDR_18_INSTRUCTION;
 	p[EXC_DATA_ABORT_INDEX] = VEC_LDR_18_INSTRUCTION;
 	p[EXC_INTERRUPT_INDEX] = VEC_LDR_18_INSTRUCTION;
-	// we will skip the fiq because the iphone 4 uses a banked register for its ldr
-	//p[EXC_FAST_INTERRUPT_INDEX] = vec_LDR_INSTRUCTION;
+
+	if(patch_fiq == TRUE) {
+		p[EXC_FAST_INTERRUPT_INDEX] = VEC_LDR_18_INSTRUCTION;
+	}
 
 	// load the address of the new handlers
 	//p[EXC_NUMBER_OF_VECTORS + EXC_RESET_INDEX] = (size_t)gen_add_base(&vec_asm_handler_rst);
@@ -253,7 +333,12 @@ result_t vec_patch(mmu_paging_system_t *ps) {
 	p[EXC_NUMBER_OF_VECTORS + EXC_PREFETCH_ABORT_INDEX] = (size_t)gen_add_base(&vec_asm_handler_pabt);
 	p[EXC_NUMBER_OF_VECTORS + EXC_DATA_ABORT_INDEX] = (size_t)gen_add_base(&vec_asm_handler_dabt);
 	p[EXC_NUMBER_OF_VECTORS + EXC_INTERRUPT_INDEX] = (size_t)gen_add_base(&vec_asm_handler_irq);
-	//p[EXC_NUMBER_OF_VECTORS + EXC_FAST_INTERRUPT_INDEX] = (size_t)gen_add_base(&vec_asm_handler_fiq);
+
+	if(patch_fiq == TRUE) {
+		p[EXC_NUMBER_OF_VECTORS + EXC_FAST_INTERRUPT_INDEX] = (size_t)gen_add_base(&vec_asm_handler_fiq);
+	}
+
+	*(bool_t *)gen_add_base(&vec_patched_fiq) = patch_fiq;
 
 	CHECK_SUCCESS(mmu_unmap(va, FOUR_KILOBYTES, MMU_MAP_INTERNAL), "unable to unmap the va", l2.all, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
@@ -320,6 +405,69 @@ result_t vec_instruction_to_address(size_t instruction, size_t instruction_addre
 	return SUCCESS;
 }
 
+// an instruction can be executed from another address when it is not a
+// branch and does not name the pc. this is conservative, an immediate
+// that happens to sit in a register field also rejects the instruction
+bool_t vec_instruction_is_relocatable(size_t instruction) {
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	if((instruction & VEC_ARM_CONDITION_MASK) == VEC_ARM_CONDITION_UNCONDITIONAL) {
+		return FALSE;
+	}
+
+	if((instruction & VEC_ARM_BRANCH_OPCODE_MASK) == VEC_ARM_BRANCH_OPCODE) {
+		return FALSE;
+	}
+
+	// blx would return into the copy instead of the original code
+	if((instruction & VEC_ARM_BRANCH_LINK_EXCHANGE_REGISTER_OPCODE_MASK) == VEC_ARM_BRANCH_LINK_EXCHANGE_REGISTER_OPCODE) {
+		return FALSE;
+	}
+
+	if(((instruction & VEC_ARM_BLOCK_DATA_TRANSFER_OPCODE_MASK) == VEC_ARM_BLOCK_DATA_TRANSFER_OPCODE) && ((instruction & VEC_ARM_REGISTER_LIST_PC) != 0)) {
+		return FALSE;
+	}
+
+	if((((instruction >> VEC_ARM_RN_SHIFT) & VEC_ARM_REGISTER_MASK) == VEC_ARM_PC_REGISTER) ||
+	   (((instruction >> VEC_ARM_RD_SHIFT) & VEC_ARM_REGISTER_MASK) == VEC_ARM_PC_REGISTER) ||
+	   (((instruction >> VEC_ARM_RM_SHIFT) & VEC_ARM_REGISTER_MASK) == VEC_ARM_PC_REGISTER)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+result_t vec_fiq_instruction_to_address(size_t instruction, size_t instruction_address, vec_fiq_registers_t *registers, size_t *absolute_address) {
+
+	size_t rm;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(registers, "registers is null", registers, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	if((instruction & VEC_ARM_MOVE_PC_REGISTER_OPCODE_MASK) != VEC_ARM_MOVE_PC_REGISTER_OPCODE) {
+		return vec_instruction_to_address(instruction, instruction_address, absolute_address);
+	}
+
+	rm = instruction & VEC_ARM_MOVE_PC_REGISTER_RM_MASK;
+
+	// only r8_fiq - r14_fiq can be recovered, r0 - r7 belong to whatever
+	// was interrupted
+	if((rm < VEC_FIQ_FIRST_BANKED_REGISTER) || (rm >= (VEC_FIQ_FIRST_BANKED_REGISTER + VEC_FIQ_NUMBER_OF_REGISTERS))) {
+		DBG_LOG_STATEMENT("unable to convert unbanked register to address", rm, vec_dbg, DBG_LEVEL_3);
+		return FAILURE;
+	}
+
+	*absolute_address = registers->all[rm - VEC_FIQ_FIRST_BANKED_REGISTER];
+
+	DBG_LOG_STATEMENT("absolute address", *absolute_address, vec_dbg, DBG_LEVEL_3);
+
+	return SUCCESS;
+}
+
 result_t vec_default_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
 
 	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
@@ -353,13 +501,31 @@ result_t vec_default_handler(vec_handler_t *handler, bool_t *handled, gen_genera
 	return SUCCESS;
 }
 
+// the fiq vector is not dispatched from the list, its handlers do not get
+// a register frame and are registered with vec_register_fiq_handler.
+// registering a vec_function_t for VEC_FAST_INTERRUPT_VECTOR fails with a
+// message that points the caller at vec_register_fiq_handler instead of
+// leaving it with a handler that would never run
 result_t vec_register_handler(size_t vector, vec_function_t function, void *data) {
 
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	return vec_register_priority_handler(vector, function, data, VEC_HANDLER_PRIORITY_DEFAULT, VEC_HANDLER_FLAG_NONE);
+}
+
+result_t vec_register_priority_handler(size_t vector, vec_function_t function, void *data, size_t priority, size_t flags) {
+
 	lst_item_t *vl;
+	lst_item_t *next;
 	vec_handler_t *handler;
+	vec_handler_t *tmp;
 
 	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
 
+	CHECK_NOT_EQUAL(vector, VEC_FAST_INTERRUPT_VECTOR, "VEC_FAST_INTERRUPT_VECTOR is no longer dispatched from the list, register a vec_fiq_function_t with vec_register_fiq_handler", vector, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	vl = *(lst_item_t **)gen_add_base(&vec_list);
 
 	handler = malloc(sizeof(vec_handler_t));
@@ -368,16 +534,46 @@ result_t vec_register_handler(size_t vector, vec_function_t function, void *data
 		return FAILURE;
 	CHECK_END
 
-	CHECK_SUCCESS(lst_add_item(&vl), "unable to add item", handler, vec_dbg, DBG_LEVEL_2)
-		free(handler);
-		return FAILURE;
-	CHECK_END
+	// keep the list sorted at registration time so dispatch
+	// never has to look at the priorities. the new handler is
+	// placed after every handler with the same or higher priority
+	while(1) {
+
+		CHECK_SUCCESS(lst_get_next_item(vl, &next), "unable to get the next item", vl, vec_dbg, DBG_LEVEL_2)
+			free(handler);
+			return FAILURE;
+		CHECK_END
+
+		if(next == NULL) { break; }
+
+		lst_get_data(next, (void **)&tmp);
+
+		if(tmp->priority < priority) { break; }
+
+		vl = next;
+	}
 
 	handler->vector = vector;
 	handler->function = function;
 	handler->data = data;
+	handler->priority = priority;
+	handler->flags = flags;
+	handler->deferred = 0;
+	handler->removed = FALSE;
+
+	memset(&(handler->statistics), 0, sizeof(cpu_statistics_t));
+
+	// a dispatch on another cpu may walk the list, the handler is
+	// complete before it can be found
+	CHECK_SUCCESS(lst_publish_after_item(&vl, handler), "unable to add item", handler, vec_dbg, DBG_LEVEL_2)
+		free(handler);
+		return FAILURE;
+	CHECK_END
 
-	lst_set_data(vl, handler);
+	if((vector == VEC_SUPERVISOR_CALL_VECTOR) && ((flags & VEC_HANDLER_FLAG_SELECTED) == 0)) {
+		(*(size_t *)gen_add_base(&vec_svc_unselected))++;
+		vec_update_svc_bitmap();
+	}
 
 	return SUCCESS;
 }
@@ -415,6 +611,10 @@ result_t vec_unregister_handler(size_t vector, vec_function_t function) {
 
 	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
 
+	CHECK_NOT_EQUAL(vector, VEC_FAST_INTERRUPT_VECTOR, "VEC_FAST_INTERRUPT_VECTOR is no longer dispatched from the list, use vec_unregister_fiq_handler", vector, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
 	vl = *(lst_item_t **)gen_add_base(&vec_list);
 
 	CHECK_SUCCESS(lst_get_first_item(vl, &vl), "unable to get the first item", vl, vec_dbg, DBG_LEVEL_2)
@@ -427,11 +627,30 @@ result_t vec_unregister_handler(size_t vector, vec_function_t function) {
 
 		if(handler->function == function) {
 
-			CHECK_SUCCESS(lst_remove_item(vl), "unable to remove item", vl, vec_dbg, DBG_LEVEL_2)
+			// a dispatch on another cpu may be walking the item, it
+			// is retired with the handler
+			CHECK_SUCCESS(lst_unlink_item(vl), "unable to unlink item", vl, vec_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+
+			if((vector == VEC_SUPERVISOR_CALL_VECTOR) && ((handler->flags & VEC_HANDLER_FLAG_SELECTED) == 0)) {
+				(*(size_t *)gen_add_base(&vec_svc_unselected))--;
+				vec_update_svc_bitmap();
+			}
+
+			// a dispatch on another cpu may still be running the
+			// handler or queueing it, vec_deferred_handler drops the
+			// items queued for it once removed is set
+			handler->removed = TRUE;
+
+			CHECK_SUCCESS(vec_retire_pending(handler, &(handler->deferred)), "unable to retire the handler", handler, vec_dbg, DBG_LEVEL_2)
+				return FAILURE;
+			CHECK_END
+
+			CHECK_SUCCESS(vec_retire(vl), "unable to retire the item", vl, vec_dbg, DBG_LEVEL_2)
 				return FAILURE;
 			CHECK_END
 
-			free(handler);
 			break;
 		}
 
@@ -441,12 +660,45 @@ result_t vec_unregister_handler(size_t vector, vec_function_t function) {
 	return SUCCESS;
 }
 
-result_t vec_dispatch_handler(size_t vector, gen_general_purpose_registers_t *registers) {
+// runs a demoted handler from the deferred queue. the handler is not
+// freed while items queued for it are pending, an item that outlived
+// the registration is dropped as the function may be gone
+result_t vec_deferred_handler(dfr_item_t *item) {
+
+	vec_handler_t *handler;
+	bool_t handled;
+	size_t start;
+	result_t result;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	handler = item->data;
+	handled = FALSE;
+	result = SUCCESS;
+
+	if(handler->removed == FALSE) {
+
+		start = cpu_get_cycle_count();
+
+		result = handler->function(handler, &handled, &(item->registers));
+
+		cpu_update_statistics(&(handler->statistics), (cpu_get_cycle_count() - start));
+	}
+
+	// the last access to the handler, vec_reclaim may free it after this
+	cpu_data_memory_barrier();
+	cpu_atomic_add(&(handler->deferred), (size_t)-1);
+
+	return result;
+}
+
+// depth is the number of exceptions that were already being dispatched
+// on this cpu on any vector, the stubs pass it along with the handled
+// flag that lives in their frame
+result_t vec_dispatch_handler(size_t vector, gen_general_purpose_registers_t *registers, bool_t *handled, size_t depth) {
 
-	lst_item_t *vl;
-	vec_handler_t *tmp;
 	gen_program_status_register_t spsr;
-	bool_t *handled;
+	size_t *dispatches;
 	result_t result;
 
 	// make sure that everything done here is atomic
@@ -456,42 +708,92 @@ result_t vec_dispatch_handler(size_t vector, gen_general_purpose_registers_t *re
 
 	int_disable_fiq();
 
-	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+	// the depth the stub stored is visible to vec_retire before
+	// anything that may be retired is looked up
+	cpu_data_memory_barrier();
 
-	if(vector == VEC_RESET_VECTOR) {
-		handled = gen_add_base(&vec_handled_rst);
-	}
-	else if(vector == VEC_UNDEFINED_INSTRUCTION_VECTOR) {
-		handled = gen_add_base(&vec_handled_und);
+	TRC_POINT(vec_dispatch_handler);
+
+	dispatches = &(((size_t *)gen_add_base(&vec_dispatches))[cpu_get_id()]);
+
+	// the first exception dispatched on a cpu turns its cycle counter on,
+	// there is no other point where the microvisor sees a cpu the
+	// operating system brought up
+	if((depth == 0) && (*dispatches == 0)) {
+		cpu_prepare_cycle_counter();
 	}
-	else if(vector == VEC_SUPERVISOR_CALL_VECTOR) {
-		handled = gen_add_base(&vec_handled_svc);
+
+	*handled = FALSE;
+
+	if((vector != VEC_RESET_VECTOR) &&
+	   (vector != VEC_UNDEFINED_INSTRUCTION_VECTOR) &&
+	   (vector != VEC_SUPERVISOR_CALL_VECTOR) &&
+	   (vector != VEC_PREFETCH_ABORT_VECTOR) &&
+	   (vector != VEC_DATA_ABORT_VECTOR) &&
+	   (vector != VEC_INTERRUPT_VECTOR)) {
+		DBG_LOG_STATEMENT("unknown vector", vector, vec_dbg, DBG_LEVEL_2);
+		return FAILURE;
 	}
-	else if(vector == VEC_PREFETCH_ABORT_VECTOR) {
-		handled = gen_add_base(&vec_handled_pabt);
+
+	// a fault on one of the probe accesses returns FAILURE from the probe
+	if((vector == VEC_DATA_ABORT_VECTOR) &&
+	   (((registers->lr - VEC_DATA_ABORT_RETURN_ADJUSTMENT) == (size_t)gen_add_base(&vec_probe_read_access)) ||
+	    ((registers->lr - VEC_DATA_ABORT_RETURN_ADJUSTMENT) == (size_t)gen_add_base(&vec_probe_write_access)))) {
+
+		registers->lr = (size_t)gen_add_base(&vec_probe_fixup);
+		*handled = TRUE;
+
+		result = SUCCESS;
 	}
-	else if(vector == VEC_DATA_ABORT_VECTOR) {
-		handled = gen_add_base(&vec_handled_dabt);
+	else if(depth >= VEC_NESTING_LIMIT) {
+		result = vec_nested_fault(vector, registers, handled, depth);
 	}
-	else if(vector == VEC_INTERRUPT_VECTOR) {
-		handled = gen_add_base(&vec_handled_irq);
+	else {
+
+		result = vec_dispatch_chain(vector, registers, handled);
+
+		// the interrupted code is the microvisor, there is
+		// no operating system handler to chain to
+		if((depth != 0) && (*handled == FALSE)) {
+			result = vec_nested_fault(vector, registers, handled, depth);
+		}
 	}
-	else if(vector == VEC_FAST_INTERRUPT_VECTOR) {
-		handled = gen_add_base(&vec_handled_fiq);
+
+	// the cpu is done with everything retired before this exception
+	if(depth == 0) {
+		cpu_data_memory_barrier();
+		(*dispatches)++;
 	}
-	else {
-		DBG_LOG_STATEMENT("unknown vector", vector, vec_dbg, DBG_LEVEL_2);
+
+	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
+	CHECK_END
+
+	spsr = gen_get_spsr();
+
+	if(spsr.fields.f == FALSE) {
+		int_enable_fiq();
 	}
 
+	return result;
+}
+
+result_t vec_dispatch_chain(size_t vector, gen_general_purpose_registers_t *registers, bool_t *handled) {
+
+	lst_item_t *vl;
+	vec_handler_t *tmp;
+	result_t result;
+	result_t status;
+	size_t start;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
 	vl = *(lst_item_t **)gen_add_base(&vec_list);
 
 	CHECK_SUCCESS(lst_get_first_item(vl, &vl), "unable to get the first item", vl, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	*handled = FALSE;
-
 	result = SUCCESS;
 
 	while(1) {
@@ -504,27 +806,505 @@ result_t vec_dispatch_handler(size_t vector, gen_general_purpose_registers_t *re
 
 		lst_get_data(vl, (void **)&tmp);
 
-		CHECK_SUCCESS(tmp->function(tmp, handled, registers), "handler returned failure", FAILURE, vec_dbg, DBG_LEVEL_2)
-			result = FAILURE;
+		// a demoted handler never claims the event, it runs later
+		// on a copy of the registers and the chain carries on. a
+		// dropped item is counted by the deferred queue
+		if((tmp->flags & VEC_HANDLER_FLAG_DEMOTED) != 0) {
+
+			cpu_atomic_add(&(tmp->deferred), 1);
+
+			if(dfr_enqueue(gen_add_base(&vec_deferred_handler), tmp, vector, registers) != SUCCESS) {
+				cpu_atomic_add(&(tmp->deferred), (size_t)-1);
+			}
+		}
+		else {
+
+			start = cpu_get_cycle_count();
+
+			status = vec_call_handler(tmp, handled, registers);
+
+			if(cpu_update_statistics(&(tmp->statistics), (cpu_get_cycle_count() - start)) == TRUE) {
+
+				DBG_LOG_STATEMENT("handler is over budget", (size_t)(tmp->function), vec_dbg, DBG_LEVEL_2);
+
+				// the handler runs on every cpu at once, a plain or
+				// could lose the bits another cpu is setting
+				cpu_atomic_or(&(tmp->flags), VEC_HANDLER_FLAG_OVER_BUDGET);
+
+				if((tmp->flags & VEC_HANDLER_FLAG_DEMOTE) != 0) {
+					cpu_atomic_or(&(tmp->flags), VEC_HANDLER_FLAG_DEMOTED);
+				}
+			}
+
+			CHECK_SUCCESS(status, "handler returned failure", FAILURE, vec_dbg, DBG_LEVEL_2)
+				result = FAILURE;
+				break;
+			CHECK_END
+		}
+
+		// the rest of the chain has a lower priority than a
+		// terminal handler that claimed the event
+		if((*handled == TRUE) && ((tmp->flags & VEC_HANDLER_FLAG_TERMINAL) != 0)) {
 			break;
-		CHECK_END
+		}
 
     	CHECK_SUCCESS(lst_get_next_item(vl, &vl), "unable to get the next item", vl, vec_dbg, DBG_LEVEL_2)
     		return FAILURE;
     	CHECK_END
 	}
 
-	CHECK_SUCCESS(mmu_switch_paging_system(MMU_SWITCH_EXTERNAL), "unable to switch paging systems", FAILURE, vec_dbg, DBG_LEVEL_2)
+	return result;
+}
+
+// runs a handler with a vec_recovery_t that vec_nested_fault can resume
+// at when an exception the handler takes cannot be handled
+result_t vec_call_handler(vec_handler_t *handler, bool_t *handled, gen_general_purpose_registers_t *registers) {
+
+	vec_recovery_t recovery;
+	vec_recovery_t **top;
+	result_t result;
+
+	// this is on the exception path, see vec_dispatch_chain
+
+	top = &(((vec_recovery_t **)gen_add_base(&vec_recoveries))[cpu_get_id()]);
+
+	recovery.depth = ((size_t *)gen_add_base(&vec_depth))[cpu_get_id()];
+	recovery.previous = *top;
+
+	*top = &recovery;
+
+	result = vec_call_recoverable(handler, handled, registers, &recovery);
+
+	*top = recovery.previous;
+
+	return result;
+}
+
+// the microvisor state of the interrupted dispatch cannot be handed to
+// the operating system. the exception returns to vec_resume instead so
+// the handler that took it fails and its dispatch carries on. when the
+// microvisor was not in a handler of the interrupted dispatch there is
+// nothing to resume and the cpu is stopped
+result_t vec_nested_fault(size_t vector, gen_general_purpose_registers_t *registers, bool_t *handled, size_t depth) {
+
+	vec_recovery_t *recovery;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	DBG_LOG_STATEMENT("unable to handle a nested exception", vector, vec_dbg, DBG_LEVEL_2);
+	DBG_LOG_STATEMENT("depth", depth, vec_dbg, DBG_LEVEL_2);
+	DBG_LOG_STATEMENT("registers->lr", registers->lr, vec_dbg, DBG_LEVEL_2);
+
+	recovery = ((vec_recovery_t **)gen_add_base(&vec_recoveries))[cpu_get_id()];
+
+	if((recovery == NULL) || (recovery->depth != depth)) {
+		DBG_LOG_STATEMENT("no handler to resume, stopping the cpu", vector, vec_dbg, DBG_LEVEL_2);
+		vec_halt();
+	}
+
+	registers->r0 = (size_t)recovery;
+	registers->lr = (size_t)gen_add_base(vec_resume);
+
+	*handled = TRUE;
+
+	return SUCCESS;
+}
+
+// frees pointer once every cpu has left the dispatch it was in, so a
+// handler that loaded pointer before it was unpublished can finish with
+// it. the caller unpublishes it first and callers are serialized like
+// the registrations that call it. the retired memory of earlier calls
+// is reclaimed first, so it waits at most until the next call after the
+// cpus have been through a quiescent point
+result_t vec_retire(void *pointer) {
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	return vec_retire_pending(pointer, NULL);
+}
+
+// vec_retire for memory that work queued on the cpus still refers to,
+// it is freed once *pending has dropped to zero as well
+result_t vec_retire_pending(void *pointer, size_t *pending) {
+
+	vec_retired_t **list;
+	vec_retired_t *retired;
+	size_t *depths;
+	size_t *dispatches;
+	size_t i;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	vec_reclaim();
+
+	if(pointer == NULL) {
+		return SUCCESS;
+	}
+
+	retired = malloc(sizeof(vec_retired_t));
+
+	// leaking the memory is the only safe choice left
+	CHECK_NOT_NULL(retired, "unable to allocate memory to retire the pointer", pointer, vec_dbg, DBG_LEVEL_2)
 		return FAILURE;
 	CHECK_END
 
-	spsr = gen_get_spsr();
+	list = gen_add_base(&vec_retired);
+	depths = gen_add_base(&vec_depth);
+	dispatches = gen_add_base(&vec_dispatches);
 
-	if(spsr.fields.f == FALSE) {
-		int_enable_fiq();
+	// the store that unpublished pointer is visible before the cpus are read
+	cpu_data_memory_barrier();
+
+	retired->pointer = pointer;
+	retired->pending = pending;
+	retired->quiescent = 0;
+
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		if(depths[i] == 0) {
+			retired->quiescent |= (1 << i);
+		}
+
+		retired->dispatches[i] = dispatches[i];
 	}
 
-	return result;
+	retired->next = *list;
+	*list = retired;
+
+	return SUCCESS;
+}
+
+// frees the retired memory no cpu can still be using, a cpu is done with
+// it once it was not dispatching when it was retired or has finished a
+// dispatch since
+void vec_reclaim(void) {
+
+	vec_retired_t **list;
+	vec_retired_t *retired;
+	size_t *dispatches;
+	size_t i;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	list = gen_add_base(&vec_retired);
+	dispatches = gen_add_base(&vec_dispatches);
+
+	while(*list != NULL) {
+
+		retired = *list;
+
+		for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+			if(((retired->quiescent & (1 << i)) == 0) && (retired->dispatches[i] == dispatches[i])) {
+				break;
+			}
+		}
+
+		// the cpus are done with the dispatches that may have queued
+		// more, the count is read after them
+		cpu_data_memory_barrier();
+
+		if((i != CPU_NUMBER_OF_CPUS) || ((retired->pending != NULL) && (*(retired->pending) != 0))) {
+			list = &(retired->next);
+			continue;
+		}
+
+		*list = retired->next;
+
+		free(retired->pointer);
+		free(retired);
+	}
+}
+
+result_t vec_get_handler(size_t vector, vec_function_t function, vec_handler_t **handler) {
+
+	lst_item_t *vl;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(handler, "handler is null", handler, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	vl = *(lst_item_t **)gen_add_base(&vec_list);
+
+	CHECK_SUCCESS(lst_get_first_item(vl, &vl), "unable to get the first item", vl, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	while((vec_find_handler(&vl, vector) == SUCCESS) && (vl != NULL)) {
+
+		lst_get_data(vl, (void **)handler);
+
+		if((*handler)->function == function) {
+			return SUCCESS;
+		}
+
+		lst_get_next_item(vl, &vl);
+	}
+
+	DBG_LOG_STATEMENT("handler is not registered", (size_t)function, vec_dbg, DBG_LEVEL_2);
+
+	return FAILURE;
+}
+
+// a budget of CPU_STATISTICS_NO_BUDGET turns the checks off, setting
+// a budget also brings a demoted handler back inline
+result_t vec_set_handler_budget(size_t vector, vec_function_t function, size_t budget) {
+
+	vec_handler_t *handler;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK_SUCCESS(vec_get_handler(vector, function, &handler), "unable to get the handler", vector, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	handler->statistics.budget = budget;
+	handler->statistics.consecutive = 0;
+	cpu_atomic_clear(&(handler->flags), (VEC_HANDLER_FLAG_OVER_BUDGET | VEC_HANDLER_FLAG_DEMOTED));
+
+	return SUCCESS;
+}
+
+result_t vec_get_handler_statistics(size_t vector, vec_function_t function, cpu_statistics_t *statistics) {
+
+	vec_handler_t *handler;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(statistics, "statistics is null", statistics, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_SUCCESS(vec_get_handler(vector, function, &handler), "unable to get the handler", vector, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	memcpy(statistics, &(handler->statistics), sizeof(cpu_statistics_t));
+
+	return SUCCESS;
+}
+
+// the svc stub only dispatches the system calls selected here while every
+// svc handler is registered with VEC_HANDLER_FLAG_SELECTED. numbers past
+// the end of the bitmap can not be selected and are always dispatched
+result_t vec_set_svc_dispatch(size_t number, bool_t dispatch) {
+
+	u32_t *bitmap;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK(number < VEC_SVC_BITMAP_SIZE, "number is past the end of the bitmap", number, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	bitmap = gen_add_base(&vec_svc_selected);
+
+	if(dispatch == TRUE) {
+		bitmap[number / 32] |= (1 << (number % 32));
+	}
+	else {
+		bitmap[number / 32] &= ~(1 << (number % 32));
+	}
+
+	vec_update_svc_bitmap();
+
+	return SUCCESS;
+}
+
+result_t vec_set_svc_dispatch_all(bool_t dispatch) {
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	memset(gen_add_base(&vec_svc_selected), ((dispatch == TRUE) ? 0xFF : 0x00), sizeof(vec_svc_selected));
+
+	vec_update_svc_bitmap();
+
+	return SUCCESS;
+}
+
+// a handler registered without VEC_HANDLER_FLAG_SELECTED has to see every
+// system call, the selection only applies once there is none left. the
+// stub reads the bitmap a word at a time without a lock
+void vec_update_svc_bitmap(void) {
+
+	u32_t *bitmap;
+	u32_t *selected;
+	size_t i;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	bitmap = gen_add_base(&vec_svc_bitmap);
+	selected = gen_add_base(&vec_svc_selected);
+
+	for(i = 0; i < VEC_SVC_BITMAP_WORDS; i++) {
+
+		if(*(size_t *)gen_add_base(&vec_svc_unselected) != 0) {
+			bitmap[i] = 0xFFFFFFFF;
+		}
+		else {
+			bitmap[i] = selected[i];
+		}
+	}
+}
+
+// the entry is read by the und stub of every cpu without a lock, a
+// single word store is atomic so it sees the old or the new function
+result_t vec_set_leaf_function(size_t index, vec_leaf_function_t function) {
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK(index < VEC_LEAF_TABLE_SIZE, "index is past the end of the leaf table", index, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	((vec_leaf_function_t *)gen_add_base(&vec_leaf_table))[index] = function;
+
+	cpu_data_memory_barrier();
+
+	return SUCCESS;
+}
+
+// fails when the fiq was left with the operating system, the handler
+// would never be called
+result_t vec_register_fiq_handler(vec_fiq_function_t function, void *data) {
+
+	vec_fiq_handler_t *handlers;
+	size_t i;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	CHECK_NOT_NULL(function, "function is null", function, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	CHECK_EQUAL(*(bool_t *)gen_add_base(&vec_patched_fiq), TRUE, "the fiq vector is not patched", FALSE, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	handlers = gen_add_base(&vec_fiq_handlers);
+
+	for(i = 0; i < VEC_FIQ_HANDLERS_SIZE; i++) {
+
+		if(handlers[i].function == NULL) {
+
+			// the function is written last as it is what
+			// vec_dispatch_fiq_handler uses to find an entry
+			handlers[i].data = data;
+
+			cpu_data_memory_barrier();
+
+			handlers[i].function = function;
+
+			return SUCCESS;
+		}
+	}
+
+	DBG_LOG_STATEMENT("no free fiq handler entries", VEC_FIQ_HANDLERS_SIZE, vec_dbg, DBG_LEVEL_2);
+
+	return FAILURE;
+}
+
+// the handler is not running on any cpu once this returns, so its code
+// and data can go away
+result_t vec_unregister_fiq_handler(vec_fiq_function_t function) {
+
+	vec_fiq_handler_t *handlers;
+	volatile size_t *entries;
+	volatile size_t *exits;
+	size_t exited;
+	size_t index;
+	size_t i;
+
+	DBG_LOG_FUNCTION(vec_dbg, DBG_LEVEL_3);
+
+	handlers = gen_add_base(&vec_fiq_handlers);
+
+	for(index = 0; index < VEC_FIQ_HANDLERS_SIZE; index++) {
+
+		if(handlers[index].function == function) {
+			break;
+		}
+	}
+
+	CHECK(index < VEC_FIQ_HANDLERS_SIZE, "the fiq handler is not registered", function, vec_dbg, DBG_LEVEL_2)
+		return FAILURE;
+	CHECK_END
+
+	handlers[index].function = NULL;
+
+	cpu_data_memory_barrier();
+
+	entries = gen_add_base(&vec_fiq_entries);
+	exits = gen_add_base(&vec_fiq_exits);
+
+	// a fiq that found the handler before it was cleared has to
+	// finish. fiqs do not nest so the next exit of a cpu that is
+	// dispatching one ends it
+	for(i = 0; i < CPU_NUMBER_OF_CPUS; i++) {
+
+		exited = exits[i];
+
+		if(entries[i] != exited) {
+			while(exits[i] == exited) {}
+		}
+	}
+
+	cpu_data_memory_barrier();
+
+	handlers[index].data = NULL;
+
+	return SUCCESS;
+}
+
+result_t vec_dispatch_fiq_handler(bool_t *handled) {
+
+	vec_fiq_handler_t *handlers;
+	vec_fiq_function_t function;
+	size_t cpu;
+	size_t i;
+
+	// this is the low latency path so there is intentionally no
+	// logging, no list walk and no paging system switch here
+
+	handlers = gen_add_base(&vec_fiq_handlers);
+
+	cpu = cpu_get_id();
+
+	((size_t *)gen_add_base(&vec_fiq_entries))[cpu]++;
+
+	// vec_unregister_fiq_handler sees the entry before the table is read
+	cpu_data_memory_barrier();
+
+	*handled = FALSE;
+
+	for(i = 0; i < VEC_FIQ_HANDLERS_SIZE; i++) {
+
+		// read once, vec_unregister_fiq_handler may clear it
+		function = handlers[i].function;
+
+		if(function == NULL) {
+			continue;
+		}
+
+		// the data vec_register_fiq_handler wrote before the function
+		cpu_data_memory_barrier();
+
+		if(function(&(handlers[i]), handled) != SUCCESS) {
+			break;
+		}
+
+		if(*handled == TRUE) {
+			break;
+		}
+	}
+
+	cpu_data_memory_barrier();
+
+	((size_t *)gen_add_base(&vec_fiq_exits))[cpu]++;
+
+	return SUCCESS;
 }
 
 result_t vec_fini(void) {